@@ -0,0 +1,36 @@
+#!/bin/bash
+
+# Compare the two stack splitting routes on the Lehmann dataset:
+# StackBreaker after type recovery (default) and DSROA before it
+# (NOTDEC_DSROA=1). For each binary prints the size of the bottom up
+# constraint graphs (from NOTDEC_MEMORY_REPORT) and the end-to-end time.
+#
+# usage: benchDSROA.sh [output.csv]
+
+SCRIPTPATH="$( cd -- "$(dirname "$0")" >/dev/null 2>&1 ; pwd -P )"
+NOTDEC=$SCRIPTPATH/../../../build/bin/notdec
+OUT=${1:-$SCRIPTPATH/benchDSROA.csv}
+TMP=$(mktemp -d)
+
+echo "file,route,nodes,edges,peak_rss,seconds" > $OUT
+for i in `ls $SCRIPTPATH/wasm`
+do
+  for route in stackbreaker dsroa
+  do
+    if [ $route = dsroa ]; then
+      export NOTDEC_DSROA=1
+    else
+      unset NOTDEC_DSROA
+    fi
+    START=$(date +%s.%N)
+    NOTDEC_MEMORY_REPORT=$TMP/report.jsonl $NOTDEC $SCRIPTPATH/wasm/$i -o $TMP/out.c > /dev/null 2>&1
+    END=$(date +%s.%N)
+    TOTAL=$(grep '"phase":"bottom-up"' $TMP/report.jsonl | grep -v '"scc"' | tail -n 1)
+    NODES=$(echo "$TOTAL" | sed -n 's/.*"nodes":\([0-9]*\).*/\1/p')
+    EDGES=$(echo "$TOTAL" | sed -n 's/.*"edges":\([0-9]*\).*/\1/p')
+    RSS=$(echo "$TOTAL" | sed -n 's/.*"peak_rss":\([0-9]*\).*/\1/p')
+    echo "$i,$route,$NODES,$EDGES,$RSS,$(awk "BEGIN { print $END - $START }")" | tee -a $OUT
+  done
+done
+unset NOTDEC_DSROA
+rm -rf $TMP
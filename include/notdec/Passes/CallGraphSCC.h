@@ -0,0 +1,77 @@
+#ifndef _NOTDEC_PASSES_CALL_GRAPH_SCC_H_
+#define _NOTDEC_PASSES_CALL_GRAPH_SCC_H_
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/Analysis/CallGraph.h>
+#include <llvm/IR/InstrTypes.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/PassManager.h>
+
+namespace notdec {
+
+/// Map from callee to all its call sites and the calling node.
+using FuncCallerMap =
+    std::map<llvm::CallGraphNode *,
+             std::vector<std::pair<llvm::CallBase *, llvm::CallGraphNode *>>>;
+
+/// Call graph of the module, split into SCCs.
+struct CallGraphSCCInfo {
+  llvm::CallGraph CG;
+  /// SCCs in post order, i.e., callees before callers.
+  std::vector<std::vector<llvm::CallGraphNode *>> SCCs;
+  llvm::DenseMap<const llvm::CallGraphNode *, std::size_t> Node2SCC;
+  /// The SCC DAG: indices of the SCCs called by each SCC.
+  std::vector<std::vector<std::size_t>> SCCCallees;
+  /// 0 for SCCs that call no other SCC, otherwise one more than the highest
+  /// callee. SCCs on the same level do not depend on each other.
+  std::vector<std::size_t> SCCLevels;
+  std::size_t NumLevels = 0;
+  FuncCallerMap FuncCallers;
+
+  explicit CallGraphSCCInfo(llvm::Module &M);
+
+  /// Rescan the calls of F after it is rewritten, without walking the other
+  /// functions.
+  void updateFunction(llvm::Function &F);
+  /// Same as updateFunction, recomputing the SCCs once for all of Fs.
+  void updateFunctions(llvm::ArrayRef<llvm::Function *> Fs);
+
+protected:
+  /// Recompute the SCCs, the DAG and the callers from the call graph edges.
+  void recalculate();
+};
+
+/// Split an SCC into pieces of at most MaxSize functions, by cutting the
+/// call edges with the fewest call sites until no component is larger. The
+/// pieces are in post order of the remaining edges, so only the cut calls go
+/// from a piece to a later one.
+std::vector<std::vector<llvm::CallGraphNode *>>
+splitSCC(const std::vector<llvm::CallGraphNode *> &SCC, std::size_t MaxSize);
+
+/// Cached call graph SCCs. Passes that rewrite functions (e.g. StackBreaker,
+/// FunctionRenamer) update the cached result with updateFunctions and
+/// preserve it.
+class CallGraphSCCAnalysis
+    : public llvm::AnalysisInfoMixin<CallGraphSCCAnalysis> {
+public:
+  static inline llvm::AnalysisKey Key; // NOLINT
+  friend llvm::AnalysisInfoMixin<CallGraphSCCAnalysis>;
+
+  // shared so that users can keep the old graph until they are refreshed.
+  using Result = std::shared_ptr<CallGraphSCCInfo>;
+
+  Result run(llvm::Module &M, llvm::ModuleAnalysisManager &) {
+    return std::make_shared<CallGraphSCCInfo>(M);
+  }
+};
+
+} // namespace notdec
+
+#endif
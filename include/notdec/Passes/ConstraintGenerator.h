@@ -11,6 +11,8 @@
 #include <deque>
 #include <functional>
 #include <iostream>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/MapVector.h>
 #include <llvm/Analysis/CallGraph.h>
 #include <llvm/IR/Constant.h>
 #include <llvm/IR/InstrTypes.h>
@@ -35,6 +37,8 @@
 #include <llvm/IR/Value.h>
 #include <llvm/Support/FormattedStream.h>
 
+#include "Passes/CallGraphSCC.h"
+#include "TypeRecovery/BinaryFormat.h"
 #include "TypeRecovery/ConstraintGraph.h"
 #include "TypeRecovery/DotSummaryParser.h"
 #include "TypeRecovery/Lattice.h"
@@ -43,6 +47,8 @@
 #include "TypeRecovery/retypd/Schema.h"
 #include "TypeRecovery/TRContext.h"
 #include "Utils/DSUMap.h"
+#include "Utils/ExtValuePtrInfo.h"
+#include "Utils/ValueNamerLock.h"
 #include "notdec-llvm2c/Interface/HType.h"
 #include "notdec-llvm2c/Interface/ValueNamer.h"
 
@@ -66,7 +72,13 @@ struct ConstraintsGenerator;
 
 const char *getTRDebugDir();
 bool isDisableInterFunction();
-std::optional<std::string> getSCCDebugDir(std::size_t SCCIndex);
+// Keep all per-SCC graphs until TypeRecovery is destroyed, instead of freeing
+// them after their last use. NOTDEC_KEEP_GRAPHS=1, or implied by the debug dir
+// because the annotated dumps print every graph.
+bool isKeepAllGraphs();
+// NOTDEC_DEBUG_DUMP_FILTER can select SCCs by name, see DebugDump.
+std::optional<std::string> getSCCDebugDir(std::size_t SCCIndex,
+                                          const std::string &SCCName);
 std::optional<int64_t> getAllocSize(ExtValuePtr Val);
 std::string getUniquePath(const std::string &basePath, const char *suffix);
 
@@ -91,6 +103,13 @@ struct SCCData {
   std::shared_ptr<ConstraintsGenerator> TopDownGenerator;
   std::shared_ptr<ConstraintsGenerator> SketchGenerator;
   std::shared_ptr<SCCTypeResult> TypeResult;
+  /// Pieces of a call graph SCC split by NOTDEC_SCC_SPLIT_THRESHOLD share the
+  /// SCC index range [SplitBegin, SplitEnd). Calls to a later piece are cut,
+  /// and the bottom-up phase repeats the range to resolve them.
+  std::size_t SplitBegin = 0;
+  std::size_t SplitEnd = 0;
+
+  bool isSplit() const { return SplitBegin != SplitEnd; }
 
   void onIRChanged() {
     BottomUpGenerator.reset();
@@ -102,14 +121,13 @@ struct SCCData {
 
 struct AllGraphs {
   std::vector<SCCData> AllSCCs;
-  std::map<llvm::CallGraphNode *, std::size_t> Func2SCCIndex;
+  llvm::DenseMap<llvm::CallGraphNode *, std::size_t> Func2SCCIndex;
   // Graph for global variables.
   std::shared_ptr<ConstraintsGenerator> Global;
   // Sketch graph for global variables.
   std::shared_ptr<ConstraintsGenerator> GlobalSketch;
-  std::map<llvm::CallGraphNode *,
-           std::vector<std::pair<llvm::CallBase *, llvm::CallGraphNode *>>>
-      FuncCallers;
+  // owned by the CallGraphSCCInfo in TypeRecovery::CallG
+  const FuncCallerMap *FuncCallers = nullptr;
   llvm::CallGraph *CG = nullptr;
 
   void onIRChanged() {
@@ -142,7 +160,7 @@ struct TypeRecovery {
       SignatureOverride;
   std::map<llvm::CallBase *, std::shared_ptr<ConstraintsGenerator>>
       CallsiteSummaryOverride;
-  std::unique_ptr<llvm::CallGraph> CallG;
+  std::shared_ptr<CallGraphSCCInfo> CallG;
   // for recreating alloca range that is eliminated as dead code.
   std::unique_ptr<std::map<llvm::Function *,
                            std::vector<std::pair<SimpleRange, std::string>>>>
@@ -177,12 +195,20 @@ struct TypeRecovery {
                                      llvm::ModuleAnalysisManager &MAM) {
     assert((!AG.AllSCCs.empty()) && "function run() is not called!");
     if (ResultVal == nullptr) {
+      refreshCallGraph(M1, MAM);
       genASTTypes(M1);
     }
     return ResultVal;
   }
+  // Record the graph of the SCC after a phase, see MemoryReport. Without G,
+  // the AST types of the SCC are counted.
+  void reportMemory(const SCCData &Data, const char *Phase,
+                    const ConstraintsGenerator *G);
   // Prepare topological order of SCC in AG.AllSCCs
-  void prepareSCC(llvm::CallGraph &CG);
+  void prepareSCC(CallGraphSCCInfo &Info);
+  // Move AG to the current CallGraphSCCAnalysis result if the cached one was
+  // invalidated, e.g., by the level 3 optimizations.
+  void refreshCallGraph(llvm::Module &M, llvm::ModuleAnalysisManager &MAM);
   void bottomUpPhase();
   std::shared_ptr<ConstraintsGenerator>
   getBottomUpGraph(SCCData &Data,
@@ -205,6 +231,15 @@ struct TypeRecovery {
 
   // NOTDEC_SUMMARY_OVERRIDE
   const char *SummaryFile;
+  // NOTDEC_SUMMARY_LIBRARY: precompiled summaries, see notdec-summary. The
+  // notdec-summary-library target (not built by default) compiles
+  // experiment/dataset/summarys.json, which only covers the dataset helpers,
+  // not the wasi or emscripten imports.
+  const char *SummaryLibFile;
+  std::unique_ptr<retypd::SummaryLibrary> SummaryLib;
+  // undecoded library summaries of the external functions, see
+  // getSummaryOverride.
+  std::map<std::set<llvm::Function *>, llvm::StringRef> LibrarySummaries;
   // NOTDEC_SIGNATURE_OVERRIDE
   const char *SigFile;
   // NOTDEC_TYPE_RECOVERY_TRACE_IDS
@@ -217,6 +252,7 @@ struct TypeRecovery {
                std::shared_ptr<ast::HTypeContext> HTCtx, llvm::Module &M)
       : Mod(M), TRCtx(TRCtx), HTCtx(HTCtx),
         SummaryFile(std::getenv("NOTDEC_SUMMARY_OVERRIDE")),
+        SummaryLibFile(std::getenv("NOTDEC_SUMMARY_LIBRARY")),
         SigFile(std::getenv("NOTDEC_SIGNATURE_OVERRIDE")),
         Traces(std::getenv("NOTDEC_TYPE_RECOVERY_TRACE_IDS")) {
     if (const char *path = std::getenv("NOTDEC_TYPE_RECOVERY_NO_SCC")) {
@@ -235,7 +271,17 @@ struct TypeRecovery {
   multiGraphDeterminizeTo(ConstraintsGenerator &CurrentTypes,
                           std::set<retypd::CGNode *> &StartNodes,
                           const char *NamePrefix);
+  // merge memory nodes of many graphs by determinizing them in a k-way
+  // reduction tree. NOTDEC_GLOBAL_MERGE_FANIN
+  static retypd::CGNode *
+  treeDeterminizeTo(TypeRecovery &Ctx, ConstraintsGenerator &CurrentTypes,
+                    std::vector<retypd::CGNode *> StartNodes,
+                    const char *NamePrefix);
   void loadSummaryFile(llvm::Module &M, const char *path);
+  void loadSummaryLibrary(llvm::Module &M, const char *path);
+  // Summary from the summary file, or from the library, decoded on first use.
+  std::shared_ptr<ConstraintsGenerator>
+  getSummaryOverride(const std::set<llvm::Function *> &SCCSet);
   void loadSignatureFile(llvm::Module &M, const char *path);
   void print(llvm::Module &M, std::string path);
   void printAnnotatedModule(const llvm::Module &M, std::string path, int level);
@@ -252,19 +298,26 @@ struct ConstraintsGenerator {
   // std::map<ExtValuePtr, retypd::NodeKey> Val2Node;
   // TODO
   // 使用getPreferredVariance合并两个map。key是ExtValuePtr带上variance的pair。
-  DSUMap<ExtValuePtr, CGNode *> V2N;
-  DSUMap<ExtValuePtr, CGNode *> V2NContra;
+  using ValueNodeMap =
+      DSUMap<ExtValuePtr, CGNode *, llvm::DenseMap<ExtValuePtr, std::size_t>>;
+  ValueNodeMap V2N;
+  ValueNodeMap V2NContra;
   void removeNode(retypd::CGNode &N);
+  /// Rough heap bytes, see MemoryReport.
+  std::size_t estimateBytes() const;
   // void removeNode(const retypd::NodeKey &K);
 
   retypd::ConstraintGraph CG;
   retypd::PNIGraph *PG;
   std::set<llvm::Function *> SCCs;
-  std::map<llvm::CallBase *, std::pair<retypd::CGNode *, retypd::CGNode *>>
+  // MapVector: summaries are instantiated in call insertion order.
+  llvm::MapVector<llvm::CallBase *,
+                  std::pair<retypd::CGNode *, retypd::CGNode *>>
       CallToInstance;
   // unhandled due to not having function body.
   // TODO: If reachable from function node, then it makes summary incorrect.
-  std::map<llvm::CallBase *, std::pair<retypd::CGNode *, retypd::CGNode *>>
+  llvm::MapVector<llvm::CallBase *,
+                  std::pair<retypd::CGNode *, retypd::CGNode *>>
       UnhandledCalls;
 
   DSUMap<std::pair<std::string, llvm::Type *>, CGNode *> PrimMap;
@@ -355,8 +408,30 @@ struct ConstraintsGenerator {
   void mergeArrayWithMember();
   void mergeNodeAndType(retypd::CGNode &From, retypd::CGNode &To);
   void mergeFixTypeInfo(retypd::CGNode &From, retypd::CGNode &To);
+  /// Nodes changed by mergeFixTypeInfo, collected for worklist passes that
+  /// must revisit them. Only recorded while MergeTrace is set.
+  struct MergeTraceTy {
+    std::set<retypd::CGNode *> Touched;
+    std::set<retypd::CGNode *> Removed;
+  };
+  MergeTraceTy *MergeTrace = nullptr;
 
   void run();
+  // Functions of the SCC in module order, independent of their addresses.
+  std::vector<llvm::Function *> getOrderedFuncs() const;
+  // Generate each function of the SCC into its own generator, on a thread
+  // pool if Threads > 1, then merge them in order. See
+  // NOTDEC_TYPE_RECOVERY_THREADS.
+  void runParallel(unsigned Threads);
+  // Set in the parts of runParallel: new type variables are named
+  // "<prefix><scope>_<n>" with a counter of the part instead of the global
+  // one, so the names do not depend on the scheduling.
+  std::string NameScope;
+  std::size_t NextScopedName = 0;
+  std::string getNewName(const char *Prefix = nullptr);
+  // Merge the graph and value maps of a generator built on the same SCC.
+  // Nodes of the same value, e.g., functions and globals, are unified.
+  void mergeFrom(ConstraintsGenerator &Part);
   // clone CG and maintain value map.
   // ConstraintsGenerator
   // clone(std::map<const retypd::CGNode *, retypd::CGNode *> &Old2New);
@@ -415,6 +490,12 @@ public:
 
   retypd::CGNode *getNodeOrNull(ExtValuePtr Val, llvm::User *User, long OpInd,
                                 retypd::Variance V);
+  // lookup of an already converted value.
+  retypd::CGNode *lookupNode(const ExtValuePtr &Val, retypd::Variance V) const {
+    auto &M = V == retypd::Covariant ? V2N : V2NContra;
+    auto It = M.find(Val);
+    return It == M.end() ? nullptr : It->second;
+  }
   const retypd::CGNode *getNodeOrNull(ExtValuePtr Val, llvm::User *User,
                                       long OpInd, retypd::Variance V) const {
     return const_cast<ConstraintsGenerator *>(this)->getNodeOrNull(Val, User,
@@ -432,6 +513,11 @@ public:
 
   retypd::CGNode &getOrInsertNode(ExtValuePtr Val, llvm::User *User, long OpInd,
                                   retypd::Variance V = retypd::Covariant);
+  // Create the nodes of the SSA values in F before the visitor runs, so that
+  // visitors only look them up and emit edges.
+  void createValueNodes(llvm::Function &F);
+  // Create the function, argument and return nodes of F if missing.
+  void createFuncNodes(llvm::Function &F);
 
   const TypeVariable &getTypeVar(ExtValuePtr val, llvm::User *User, long OpInd);
   // convert the value to a type variable.
@@ -439,6 +525,8 @@ public:
                               long OpInd = -1);
   TypeVariable convertTypeVarVal(Value *Val, llvm::User *User = nullptr,
                                  long OpInd = -1);
+  // name prefix of the type variable of an instruction.
+  static const char *getInstPrefix(llvm::Instruction &I);
   void addAddConstraint(const ExtValuePtr LHS, const ExtValuePtr RHS,
                         llvm::BinaryOperator *Result);
   void addSubConstraint(const ExtValuePtr LHS, const ExtValuePtr RHS,
@@ -448,6 +536,8 @@ public:
 
   TypeVariable addOffset(TypeVariable &dtv, OffsetRange Offset);
   unsigned getPointerElemSize(llvm::Type *ty);
+  // pointer type -> size of the pointee, in bits.
+  llvm::DenseMap<llvm::Type *, unsigned> ElemSizeCache;
   static inline bool is_cast(Value *Val) {
     return llvm::isa<llvm::AddrSpaceCastInst, llvm::BitCastInst,
                      llvm::PtrToIntInst, llvm::IntToPtrInst>(Val);
@@ -483,6 +573,7 @@ protected:
   // visitor class
   // Visit each basic block in topo order. Then handle dataflow of Phi nodes.
   // After visiting each instruction, it must be assigned a type variable.
+  // Nodes of instruction results are already created by createValueNodes.
   // Often visitor will immediately add a subtype constraint. If the primitive
   // type is final, then it will directly map as the known type.
   class RetypdGeneratorVisitor
@@ -546,7 +637,7 @@ std::string inline getFuncTvName(llvm::Function *Func) {
   if (Func->isIntrinsic()) {
     return llvm::Intrinsic::getBaseName(Func->getIntrinsicID()).str();
   }
-  return ValueNamer::getName(*Func, ValueNamer::FuncPrefix);
+  return getLockedName(*Func, ValueNamer::FuncPrefix);
 }
 
 inline TypeVariable getCallArgTV(TypeVariable &TV, int32_t Index) {
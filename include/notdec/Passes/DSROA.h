@@ -18,7 +18,13 @@ class AllocaSliceRewriter;
 
 }; // namespace dsroa
 
+// NOTDEC_DSROA=1: split the recovered stack with DSROAPass before type
+// recovery, instead of StackBreaker after it.
+bool isDSROAEnabled();
+
 // Decompiler SROA
+// Besides pointer uses, it follows the integer address arithmetic of the stack
+// from LinearAllocationRecovery (ptrtoint, add/sub constant, inttoptr).
 struct DSROAPass : llvm::PassInfoMixin<DSROAPass> {
   llvm::LLVMContext *C = nullptr;
   llvm::DominatorTree *DT = nullptr;
@@ -19,6 +19,7 @@
 #include <llvm/Transforms/Utils/Mem2Reg.h>
 
 #include "DecompilerContext.h"
+#include "Passes/CallGraphSCC.h"
 #include "Passes/ConstraintGenerator.h"
 #include "Passes/StackPointerFinder.h"
 #include "notdec-llvm2c/Interface.h"
@@ -48,6 +49,7 @@ struct PassEnv {
                            "linear-allocation-recovery");
     PIC.addClassToPassName("notdec::PointerTypeRecovery",
                            "pointer-type-recovery");
+    PIC.addClassToPassName("notdec::DSROAPass", "dsroa");
 
     // llvm2c passes
     PIC.addClassToPassName("notdec::llvm2c::AdjustCFGPass", "adjustcfg");
@@ -61,6 +63,7 @@ struct PassEnv {
     PB.registerLoopAnalyses(LAM);
     PB.crossRegisterProxies(LAM, FAM, SCCAM, MAM);
     MAM.registerPass([&]() { return StackPointerFinderAnalysis(); });
+    MAM.registerPass([&]() { return CallGraphSCCAnalysis(); });
   }
 
   std::shared_ptr<retypd::TRContext> TRCtx;
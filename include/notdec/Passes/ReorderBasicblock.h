@@ -8,7 +8,8 @@
 namespace notdec::passes {
 struct ReorderBlocksPass : public llvm::PassInfoMixin<ReorderBlocksPass> {
   // 收集支配顺序的基本块列表（入口块优先）
-  llvm::SmallVector<llvm::BasicBlock *, 32> getDomOrder(llvm::Function &F);
+  llvm::SmallVector<llvm::BasicBlock *, 32>
+  getDomOrder(llvm::Function &F, llvm::DominatorTree &DT);
 
   void traverseDomTree(llvm::DomTreeNode *node,
                        llvm::SmallVectorImpl<llvm::BasicBlock *> &blocks,
@@ -1,7 +1,9 @@
 #ifndef _NOTDEC_PASSES_STACK_ALLOCA_H_
 #define _NOTDEC_PASSES_STACK_ALLOCA_H_
 
+#include <llvm/ADT/ArrayRef.h>
 #include <llvm/IR/Instruction.h>
+#include <llvm/IR/Instructions.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/PassManager.h>
 #include <vector>
@@ -18,11 +20,18 @@ struct LinearAllocationRecovery
     return offset < 0 ? "N" + std::to_string(-offset) : std::to_string(offset);
   }
 
-  static void matchDynamicAllocas(llvm::Function &F, llvm::Value *SP,
-                                  llvm::Instruction *LoadSP,
+  /// Match dynamic allocations among the stores to the stack pointer.
+  /// Erased stores are null in SPStores.
+  static void matchDynamicAllocas(llvm::ArrayRef<llvm::StoreInst *> SPStores,
+                                  llvm::Value *SP, llvm::Instruction *LoadSP,
                                   llvm::Instruction *add_load_sp,
                                   llvm::Value *space, bool isGrowNegative);
 
+  /// Recover the stack allocation of a single function. Only the function
+  /// itself is accessed, so functions can be processed independently.
+  static void recoverFunction(llvm::Function &F, llvm::GlobalVariable *SP,
+                              bool isGrowNegative);
+
   llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &);
 };
 
@@ -17,6 +17,7 @@
 #include <unordered_set>
 #include <vector>
 
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/ADT/SmallPtrSet.h>
 #include <llvm/IR/Module.h>
 
@@ -35,8 +36,9 @@ using Changed = bool;
 
 using BBEntrySet = std::unordered_set<BasicBlockEntry*>;
 
-using DefSet = std::unordered_set<Definition*>;
-using UseSet = std::unordered_set<Use*>;
+// Def-use chains. Every pair is linked once, so vectors are enough.
+using DefSet = std::vector<Definition*>;
+using UseSet = std::vector<Use*>;
 
 using DefVector = std::vector<Definition>;
 using UseVector = std::vector<Use>;
@@ -90,9 +92,6 @@ class BasicBlockEntry
 				std::ostream& out,
 				const BasicBlockEntry& bbe);
 
-		void initializeKillDefSets();
-		Changed initDefsOut();
-
 		const DefSet& defsFromUse(const llvm::Instruction* I) const;
 		const UseSet& usesFromDef(const llvm::Instruction* I) const;
 		const Definition* getDef(const llvm::Instruction* I) const;
@@ -106,13 +105,6 @@ class BasicBlockEntry
 
 		BBEntrySet prevBBs;
 
-		// defsIn is union of prevBBs' defsOuts
-		DefSet defsOut;
-		DefSet genDefs;
-		std::unordered_set<llvm::Value*> killDefs;
-
-		bool changed = false;
-
 	private:
 		unsigned id;
 };
@@ -134,10 +126,18 @@ class ReachingDefinitionsAnalysis
 	// Full instance interface.
 	//
 	public:
+		/// Single use instructions: load, ptrtoint and GEP.
 		const DefSet& defsFromUse(const llvm::Instruction* I) const;
+		/// Use of the value by the instruction, e.g. a call argument.
+		const DefSet& defsFromUse(
+				const llvm::Instruction* I,
+				const llvm::Value* src) const;
 		const UseSet& usesFromDef(const llvm::Instruction* I) const;
 		const Definition* getDef(const llvm::Instruction* I) const;
 		const Use* getUse(const llvm::Instruction* I) const;
+		const Use* getUse(
+				const llvm::Instruction* I,
+				const llvm::Value* src) const;
 
 		friend std::ostream& operator<<(
 				std::ostream& out,
@@ -152,18 +152,24 @@ class ReachingDefinitionsAnalysis
 				llvm::Instruction* I);
 
 	private:
+		using BBEntryMap = std::map<const llvm::BasicBlock*, BasicBlockEntry>;
+
 		void run();
-		const BasicBlockEntry& getBasicBlockEntry(const llvm::Instruction* I) const;
 		void initializeBasicBlocks(llvm::Module& M);
 		void initializeBasicBlocks(llvm::Function& F);
 		void initializeBasicBlocksPrev();
-		void initializeKillGenSets();
 		void propagate();
-		void initializeDefsAndUses();
-		void clearInternal();
+		void propagate(const llvm::Function* F, BBEntryMap& bbs);
+		void initializeInstructionMaps();
 
 	private:
-		std::map<const llvm::Function*, std::map<const llvm::BasicBlock*, BasicBlockEntry>> bbMap;
+		std::map<const llvm::Function*, BBEntryMap> bbMap;
+		/// Instruction -> its definition, (instruction, used value) -> its
+		/// use, for O(1) queries.
+		llvm::DenseMap<const llvm::Instruction*, const Definition*> _defMap;
+		llvm::DenseMap<
+				std::pair<const llvm::Instruction*, const llvm::Value*>,
+				const Use*> _useMap;
 		bool _trackFlagRegs = false;
 		bool _run = false;
 		Abi* _abi = nullptr;
@@ -48,6 +48,8 @@ class StackAnalysis : public llvm::PassInfoMixin<StackAnalysis>
 		Abi* _abi = nullptr;
 
 		std::unordered_set<llvm::Value*> _toRemove;
+		/// Expanded symbolic trees of the current function.
+		SymbolicTreeMemo _memo;
 };
 
 } // namespace bin2llvmir
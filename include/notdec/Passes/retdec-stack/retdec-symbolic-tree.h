@@ -11,10 +11,17 @@
 #ifndef RETDEC_BIN2LLVMIR_ANALYSES_SYMBOLIC_TREE_H
 #define RETDEC_BIN2LLVMIR_ANALYSES_SYMBOLIC_TREE_H
 
+#include <memory>
+#include <optional>
 #include <set>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/Allocator.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Instruction.h>
 #include <llvm/IR/Instructions.h>
@@ -27,6 +34,91 @@
 namespace retdec {
 namespace bin2llvmir {
 
+class SymbolicTree;
+
+/**
+ * Memo table of expanded symbolic tree nodes, shared by all trees constructed
+ * while it is set by @c SymbolicTree::setMemo().
+ *
+ * Nodes are hash-consed by (value, remaining expansion depth) into a DAG, so
+ * common subexpressions (e.g. stack pointer loads) are expanded only once.
+ * Only trees built with a precomputed RDA and the same value map are cached.
+ * Whoever modifies the IR or the value map must call @c invalidate() on every
+ * value whose operands or mapping changed.
+ */
+class SymbolicTreeMemo
+{
+	public:
+		using Key = std::pair<llvm::Value*, unsigned>;
+		struct Entry;
+		/// Operand of an entry. Leaves (constants, arguments) have no entry.
+		struct Op
+		{
+			Entry* entry = nullptr;
+			llvm::Value* value = nullptr;
+			llvm::Value* user = nullptr;
+		};
+
+		struct Entry
+		{
+			Key key;
+			llvm::Value* value = nullptr;
+			llvm::Value* user = nullptr;
+			/// Whether the node keeps the user it was constructed with,
+			/// i.e. it was not replaced by its operand at creation.
+			bool userFromCtor = true;
+			bool val2valUsed = false;
+			/// Whether the stack pointer register is in the tree.
+			bool stackPointer = false;
+			llvm::SmallVector<Op, 3> ops;
+			/// Entries which have this entry as an operand.
+			llvm::SmallVector<Entry*, 2> parents;
+
+			/// Cached result of simplifying the node.
+			std::unique_ptr<SymbolicTree> simplified;
+		};
+
+		SymbolicTreeMemo();
+		SymbolicTreeMemo(const SymbolicTreeMemo&) = delete;
+		SymbolicTreeMemo& operator=(const SymbolicTreeMemo&) = delete;
+
+		/**
+		 * Drop all entries built from @a v, and all entries using them.
+		 */
+		void invalidate(llvm::Value* v);
+		/**
+		 * Drop all entries. Trees built before stop using their cached
+		 * simplification.
+		 */
+		void clear();
+
+	private:
+		friend class SymbolicTree;
+
+		static bool isLeaf(llvm::Value* v);
+		bool accepts(
+				ReachingDefinitionsAnalysis* rda,
+				std::map<llvm::Value*, llvm::Value*>* val2val,
+				bool linear);
+
+		Entry* lookup(const Key& key) const;
+		void insert(Entry* e);
+		bool erase(Entry* e);
+		bool isLive(const Entry* e, unsigned generation) const;
+		const SymbolicTree& simplified(Entry* e);
+
+		/// Entries of each value, indexed by the remaining depth.
+		llvm::DenseMap<llvm::Value*, llvm::SmallVector<Entry*, 2>> _entries;
+		/// Owns all entries, including invalidated ones, until clear().
+		llvm::SpecificBumpPtrAllocator<Entry> _storage;
+		/// Entries being expanded, innermost last.
+		std::vector<Entry*> _building;
+		unsigned _generation = 0;
+		bool _bound = false;
+		ReachingDefinitionsAnalysis* _rda = nullptr;
+		std::map<llvm::Value*, llvm::Value*>* _val2val = nullptr;
+};
+
 /**
  * Tracking values through load/store operations using reaching definition
  * analysis.
@@ -67,6 +159,20 @@ class SymbolicTree
 				std::map<llvm::Value*, llvm::Value*>* val2val,
 				unsigned maxNodeLevel = 10
 		);
+		/**
+		 * The same as PrecomputedRdaWithValueMap() followed by
+		 * simplifyNode(), for trees which may simplify to a stack offset,
+		 * i.e. use the value map or contain the stack pointer register.
+		 * Returns nothing for other trees.
+		 * If a memo is set (see setMemo()), the simplification is computed
+		 * on the memo DAG and the tree is never expanded.
+		 */
+		static std::optional<SymbolicTree> PrecomputedRdaWithValueMapSimplified(
+				ReachingDefinitionsAnalysis& rda,
+				llvm::Value* v,
+				std::map<llvm::Value*, llvm::Value*>* val2val,
+				unsigned maxNodeLevel = 10
+		);
 		/**
 		 * SymbolicTree is constructed using on demand RDA features.
 		 * I.e. RDA is not precomputed, but it is constructed as needed.
@@ -111,6 +217,7 @@ class SymbolicTree
 		bool isBinary() const;
 		bool isTernary() const;
 		bool isNary(unsigned N) const;
+		bool anyOf(llvm::function_ref<bool(const SymbolicTree&)> pred) const;
 
 		unsigned getLevel() const;
 
@@ -146,6 +253,7 @@ class SymbolicTree
 		static void setTrackOnlyFlagRegisters(bool b);
 		static void setSimplifyAtCreation(bool b);
 		static void setNaryLimit(unsigned n);
+		static void setMemo(SymbolicTreeMemo* memo);
 
 	private:
 		static Abi* _abi;
@@ -156,10 +264,29 @@ class SymbolicTree
 		static bool _trackOnlyFlagRegisters;
 		static bool _simplifyAtCreation;
 		static unsigned _naryLimit;
+		static SymbolicTreeMemo* _memoTable;
 
 	// Private methods.
 	//
 	private:
+		SymbolicTree(
+				SymbolicTreeMemo::Entry* entry,
+				llvm::Value* v,
+				llvm::Value* u,
+				unsigned nodeLevel,
+				unsigned generation);
+		void materialize(SymbolicTreeMemo::Entry* entry, unsigned generation);
+		void constructMemoized(
+				SymbolicTreeMemo* memo,
+				ReachingDefinitionsAnalysis* rda,
+				llvm::Value* u,
+				unsigned maxNodeLevel,
+				std::map<llvm::Value*, llvm::Value*>* val2val);
+		void construct(
+				ReachingDefinitionsAnalysis* rda,
+				std::map<llvm::Value*, llvm::Value*>* val2val,
+				unsigned maxNodeLevel,
+				bool linear);
 		void expandNode(
 				ReachingDefinitionsAnalysis* RDA,
 				std::map<llvm::Value*, llvm::Value*>* val2val,
@@ -167,6 +294,7 @@ class SymbolicTree
 				bool linear);
 
 		void _simplifyNode();
+		void _simplifyOps();
 		void fixLevel(unsigned level = 0);
 
 		void _getPreOrder(std::vector<SymbolicTree*>& res) const;
@@ -191,7 +319,13 @@ class SymbolicTree
 	// Private data.
 	//
 	private:
+		friend class SymbolicTreeMemo;
+
 		unsigned _level = 1;
+		/// Memo entry this node was built from. Reset once the node is
+		/// simplified, since simplification changes the node.
+		SymbolicTreeMemo::Entry* _memoEntry = nullptr;
+		unsigned _memoGeneration = 0;
 };
 
 } // namespace bin2llvmir
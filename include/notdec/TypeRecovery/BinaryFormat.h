@@ -0,0 +1,84 @@
+#ifndef _NOTDEC_RETYPD_BINARYFORMAT_H_
+#define _NOTDEC_RETYPD_BINARYFORMAT_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include "TypeRecovery/ConstraintGraph.h"
+
+namespace notdec::retypd {
+
+/// Versioned binary format for constraint summaries and constraint graphs.
+///
+/// Layout (little endian, every record aligned to 4 bytes):
+///   header:  magic "NDTR", u32 version, u32 kind, u32 pointer size
+///   strings: u32 count, { u32 len, bytes }
+///   labels:  u32 count, { FieldLabel }, strings referenced by index
+///   tvars:   u32 count, { TypeVariable }, labels referenced by index
+///   body:    summary constraints and PNI map, or graph nodes and edges.
+/// Loading only interns the type variables, no text is parsed. The pointer of
+/// int constants (BaseConstant::User) is not kept.
+constexpr uint32_t BinaryFormatVersion = 1;
+enum class BinaryKind : uint32_t { Summary = 1, Graph = 2, Library = 3 };
+
+/// check the magic number and return the kind, if the buffer is a binary file.
+std::optional<BinaryKind> getBinaryKind(llvm::StringRef Buffer);
+
+/// Only subtype constraints can be saved. Return nullopt for other kinds.
+std::optional<std::string> writeBinarySummary(const ConstraintSummary &Summary);
+std::optional<ConstraintSummary> readBinarySummary(TRContext &Ctx,
+                                                   llvm::StringRef Buffer);
+
+/// Snapshot of a graph, including its PNIGraph. Pending PNI constraints
+/// (add/sub) are not saved.
+std::string writeBinaryGraph(const ConstraintGraph &G);
+/// Read the snapshot into an empty graph. Return false if the file is broken.
+bool readBinaryGraph(llvm::StringRef Buffer, ConstraintGraph &G);
+
+/// Precompiled library of summaries, keyed by function names ("f" or "f,g"
+/// for a SCC). The body is an index sorted by name, followed by the names and
+/// the binary summaries:
+///   u32 entry count, u32 single function entry count,
+///   { u32 name offset, u32 name size, u32 summary offset, u32 summary size }
+/// Single function entries come first, so they can be found by binary search.
+std::string
+writeBinaryLibrary(const std::map<std::string, std::string> &Summaries,
+                   long PointerSize);
+
+/// Read-only view of a library file. The file is memory mapped, and summaries
+/// are only decoded when they are looked up.
+class SummaryLibrary {
+  struct Entry {
+    llvm::StringRef Name;
+    llvm::StringRef Summary;
+  };
+  std::unique_ptr<llvm::MemoryBuffer> Buffer;
+  std::vector<Entry> Entries;
+  size_t NumSingle = 0;
+  long PointerSize = 0;
+
+public:
+  static std::unique_ptr<SummaryLibrary> open(const std::string &Path);
+  /// Validate the index of an in-memory library.
+  static std::unique_ptr<SummaryLibrary>
+  create(std::unique_ptr<llvm::MemoryBuffer> Buffer);
+
+  long getPointerSize() const { return PointerSize; }
+  size_t size() const { return Entries.size(); }
+  /// Binary summary of a single function, if present.
+  std::optional<llvm::StringRef> lookup(llvm::StringRef FuncName) const;
+  /// Entries whose key contains more than one function.
+  std::vector<std::pair<llvm::StringRef, llvm::StringRef>>
+  multiFunctionEntries() const;
+};
+
+} // namespace notdec::retypd
+
+#endif
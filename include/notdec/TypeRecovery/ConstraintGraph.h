@@ -2,6 +2,7 @@
 #define _NOTDEC_RETYPD_GRAPH_H_
 
 #include <cassert>
+#include <cstdint>
 #include <list>
 #include <llvm/ADT/Optional.h>
 #include <llvm/IR/Type.h>
@@ -11,6 +12,7 @@
 #include <set>
 #include <string>
 #include <tuple>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -43,6 +45,7 @@ struct ConstraintSummary {
   std::map<TypeVariable, std::string> PNIMap;
 
   void fromJSON(TRContext &Ctx, const llvm::json::Object &Obj);
+  llvm::json::Object toJSON() const;
 };
 
 std::shared_ptr<retypd::ConstraintSummary>
@@ -51,6 +54,7 @@ buildPrintfSummary(retypd::TRContext &Ctx, uint32_t PointerSize,
 
 struct CGNode;
 struct ConstraintGraph;
+struct DotGraph;
 
 struct NodeKey {
   TypeVariable Base;
@@ -92,6 +96,36 @@ std::string toString(const NodeKey &K);
 struct CGNode;
 struct CGEdge;
 
+/// Hash consistent with EdgeLabel::operator==. Type variables are pooled in
+/// the TRContext, so their pointers identify their values.
+struct EdgeLabelHash {
+  std::size_t operator()(const EdgeLabel &L) const;
+};
+
+/// Interned edge labels of one graph. Edges keep the id, so edge sets compare
+/// integers. The ids follow the order the graph is built in, which does not
+/// depend on other graphs or threads, and the per-node labels are freed with
+/// the graph.
+struct LabelPool {
+  std::unordered_map<EdgeLabel, uint32_t, EdgeLabelHash> Ids;
+  std::vector<const EdgeLabel *> Labels;
+
+  uint32_t intern(const EdgeLabel &L) {
+    auto [It, Inserted] = Ids.try_emplace(L, Labels.size());
+    if (Inserted) {
+      Labels.push_back(&It->first);
+    }
+    return It->second;
+  }
+  const EdgeLabel &get(uint32_t Id) const { return *Labels[Id]; }
+  std::size_t estimateBytes() const {
+    return Ids.size() * (sizeof(std::pair<const EdgeLabel, uint32_t>) +
+                         2 * sizeof(void *)) +
+           Ids.bucket_count() * sizeof(void *) +
+           Labels.capacity() * sizeof(const EdgeLabel *);
+  }
+};
+
 struct CGNode {
   ConstraintGraph &Parent;
   unsigned long Id = 0;
@@ -99,6 +133,10 @@ struct CGNode {
   unsigned Size;
   std::set<CGEdge *> inEdges;
   std::set<CGEdge> outEdges;
+  /// The recall offset edges of outEdges, ordered by offset. Kept up to date
+  /// as edges are added, removed or relabeled, so that layout queries on
+  /// memory-like nodes with many fields do not scan outEdges.
+  std::multimap<OffsetTy, const CGEdge *> OffsetEdges;
 
   using iterator = std::set<CGEdge>::iterator;
   using pred_iterator = std::set<CGEdge *>::iterator;
@@ -126,6 +164,8 @@ protected:
   friend struct PNIGraph;
   friend struct ConstraintGraph;
   void setPNIVar(PNINode *N) { PNIVar = N; }
+  void indexOffsetEdge(const CGEdge &E);
+  void unindexOffsetEdge(const CGEdge &E);
   void setPNIPointer() {
     assert(PNIVar != nullptr);
     PNIVar->setPtr();
@@ -184,21 +224,31 @@ public:
 struct CGEdge {
   CGNode &FromNode;
   CGNode &TargetNode;
-  EdgeLabel Label;
-  CGEdge(CGNode &From, CGNode &Target, const EdgeLabel &L)
-      : FromNode(From), TargetNode(Target), Label(L) {}
 
-  const EdgeLabel &getLabel() const { return Label; }
+protected:
+  // Label interned in the LabelPool of the graph.
+  const EdgeLabel *Label;
+  uint32_t LabelId;
+  friend struct CGNode;
+  void setLabel(const EdgeLabel &L);
+
+public:
+  CGEdge(CGNode &From, CGNode &Target, const EdgeLabel &L);
+
+  const EdgeLabel &getLabel() const { return *Label; }
+  uint32_t getLabelId() const { return LabelId; }
 
   const CGNode &getTargetNode() const { return TargetNode; }
   CGNode &getTargetNode() { return TargetNode; }
   const CGNode &getSourceNode() const { return FromNode; }
   CGNode &getSourceNode() { return FromNode; }
 
+  // Edges are ordered by label id, not by label value, then by target id.
+  // Both follow the construction order of the graph, not the addresses.
   bool operator<(const CGEdge &rhs) const {
-    auto p1 = &TargetNode;
-    auto p2 = &rhs.TargetNode;
-    return std::tie(Label, p1) < std::tie(rhs.Label, p2);
+    auto Id1 = TargetNode.getId();
+    auto Id2 = rhs.TargetNode.getId();
+    return std::tie(LabelId, Id1) < std::tie(rhs.LabelId, Id2);
   }
 };
 
@@ -216,6 +266,7 @@ struct RevEdge {
 
 struct ConstraintGraph {
   std::shared_ptr<retypd::TRContext> Ctx;
+  LabelPool Labels;
   std::string Name;
   std::unique_ptr<PNIGraph> PG;
   std::list<CGNode> Nodes;
@@ -276,6 +327,9 @@ struct ConstraintGraph {
   void removeNode(CGNode &N);
 
   std::string getName() const { return Name; }
+  /// Rough heap bytes of the graph and its PNI graph, for memory reports.
+  std::size_t estimateBytes() const;
+  std::size_t getNumEdges() const;
   using iterator = decltype(Nodes)::iterator;
   iterator begin() { return Nodes.begin(); }
   iterator end() { return Nodes.end(); }
@@ -338,6 +392,7 @@ public:
   void ensureNoForgetLabel();
   std::vector<SubTypeConstraint> solve_constraints_between();
   void printGraph(const char *DotFile) const;
+  void printGraph(llvm::raw_ostream &OS) const;
   ConstraintGraph getSubGraph(const std::set<const CGNode *> &Roots,
                               bool AllReachable) const;
   std::set<const CGNode *>
@@ -353,6 +408,10 @@ public:
   static ConstraintGraph fromConstraints(std::shared_ptr<retypd::TRContext> Ctx,
                                          std::string FuncName,
                                          const ConstraintSummary &Summary);
+  /// Rebuild an empty graph from its printGraph output, parsed by
+  /// parseDotSummary. Edges to nodes or strings are not supported. Return
+  /// false if a node or edge label cannot be parsed.
+  bool fromDotSummary(const DotGraph &G);
 
   bool hasEdge(const CGNode &From, const CGNode &To, EdgeLabel Label) const {
     assert(&From.Parent == this && &To.Parent == this);
@@ -400,6 +459,7 @@ public:
     auto it = From.outEdges.find(CGEdge(From, To, Label));
     assert(it != From.outEdges.end());
     To.inEdges.erase(const_cast<CGEdge *>(&*it));
+    From.unindexOffsetEdge(*it);
     From.outEdges.erase(it);
   }
 
@@ -414,6 +474,7 @@ public:
     auto it = From.outEdges.emplace(From, To, Label);
     if (it.second) {
       To.inEdges.insert(const_cast<CGEdge *>(&*it.first));
+      From.indexOffsetEdge(*it.first);
     }
     return &*it.first;
   }
@@ -475,11 +536,11 @@ inline NodeKey MakeReverseVariant(NodeKey Key) {
 }
 
 inline bool isOffsetOrOne(const CGEdge &E) {
-  if (auto Rec = E.Label.getAs<RecallLabel>()) {
+  if (auto Rec = E.getLabel().getAs<RecallLabel>()) {
     return Rec->label.isOffset();
-  } else if (auto Rec = E.Label.getAs<ForgetLabel>()) {
+  } else if (auto Rec = E.getLabel().getAs<ForgetLabel>()) {
     return Rec->label.isOffset();
-  } else if (E.Label.isOne()) {
+  } else if (E.getLabel().isOne()) {
     return true;
   }
   return false;
@@ -516,7 +577,7 @@ template <> struct GraphTraits<CGNode *> {
     return const_cast<CGNode *>(&Edge->getTargetNode());
   }
   static notdec::retypd::EdgeLabel getEdgeLabel(const CGEdge *Edge) {
-    return Edge->Label;
+    return Edge->getLabel();
   }
 
   // Provide a mapped iterator so that the GraphTrait-based implementations can
@@ -591,7 +652,7 @@ struct DOTGraphTraits<ConstraintGraph *> : public DefaultDOTGraphTraits {
                                 llvm::GraphTraits<NodeRef>::ChildIteratorType I,
                                 GraphRef CG) {
     return std::string("label=\"") +
-           notdec::retypd::toString((*I.getCurrent()).Label) + "\"";
+           notdec::retypd::toString((*I.getCurrent()).getLabel()) + "\"";
   }
 };
 
@@ -724,7 +785,7 @@ template <> struct GraphTraits<OffsetOnly<CGNode *>> {
     return const_cast<CGNode *>(&Edge->getTargetNode());
   }
   static notdec::retypd::EdgeLabel getEdgeLabel(const CGEdge *Edge) {
-    return Edge->Label;
+    return Edge->getLabel();
   }
 
   using FilteredIt = FilteredIterator<CGNode::iterator>;
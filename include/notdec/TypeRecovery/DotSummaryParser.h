@@ -1,3 +1,6 @@
+#ifndef _NOTDEC_RETYPD_DOTSUMMARYPARSER_H_
+#define _NOTDEC_RETYPD_DOTSUMMARYPARSER_H_
+
 #include <algorithm>
 #include <cassert>
 #include <cctype>
@@ -81,9 +84,10 @@ class DotParser {
 
   void parseAList(std::map<std::string, std::string> &attrs);
 
-  DotNode parseNodeStmt();
+  // the statements after the first node id.
+  DotNode parseNodeStmt(std::string nodeId);
 
-  DotEdge parseEdgeStmt();
+  DotEdge parseEdgeStmt(std::string from);
 
 public:
   DotParser(std::vector<std::pair<std::string, DotGraph>>& summary, std::string str)
@@ -97,6 +101,11 @@ public:
 
 };
 
+/// Parse graphs printed by ConstraintGraph::printGraph, each preceded by a
+/// "// <function>[,<function>...]" comment that names the summarized
+/// functions. The comment is optional, it is empty if missing.
 std::vector<std::pair<std::string, DotGraph>> parseDotSummary(const std::string &input);
 
 } // namespace notdec::retypd
+
+#endif
@@ -7,6 +7,8 @@
 #include <cassert>
 #include <clang/AST/Type.h>
 #include <cstddef>
+#include <cstdint>
+#include <llvm/ADT/StringRef.h>
 #include <optional>
 namespace notdec::retypd {
 
@@ -17,6 +19,15 @@ std::optional<unsigned> strToUl(std::string s);
 std::optional<unsigned> decodeSi(std::string s);
 std::optional<unsigned> decodeUi(std::string s);
 
+enum Signedness { SI_UNKNOW, SI_SIGNED, SI_UNSIGNED, SI_CONFLICT };
+
+/// Sign of an integer primitive name, e.g., SI_SIGNED for "sint32" and
+/// SI_UNKNOW for "int". std::nullopt if the name is not an integer type.
+std::optional<Signedness> getPrimitiveSign(llvm::StringRef Name);
+
+/// A lattice element. The domain is tiny, so the kind, sign and size are packed
+/// into one integer: elements are plain values, compared by their Id, and
+/// meet/join are table lookups.
 class LatticeTy {
 public:
   enum LatticeTyKind {
@@ -26,74 +37,46 @@ public:
   };
 
 protected:
-  LatticeTyKind kind;
-  unsigned Size = 0;
-
-public:
-  // const LowTy &getLowTy() const;
-  bool join(const LatticeTy &other);
-  bool meet(const LatticeTy &other);
-  HType *buildType(HTypeContext &ctx) const;
-
-  LatticeTy(LatticeTyKind Kind, unsigned Size) : kind(Kind), Size(Size){};
-  LatticeTy(const LatticeTy &Other) = delete;
-  LatticeTyKind getKind() const { return kind; }
-  unsigned getSize() const { return Size; }
-
-  static std::shared_ptr<LatticeTy> create(PNTy LTy, Variance V, std::string TyName);
-};
-
-enum Signedness { SI_UNKNOW, SI_SIGNED, SI_UNSIGNED, SI_CONFLICT };
+  // Size << 4 | Sign << 2 | Kind
+  uint32_t Id;
 
-class IntLattice : public LatticeTy {
-  Signedness Sign = SI_UNKNOW;
-
-public:
-  IntLattice(unsigned Size, Variance V)
-      : LatticeTy(LK_Int, Size),
-        Sign(V == Covariant ? SI_UNKNOW : SI_CONFLICT) {}
-  static bool classof(const LatticeTy *S) { return S->getKind() == LK_Int; }
-  static std::shared_ptr<IntLattice> create(PNTy LTy, Variance V, std::string TyName);
-  bool join(const IntLattice &Other);
-  bool meet(const IntLattice &Other);
-  HType *buildType(HTypeContext &ctx) const;
-
-  auto getSign() const { return Sign; }
+  LatticeTy(uint32_t Id) : Id(Id) {}
   bool setSign(Signedness NewSign) {
-    if (Sign == NewSign) {
+    if (getSign() == NewSign) {
       return false;
     }
-    Sign = NewSign;
+    Id = (Id & ~uint32_t(0xC)) | (uint32_t(NewSign) << 2);
     return true;
   }
-};
 
-class FloatLattice : public LatticeTy {
 public:
-  FloatLattice(unsigned Size) : LatticeTy(LK_Float, Size) {}
-  static bool classof(const LatticeTy *S) { return S->getKind() == LK_Float; }
-  static std::shared_ptr<FloatLattice> create(PNTy LTy, Variance V, std::string TyName) {
-    return std::make_shared<FloatLattice>(LTy.getSize());
-  }
-  bool join(const FloatLattice &Other) { return false; }
-  bool meet(const FloatLattice &Other) { return false; }
-};
+  // const LowTy &getLowTy() const;
+  bool join(const LatticeTy &other);
+  bool meet(const LatticeTy &other);
+  HType *buildType(HTypeContext &ctx) const;
 
-class PointerLattice : public LatticeTy {
-public:
-  PointerLattice(unsigned Size) : LatticeTy(LK_Pointer, Size) {}
-  static bool classof(const LatticeTy *S) { return S->getKind() == LK_Pointer; }
-  static std::shared_ptr<PointerLattice> create(PNTy LTy, Variance V, std::string TyName) {
-    return std::make_shared<PointerLattice>(LTy.getSize());
-  }
-  bool join(const PointerLattice &Other) { return false; }
-  bool meet(const PointerLattice &Other) { return false; }
+  LatticeTy(LatticeTyKind Kind, unsigned Size, Signedness Sign = SI_UNKNOW)
+      : Id((Size << 4) | (uint32_t(Sign) << 2) | uint32_t(Kind)) {}
+  LatticeTyKind getKind() const { return LatticeTyKind(Id & 0x3); }
+  unsigned getSize() const { return Id >> 4; }
+  Signedness getSign() const { return Signedness((Id >> 2) & 0x3); }
+  uint32_t getId() const { return Id; }
+  bool operator==(const LatticeTy &Other) const { return Id == Other.Id; }
+  bool operator!=(const LatticeTy &Other) const { return Id != Other.Id; }
+
+  /// Create from the low type and the sign of the primitive name. NameSign is
+  /// std::nullopt if there is no name.
+  static LatticeTy create(PNTy LTy, Variance V,
+                          std::optional<Signedness> NameSign);
+  static LatticeTy create(PNTy LTy, Variance V, llvm::StringRef TyName);
 };
 
-std::optional<std::shared_ptr<LatticeTy>> createLatticeTy(PNTy LTy, Variance V,
-                                         std::string Name);
-bool join(std::optional<std::shared_ptr<LatticeTy>> &L1, const std::optional<std::shared_ptr<LatticeTy>> &L2);
-bool meet(std::optional<std::shared_ptr<LatticeTy>> &L1, const std::optional<std::shared_ptr<LatticeTy>> &L2);
+std::optional<LatticeTy> createLatticeTy(PNTy LTy, Variance V,
+                                         llvm::StringRef Name);
+std::optional<LatticeTy> createLatticeTy(PNTy LTy, Variance V,
+                                         std::optional<Signedness> NameSign);
+bool join(std::optional<LatticeTy> &L1, const std::optional<LatticeTy> &L2);
+bool meet(std::optional<LatticeTy> &L1, const std::optional<LatticeTy> &L2);
 
 std::string getNameForInt(std::string Name, llvm::Type* Ty);
 // std::string getNameForInt(std::string Name, unsigned Size);
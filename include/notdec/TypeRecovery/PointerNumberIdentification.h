@@ -241,6 +241,7 @@ struct PNIGraph {
   PNIGraph(ConstraintGraph &CG, std::string Name, long PointerSize)
       : CG(CG), Name(Name), PointerSize(PointerSize) {}
   void cloneFrom(const PNIGraph &G, std::map<const CGNode *, CGNode *> Old2New);
+  std::size_t estimateBytes() const;
 
   void addAddCons(CGNode *Left, CGNode *Right, CGNode *Result,
                   llvm::BinaryOperator *Inst);
@@ -9,6 +9,7 @@
 #include "notdec-llvm2c/Interface/StructManager.h"
 #include "notdec-llvm2c/Interface/ValueNamer.h"
 #include <cstdint>
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/IR/DataLayout.h>
 #include <llvm/IR/DerivedTypes.h>
@@ -37,6 +38,20 @@ struct TypeBuilderContext {
   HTypeContext &Ctx;
   const llvm::DataLayout &DL;
   const unsigned PointerSize;
+  /// Sign of each primitive, so that names are parsed once.
+  std::map<const PooledTypeVariable *, std::optional<Signedness>>
+      PrimitiveSigns;
+
+  std::optional<Signedness> getPrimitiveSign(const TypeVariable &Prim) {
+    auto It = PrimitiveSigns.find(Prim.Var);
+    if (It == PrimitiveSigns.end()) {
+      It = PrimitiveSigns
+               .emplace(Prim.Var,
+                        retypd::getPrimitiveSign(Prim.getPrimitiveName()))
+               .first;
+    }
+    return It->second;
+  }
 
   // Todo: Change filename or remove the argument
   TypeBuilderContext(HTypeContext &Ctx, llvm::StringRef FileName,
@@ -47,7 +62,7 @@ struct TypeBuilderContext {
 struct TypeBuilder {
   TypeBuilderContext &Parent;
   HTypeContext &Ctx;
-  std::map<const CGNode *, HType *> NodeTypeMap;
+  llvm::DenseMap<const CGNode *, HType *> NodeTypeMap;
   std::set<const CGNode *> Visited;
   const std::map<CGNode *, TypeInfo>& TypeInfos;
 
@@ -91,7 +106,7 @@ struct TypeBuilder {
   }
 
   HType *fromLowTy(PNTy LTy, unsigned BitSize);
-  HType *fromLatticeTy(PNTy Low, LatticeTy *LTy, unsigned BitSize);
+  HType *fromLatticeTy(PNTy Low, const LatticeTy *LTy, unsigned BitSize);
 };
 
 } // namespace notdec::retypd
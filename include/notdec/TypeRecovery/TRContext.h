@@ -5,9 +5,14 @@
 #include <llvm/ADT/DenseSet.h>
 #include <llvm/ADT/SmallPtrSet.h>
 #include <llvm/Support/Allocator.h>
+#include <cstdint>
+#include <map>
+#include <mutex>
 #include <utility>
+#include <vector>
 
 #include "TypeRecovery/retypd/Schema.h"
+#include "Utils/MemoryReport.h"
 
 namespace notdec::retypd {
 
@@ -33,6 +38,14 @@ struct TRContext {
   // DenseMap<std::pair<FieldLabel, PooledTypeVariable *>, PooledTypeVariable *>
   //     DerivedTypeVars;
 
+  /// Guards TypeVars, constraint generation may run on several threads.
+  std::mutex Mutex;
+
+  std::size_t estimateBytes() const {
+    return estimateTreeBytes<PooledTypeVariable *>(TypeVars.size()) +
+           TypeVars.size() * sizeof(PooledTypeVariable);
+  }
+
   ~TRContext() {
     for (auto *TV : TypeVars) {
       delete TV;
@@ -1,61 +1,216 @@
-
+#include <cassert>
+#include <iterator>
 #include <map>
+#include <utility>
 #include <vector>
+
+#include <llvm/ADT/DenseMap.h>
+
+#include "Utils/MemoryReport.h"
 namespace notdec {
 
 /// Map with Disjoint Set Union. Multiple keys can be mapped to the same value.
 /// Merge operation: move all keys that are mapped to one value to another new
 /// value.
-template <class K, class V> class DSUMap {
-  std::map<K, V> M;
-  std::map<V, std::vector<K>> Rev;
+///
+/// Keys point to a class, and only the root class of each set holds the value,
+/// so a merge relinks one class (union by size) instead of rewriting every
+/// key.
+///
+/// Iteration is in key insertion order, whatever MapTy is, so that walks over
+/// pointer keys do not depend on the addresses.
+///
+/// MapTy is the key -> entry map, e.g., a DenseMap for keys with DenseMapInfo.
+template <class K, class V, class MapTy = std::map<K, std::size_t>>
+class DSUMap {
+  struct ClassTy {
+    std::size_t Parent;
+    V Val;
+    std::vector<K> Keys;
+  };
+  // key -> index in Entries
+  MapTy M;
+  // key and its class, in insertion order.
+  std::vector<std::pair<K, std::size_t>> Entries;
+  // mutable for path compression in const lookups.
+  mutable std::vector<ClassTy> Classes;
+  // value -> root class
+  llvm::DenseMap<V, std::size_t> Rev;
+
+  std::size_t findRoot(std::size_t C) const {
+    std::size_t Root = C;
+    while (Classes[Root].Parent != Root) {
+      Root = Classes[Root].Parent;
+    }
+    while (Classes[C].Parent != Root) {
+      auto Next = Classes[C].Parent;
+      Classes[C].Parent = Root;
+      C = Next;
+    }
+    return Root;
+  }
+
+  const V &valueOf(std::size_t C) const { return Classes[findRoot(C)].Val; }
+
+  std::size_t newClass(V Val) {
+    Classes.push_back({Classes.size(), Val, {}});
+    return Classes.size() - 1;
+  }
+
+  // link two root classes, the merged one is mapped to Val.
+  void unionClasses(std::size_t A, std::size_t B, V Val) {
+    if (Classes[A].Keys.size() > Classes[B].Keys.size()) {
+      std::swap(A, B);
+    }
+    auto &Keys = Classes[B].Keys;
+    Keys.insert(Keys.end(), Classes[A].Keys.begin(), Classes[A].Keys.end());
+    Classes[A].Keys = {};
+    Classes[A].Parent = B;
+    Classes[B].Val = Val;
+    Rev[Val] = B;
+  }
 
 public:
+  /// Iterates as a map from key to value.
+  class iterator {
+    const DSUMap *Parent = nullptr;
+    std::size_t Pos = 0;
+    mutable std::pair<K, V> Cur;
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<K, V>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type *;
+    using reference = const value_type &;
+
+    iterator() = default;
+    iterator(const DSUMap *Parent, std::size_t Pos)
+        : Parent(Parent), Pos(Pos) {}
+
+    reference operator*() const {
+      auto &Ent = Parent->Entries[Pos];
+      Cur = {Ent.first, Parent->valueOf(Ent.second)};
+      return Cur;
+    }
+    pointer operator->() const { return &**this; }
+    iterator &operator++() {
+      ++Pos;
+      return *this;
+    }
+    iterator operator++(int) {
+      auto Ret = *this;
+      ++Pos;
+      return Ret;
+    }
+    bool operator==(const iterator &Other) const { return Pos == Other.Pos; }
+    bool operator!=(const iterator &Other) const { return Pos != Other.Pos; }
+  };
+
   void merge(V From, V To) {
     if (From == To) {
       return;
     }
-    if (Rev.count(From) == 0) {
+    auto FromIt = Rev.find(From);
+    if (FromIt == Rev.end()) {
       return;
     }
-    for (auto Key : Rev[From]) {
-      // assert(M.at(Key) == From);
-      M.insert_or_assign(Key, To);
-      Rev[To].push_back(Key);
+    auto FromClass = FromIt->second;
+    Rev.erase(FromIt);
+    auto ToIt = Rev.find(To);
+    if (ToIt == Rev.end()) {
+      Classes[FromClass].Val = To;
+      Rev.try_emplace(To, FromClass);
+      return;
     }
-    Rev.erase(From);
+    unionClasses(FromClass, ToIt->second, To);
   }
-  const std::map<V, std::vector<K>>& rev() const { return Rev; }
 
-  template <class... Args>
-  auto emplace(Args &&...args)
-      -> decltype(M.emplace(std::forward<Args>(args)...)) {
-    auto [It, Success] = M.emplace(std::forward<Args>(args)...);
-    if (Success) {
-      Rev[It->second].push_back(It->first);
+  /// Insert all entries of Other, with values mapped by Map. Returns false if
+  /// any key already exists. When this map is empty, the classes of Other
+  /// are copied and only their values are mapped.
+  template <class Fn> bool insertMapped(const DSUMap &Other, Fn Map) {
+    if (!M.empty()) {
+      bool Success = true;
+      for (auto &Ent : Other) {
+        Success &= insert(Ent.first, Map(Ent.second)).second;
+      }
+      return Success;
     }
-    return {It, Success};
+    M = Other.M;
+    Entries = Other.Entries;
+    Classes = Other.Classes;
+    Rev.clear();
+    for (auto &Ent : Other.Rev) {
+      auto C = Ent.second;
+      auto Val = Map(Ent.first);
+      auto It = Rev.find(Val);
+      if (It == Rev.end()) {
+        Classes[C].Val = Val;
+        Rev.try_emplace(Val, C);
+      } else {
+        // two old values are mapped to the same new value.
+        unionClasses(C, It->second, Val);
+      }
+    }
+    return true;
   }
 
-  auto insert(K Key, V Val) -> decltype(M.insert({Key, Val})) {
-    auto [It, Success] = M.insert({Key, Val});
-    if (Success) {
-      Rev[It->second].push_back(It->first);
+  template <class... Args> std::pair<iterator, bool> emplace(Args &&...args) {
+    std::pair<K, V> Ent(std::forward<Args>(args)...);
+    return insert(Ent.first, Ent.second);
+  }
+
+  std::pair<iterator, bool> insert(K Key, V Val) {
+    auto Found = M.find(Key);
+    if (Found != M.end()) {
+      return {iterator(this, Found->second), false};
+    }
+    std::size_t C;
+    auto It = Rev.find(Val);
+    if (It != Rev.end()) {
+      C = It->second;
+    } else {
+      C = newClass(Val);
+      Rev.try_emplace(Val, C);
     }
-    return {It, Success};
+    Classes[C].Keys.push_back(Key);
+    Entries.emplace_back(Key, C);
+    M.try_emplace(Key, Entries.size() - 1);
+    return {iterator(this, Entries.size() - 1), true};
   }
 
-  auto find(K Key) -> decltype(M.find(Key)) {return M.find(Key);}
-  auto find(V Val) -> decltype(Rev.find(Val)) {return Rev.find(Val);}
+  iterator find(K Key) const {
+    auto It = M.find(Key);
+    return iterator(this, It == M.end() ? Entries.size() : It->second);
+  }
 
-  auto begin() { return M.begin(); }
-  auto end() { return M.end(); }
+  iterator begin() const { return iterator(this, 0); }
+  iterator end() const { return iterator(this, Entries.size()); }
 
-  auto count(K Key) -> decltype(M.count(Key)) { return M.count(Key); }
-  auto count(V Val) -> decltype(Rev.count(Val)) { return Rev.count(Val); }
-  auto at(K Key) -> decltype(M.at(Key)) { return M.at(Key); }
-  auto at(K Key) const -> const decltype(M.at(Key)) { return M.at(Key); }
-  auto size() const -> decltype(M.size()) { return M.size(); }
+  std::size_t count(K Key) const { return M.count(Key); }
+  std::size_t count(V Val) const { return Rev.count(Val); }
+  V at(K Key) const {
+    auto It = M.find(Key);
+    assert(It != M.end() && "DSUMap::at: key not found");
+    return valueOf(Entries[It->second].second);
+  }
+  /// Keys mapped to Val.
+  const std::vector<K> &keys(V Val) const {
+    auto It = Rev.find(Val);
+    assert(It != Rev.end());
+    return Classes[It->second].Keys;
+  }
+  std::size_t size() const { return M.size(); }
+  std::size_t estimateBytes() const {
+    std::size_t Bytes = estimateMapBytes(M) + Rev.getMemorySize() +
+                        Entries.capacity() * sizeof(Entries[0]) +
+                        Classes.capacity() * sizeof(ClassTy);
+    for (auto &C : Classes) {
+      Bytes += C.Keys.capacity() * sizeof(K);
+    }
+    return Bytes;
+  }
 };
 
 } // namespace notdec
@@ -0,0 +1,99 @@
+#ifndef _NOTDEC_UTILS_DEBUGDUMP_H_
+#define _NOTDEC_UTILS_DEBUGDUMP_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/StringRef.h>
+
+namespace llvm {
+class AssemblyAnnotationWriter;
+class Module;
+class raw_ostream;
+} // namespace llvm
+
+namespace notdec {
+
+/// Writer for debug dumps (graphs, modules) under the debug dir.
+///
+/// Configured by environment variables:
+///   NOTDEC_DEBUG_DUMP_FILTER: comma separated function names or "SCC<index>".
+///     Only matching SCCs get a debug folder, and module dumps only contain
+///     the named functions.
+///   NOTDEC_DEBUG_DUMP_FILE_LIMIT: skip files larger than this (bytes).
+///   NOTDEC_DEBUG_DUMP_TOTAL_LIMIT: stop dumping after this many bytes.
+///   NOTDEC_DEBUG_DUMP_ASYNC=1: write files in a background thread. Pending
+///     files are lost if the process aborts.
+///   NOTDEC_DEBUG_DUMP_COMPRESS=1: zlib compress, ".zlib" is appended.
+///   NOTDEC_DEBUG_DUMP_BINARY=1: save graphs as binary snapshots (".bin" in
+///     place of ".dot"), see notdec-summary --to-dot.
+class DebugDump {
+  std::set<std::string> Filter;
+  std::size_t FileLimit = 0;
+  std::size_t TotalLimit = 0;
+  bool Async = false;
+  bool Compress = false;
+  bool BinaryGraphs = false;
+
+  std::mutex Mutex;
+  // paths handed out by reservePath, which may not be written yet.
+  std::set<std::string> IssuedPaths;
+  std::size_t TotalBytes = 0;
+  bool TotalLimitWarned = false;
+
+  // background writer
+  std::condition_variable QueueChanged;
+  std::deque<std::pair<std::string, std::string>> Queue;
+  std::size_t PendingBytes = 0;
+  bool Stopping = false;
+  std::thread Writer;
+
+  DebugDump();
+  void writerLoop();
+  bool writeNow(const std::string &Path, const std::string &Content);
+  // Mutex must be held.
+  void totalLimitReached();
+
+public:
+  ~DebugDump();
+  static DebugDump &get();
+
+  bool dumpsBinaryGraphs() const { return BinaryGraphs; }
+  /// Whether the SCC should be dumped according to the filter.
+  bool shouldDumpSCC(std::size_t SCCIndex, const std::string &SCCName) const;
+  /// Whether the function should be in module dumps according to the filter.
+  bool shouldDumpFunction(llvm::StringRef Name) const;
+  /// Print the module, or only the functions that pass the filter.
+  void printModule(const llvm::Module &M, llvm::raw_ostream &OS,
+                   llvm::AssemblyAnnotationWriter *AAW = nullptr) const;
+  /// Return "<BasePath>.<index><Suffix>" with the first index that is neither
+  /// on disk (also compressed) nor returned before, even if that file was
+  /// queued or skipped.
+  std::string reservePath(const std::string &BasePath, const char *Suffix);
+  /// Save the content to the path, subject to the size limits. Returns false
+  /// if the file cannot be written. Asynchronous writes only report errors
+  /// to stderr.
+  bool write(std::string Path, std::string Content);
+  /// Whether the total limit leaves room for another dump. Check it before
+  /// rendering content for write().
+  bool admit();
+  /// Render a dump with Print and save it to the path, subject to the size
+  /// limits. Output beyond the limits is dropped while rendering and the file
+  /// is skipped, so an oversized dump is never held in memory. Synchronous
+  /// uncompressed dumps are streamed to the file.
+  bool render(std::string Path,
+              llvm::function_ref<void(llvm::raw_ostream &)> Print);
+  /// Wait until all pending files are written.
+  void flush();
+};
+
+} // namespace notdec
+
+#endif
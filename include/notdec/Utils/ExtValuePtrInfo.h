@@ -0,0 +1,64 @@
+#ifndef _NOTDEC_UTILS_EXTVALUEPTRINFO_H_
+#define _NOTDEC_UTILS_EXTVALUEPTRINFO_H_
+
+#include <type_traits>
+#include <variant>
+
+#include <llvm/ADT/DenseMapInfo.h>
+#include <llvm/ADT/Hashing.h>
+
+#include "notdec-llvm2c/Interface/ExtValuePtr.h"
+
+namespace notdec::detail {
+
+/// Hash of the use (User, OpInd) that a key carries besides its value, or a
+/// constant for keys without one.
+template <typename T, typename = void> struct UseHash {
+  static llvm::hash_code get(const T &) { return llvm::hash_code(0); }
+};
+template <typename T>
+struct UseHash<T, std::void_t<decltype(T::User), decltype(T::OpInd)>> {
+  static llvm::hash_code get(const T &K) {
+    return llvm::hash_combine(K.User, K.OpInd);
+  }
+};
+
+} // namespace notdec::detail
+
+namespace llvm {
+
+/// Hash ExtValuePtr by its alternative and all the fields it is compared by,
+/// so that value maps can be DenseMaps. Constants are keyed by their use, so
+/// hashing only the constant would put every use of `i32 0` in one probe
+/// chain. Equality keeps the ordering of the variant.
+template <> struct DenseMapInfo<notdec::ExtValuePtr> {
+  static notdec::ExtValuePtr getEmptyKey() {
+    return DenseMapInfo<llvm::Value *>::getEmptyKey();
+  }
+  static notdec::ExtValuePtr getTombstoneKey() {
+    return DenseMapInfo<llvm::Value *>::getTombstoneKey();
+  }
+  static unsigned getHashValue(const notdec::ExtValuePtr &Val) {
+    if (auto V = std::get_if<llvm::Value *>(&Val)) {
+      return static_cast<unsigned>(hash_combine(Val.index(), *V));
+    } else if (auto R = std::get_if<notdec::ReturnValue>(&Val)) {
+      return static_cast<unsigned>(hash_combine(Val.index(), R->Func));
+    } else if (auto U = std::get_if<notdec::UConstant>(&Val)) {
+      return static_cast<unsigned>(
+          hash_combine(Val.index(), U->Val, U->User, U->OpInd));
+    } else if (auto C = std::get_if<notdec::ConstantAddr>(&Val)) {
+      return static_cast<unsigned>(
+          hash_combine(Val.index(), C->Val,
+                       notdec::detail::UseHash<notdec::ConstantAddr>::get(*C)));
+    }
+    return static_cast<unsigned>(hash_combine(Val.index()));
+  }
+  static bool isEqual(const notdec::ExtValuePtr &L,
+                      const notdec::ExtValuePtr &R) {
+    return !(L < R) && !(R < L);
+  }
+};
+
+} // namespace llvm
+
+#endif
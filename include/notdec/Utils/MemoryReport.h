@@ -0,0 +1,72 @@
+#ifndef _NOTDEC_UTILS_MEMORYREPORT_H_
+#define _NOTDEC_UTILS_MEMORYREPORT_H_
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/MapVector.h>
+#include <llvm/Support/raw_ostream.h>
+
+namespace notdec {
+
+/// Rough heap bytes of node based containers: the element plus the node
+/// header (rb-tree: color and three pointers, list: two pointers).
+template <typename T> std::size_t estimateTreeBytes(std::size_t Count) {
+  return Count * (sizeof(T) + 4 * sizeof(void *));
+}
+template <typename T> std::size_t estimateListBytes(std::size_t Count) {
+  return Count * (sizeof(T) + 2 * sizeof(void *));
+}
+template <typename K, typename V, typename C, typename A>
+std::size_t estimateMapBytes(const std::map<K, V, C, A> &M) {
+  return estimateTreeBytes<typename std::map<K, V, C, A>::value_type>(
+      M.size());
+}
+template <typename K, typename V, typename I, typename B>
+std::size_t estimateMapBytes(const llvm::DenseMap<K, V, I, B> &M) {
+  return M.getMemorySize();
+}
+template <typename K, typename V, typename MapTy, typename VecTy>
+std::size_t estimateMapBytes(const llvm::MapVector<K, V, MapTy, VecTy> &M) {
+  // the index map and the vector of entries.
+  return M.size() * (sizeof(K) + sizeof(unsigned)) * 2 +
+         M.size() * sizeof(typename VecTy::value_type);
+}
+
+/// Memory accounting of the type recovery.
+///
+/// NOTDEC_MEMORY_REPORT=<path>: write one JSON object per line for each SCC
+/// and phase, e.g.
+///   {"scc":3,"name":"f,g","phase":"saturate","bytes":123,"nodes":4,
+///    "edges":5,"context_bytes":678,"peak_rss":91011}
+/// bytes is estimated from the container sizes of the graph built in that
+/// phase, context_bytes for the shared TRContext, and peak_rss is the process
+/// peak at that point. Lines without "scc" sum up a whole phase, e.g.
+///   {"phase":"bottom-up","nodes":1234,"edges":5678,"peak_rss":91011}
+/// or only give the peak after it, e.g. {"phase":"top-down","peak_rss":91011}
+class MemoryReport {
+  std::mutex Mutex;
+  std::unique_ptr<llvm::raw_fd_ostream> OS;
+
+  MemoryReport();
+
+public:
+  static MemoryReport &get();
+
+  bool isEnabled() const { return OS != nullptr; }
+  void record(std::size_t SCCIndex, const std::string &SCCName,
+              const char *Phase, std::size_t Bytes, std::size_t Nodes,
+              std::size_t Edges, std::size_t ContextBytes);
+  /// Record the totals of all SCCs after a phase.
+  void recordTotal(const char *Phase, std::size_t Nodes, std::size_t Edges);
+  /// Record the process peak RSS after a phase.
+  void recordPeakRSS(const char *Phase);
+};
+
+} // namespace notdec
+
+#endif
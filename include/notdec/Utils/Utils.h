@@ -100,6 +100,9 @@ public:
 
 std::string join(std::string path, std::string elem);
 
+/// Peak resident set size of the process in bytes.
+std::size_t getPeakRSS();
+
 template <class result_t = std::chrono::milliseconds,
           class clock_t = std::chrono::steady_clock,
           class duration_t = std::chrono::milliseconds>
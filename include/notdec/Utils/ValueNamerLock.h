@@ -0,0 +1,56 @@
+#ifndef _NOTDEC_UTILS_VALUENAMERLOCK_H_
+#define _NOTDEC_UTILS_VALUENAMERLOCK_H_
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "notdec-llvm2c/Interface/ValueNamer.h"
+
+namespace notdec {
+
+/// Number of parallel constraint generations running. The shared naming and
+/// pooling state is only locked inside them, so the sequential path does not
+/// pay for the locks. Entered and left by the thread that owns the pool,
+/// while no worker runs.
+inline std::atomic<unsigned> &getConcurrentScopes() {
+  static std::atomic<unsigned> Scopes{0};
+  return Scopes;
+}
+
+struct ConcurrentScope {
+  ConcurrentScope() { ++getConcurrentScopes(); }
+  ~ConcurrentScope() { --getConcurrentScopes(); }
+  ConcurrentScope(const ConcurrentScope &) = delete;
+  ConcurrentScope &operator=(const ConcurrentScope &) = delete;
+};
+
+inline std::unique_lock<std::mutex> lockIfConcurrent(std::mutex &M) {
+  if (getConcurrentScopes().load(std::memory_order_acquire) == 0) {
+    return std::unique_lock<std::mutex>();
+  }
+  return std::unique_lock<std::mutex>(M);
+}
+
+/// ValueNamer keeps global counters and names IR values. Constraint
+/// generation can run on several threads, so node creation and naming go
+/// through these wrappers.
+inline std::mutex &getValueNamerMutex() {
+  static std::mutex Mutex;
+  return Mutex;
+}
+
+inline unsigned long getLockedId() {
+  auto Lock = lockIfConcurrent(getValueNamerMutex());
+  return ValueNamer::getId();
+}
+
+template <class... Args> std::string getLockedName(Args &&...args) {
+  auto Lock = lockIfConcurrent(getValueNamerMutex());
+  return ValueNamer::getName(std::forward<Args>(args)...);
+}
+
+} // namespace notdec
+
+#endif
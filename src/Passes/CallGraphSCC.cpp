@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <map>
+
+#include <llvm/IR/Function.h>
+
+#include "Passes/CallGraphSCC.h"
+#include "Utils/AllSCCIterator.h"
+
+namespace notdec {
+
+using namespace llvm;
+
+CallGraphSCCInfo::CallGraphSCCInfo(Module &M) : CG(M) { recalculate(); }
+
+void CallGraphSCCInfo::updateFunction(Function &F) { updateFunctions({&F}); }
+
+void CallGraphSCCInfo::updateFunctions(ArrayRef<Function *> Fs) {
+  if (Fs.empty()) {
+    return;
+  }
+  for (auto *F : Fs) {
+    CallGraphNode *N = CG.getOrInsertFunction(F);
+    N->removeAllCalledFunctions();
+    CG.populateCallGraphNode(N);
+  }
+  recalculate();
+}
+
+void CallGraphSCCInfo::recalculate() {
+  SCCs.clear();
+  Node2SCC.clear();
+  SCCCallees.clear();
+  SCCLevels.clear();
+  NumLevels = 0;
+  FuncCallers.clear();
+
+  // 1. SCCs in post order
+  for (auto It = notdec::scc_begin(&CG); !It.isAtEnd(); ++It) {
+    for (auto *N : *It) {
+      Node2SCC[N] = SCCs.size();
+    }
+    SCCs.push_back(*It);
+  }
+
+  // 2. SCC DAG and levels. Callees are visited first, so their levels are
+  // ready.
+  SCCCallees.resize(SCCs.size());
+  SCCLevels.resize(SCCs.size());
+  for (std::size_t I = 0; I < SCCs.size(); ++I) {
+    auto &Callees = SCCCallees[I];
+    std::size_t Level = 0;
+    for (auto *N : SCCs[I]) {
+      for (auto &Edge : *N) {
+        auto Callee = Node2SCC.lookup(Edge.second);
+        if (Callee == I) {
+          continue;
+        }
+        Callees.push_back(Callee);
+        Level = std::max(Level, SCCLevels[Callee] + 1);
+      }
+    }
+    llvm::sort(Callees);
+    Callees.erase(std::unique(Callees.begin(), Callees.end()), Callees.end());
+    SCCLevels[I] = Level;
+    NumLevels = std::max(NumLevels, Level + 1);
+  }
+
+  // 3. reverse call edge map
+  for (auto &Ent : CG) {
+    CallGraphNode *CallerN = Ent.second.get();
+    if (CallerN == nullptr || CallerN->getFunction() == nullptr) {
+      continue;
+    }
+    for (auto &Edge : *CallerN) {
+      if (!Edge.first.hasValue()) {
+        continue;
+      }
+      CallBase *I = llvm::cast<llvm::CallBase>(&*Edge.first.getValue());
+      FuncCallers[Edge.second].emplace_back(I, CallerN);
+    }
+  }
+}
+
+// Tarjan's algorithm on the weighted edges, components in post order.
+static std::vector<std::vector<std::size_t>>
+getComponents(const std::vector<std::map<std::size_t, std::size_t>> &Succs) {
+  const std::size_t Unvisited = std::numeric_limits<std::size_t>::max();
+  std::size_t N = Succs.size();
+  std::size_t Counter = 0;
+  std::vector<std::size_t> Num(N, Unvisited);
+  std::vector<std::size_t> Low(N, 0);
+  std::vector<bool> OnStack(N, false);
+  std::vector<std::size_t> Stack;
+  std::vector<std::vector<std::size_t>> Comps;
+  // DFS frames: the node and its next successor.
+  std::vector<std::pair<std::size_t,
+                        std::map<std::size_t, std::size_t>::const_iterator>>
+      Frames;
+  auto Push = [&](std::size_t V) {
+    Num[V] = Low[V] = Counter++;
+    Stack.push_back(V);
+    OnStack[V] = true;
+    Frames.emplace_back(V, Succs[V].begin());
+  };
+  for (std::size_t Root = 0; Root < N; ++Root) {
+    if (Num[Root] != Unvisited) {
+      continue;
+    }
+    Push(Root);
+    while (!Frames.empty()) {
+      auto V = Frames.back().first;
+      auto &It = Frames.back().second;
+      if (It != Succs[V].end()) {
+        auto W = (It++)->first;
+        if (Num[W] == Unvisited) {
+          Push(W);
+        } else if (OnStack[W]) {
+          Low[V] = std::min(Low[V], Num[W]);
+        }
+        continue;
+      }
+      Frames.pop_back();
+      if (!Frames.empty()) {
+        auto P = Frames.back().first;
+        Low[P] = std::min(Low[P], Low[V]);
+      }
+      if (Low[V] == Num[V]) {
+        auto &Comp = Comps.emplace_back();
+        std::size_t W;
+        do {
+          W = Stack.back();
+          Stack.pop_back();
+          OnStack[W] = false;
+          Comp.push_back(W);
+        } while (W != V);
+        llvm::sort(Comp);
+      }
+    }
+  }
+  return Comps;
+}
+
+std::vector<std::vector<CallGraphNode *>>
+splitSCC(const std::vector<CallGraphNode *> &SCC, std::size_t MaxSize) {
+  assert(MaxSize > 0);
+  std::size_t N = SCC.size();
+  DenseMap<const CallGraphNode *, std::size_t> Index;
+  for (std::size_t I = 0; I < N; ++I) {
+    Index[SCC[I]] = I;
+  }
+  // number of call sites between the functions. Recursive calls of a function
+  // never leave its piece.
+  std::vector<std::map<std::size_t, std::size_t>> Weights(N);
+  for (std::size_t I = 0; I < N; ++I) {
+    for (auto &Edge : *SCC[I]) {
+      auto It = Index.find(Edge.second);
+      if (It != Index.end() && It->second != I) {
+        ++Weights[I][It->second];
+      }
+    }
+  }
+
+  auto Comps = getComponents(Weights);
+  std::vector<std::size_t> CompOf(N);
+  while (true) {
+    for (std::size_t C = 0; C < Comps.size(); ++C) {
+      for (auto I : Comps[C]) {
+        CompOf[I] = C;
+      }
+    }
+    bool Cut = false;
+    for (std::size_t C = 0; C < Comps.size(); ++C) {
+      if (Comps[C].size() <= MaxSize) {
+        continue;
+      }
+      // cut all the lightest edges inside the component.
+      std::size_t Min = std::numeric_limits<std::size_t>::max();
+      for (auto I : Comps[C]) {
+        for (auto &Ent : Weights[I]) {
+          if (CompOf[Ent.first] == C) {
+            Min = std::min(Min, Ent.second);
+          }
+        }
+      }
+      for (auto I : Comps[C]) {
+        for (auto It = Weights[I].begin(); It != Weights[I].end();) {
+          if (CompOf[It->first] == C && It->second == Min) {
+            It = Weights[I].erase(It);
+          } else {
+            ++It;
+          }
+        }
+      }
+      Cut = true;
+    }
+    if (!Cut) {
+      break;
+    }
+    Comps = getComponents(Weights);
+  }
+
+  // pack consecutive components into pieces.
+  std::vector<std::vector<CallGraphNode *>> Pieces;
+  for (auto &Comp : Comps) {
+    if (Pieces.empty() || Pieces.back().size() + Comp.size() > MaxSize) {
+      Pieces.emplace_back();
+    }
+    for (auto I : Comp) {
+      Pieces.back().push_back(SCC[I]);
+    }
+  }
+  return Pieces;
+}
+
+} // namespace notdec
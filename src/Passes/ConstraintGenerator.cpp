@@ -25,6 +25,7 @@
 #include <variant>
 #include <vector>
 
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/ADT/Optional.h>
 #include <llvm/ADT/SCCIterator.h>
 #include <llvm/ADT/StringExtras.h>
@@ -36,6 +37,7 @@
 #include <llvm/IR/GlobalValue.h>
 #include <llvm/IR/GlobalVariable.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
 #include <llvm/IR/InstrTypes.h>
 #include <llvm/IR/Instruction.h>
 #include <llvm/IR/Instructions.h>
@@ -43,6 +45,8 @@
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Value.h>
 #include <llvm/Support/Casting.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/Threading.h>
 #include <llvm/Support/Debug.h>
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/JSON.h>
@@ -54,6 +58,7 @@
 #include "Passes/StackAlloca.h"
 #include "Passes/StackBreaker.h"
 #include "Passes/StackPointerFinder.h"
+#include "TypeRecovery/BinaryFormat.h"
 #include "TypeRecovery/ConstraintGraph.h"
 #include "TypeRecovery/Lattice.h"
 #include "TypeRecovery/LowTy.h"
@@ -64,8 +69,10 @@
 #include "TypeRecovery/SketchToCTypeBuilder.h"
 #include "Utils/AllSCCIterator.h"
 #include "Utils/CallGraphDotInfo.h"
-#include "Utils/SingleNodeSCCIterator.h"
+#include "Utils/DebugDump.h"
+#include "Utils/MemoryReport.h"
 #include "Utils/Utils.h"
+#include "Utils/ValueNamerLock.h"
 #include "notdec-llvm2c/Interface.h"
 #include "notdec-llvm2c/Interface/HType.h"
 #include "notdec-llvm2c/Interface/Range.h"
@@ -98,9 +105,93 @@ bool isDisableInterFunction() {
   return DisableInterFunction;
 }
 
-std::optional<std::string> getSCCDebugDir(std::size_t SCCIndex) {
+bool isKeepAllGraphs() {
+  if (getTRDebugDir() != nullptr) {
+    return true;
+  }
+  auto E = std::getenv("NOTDEC_KEEP_GRAPHS");
+  return E != nullptr && std::strcmp(E, "1") == 0;
+}
+
+// NOTDEC_GLOBAL_MERGE_FANIN: number of graphs determinized together in each
+// level of the global memory merge. 0 means merge all graphs at once.
+static std::size_t getGlobalMergeFanIn() {
+  std::size_t FanIn = 16;
+  if (auto S = std::getenv("NOTDEC_GLOBAL_MERGE_FANIN")) {
+    char *End = nullptr;
+    auto V = std::strtoul(S, &End, 10);
+    if (End == S || *End != '\0') {
+      std::cerr << "Error: Unrecognized value in NOTDEC_GLOBAL_MERGE_FANIN: "
+                << S << "\n";
+    } else {
+      FanIn = V;
+    }
+  }
+  if (FanIn == 1) {
+    FanIn = 2;
+  }
+  return FanIn;
+}
+
+// NOTDEC_TYPE_RECOVERY_THREADS: number of threads generating the constraints
+// of the functions in one SCC. 1 (default) generates them in order, in the
+// same parts as the threads, so the output is the same for any value.
+static unsigned getGenerationThreads() {
+  unsigned Threads = 1;
+  if (auto S = std::getenv("NOTDEC_TYPE_RECOVERY_THREADS")) {
+    char *End = nullptr;
+    auto V = std::strtoul(S, &End, 10);
+    if (End == S || *End != '\0') {
+      std::cerr << "Error: Unrecognized value in NOTDEC_TYPE_RECOVERY_THREADS: "
+                << S << "\n";
+    } else if (V == 0) {
+      Threads = llvm::hardware_concurrency().compute_thread_count();
+    } else {
+      Threads = V;
+    }
+  }
+  return Threads;
+}
+
+// NOTDEC_SCC_SPLIT_THRESHOLD: max number of functions in one SCC. Larger call
+// graph SCCs are split by cutting the call edges with the fewest call sites.
+// 0 (default) disables splitting.
+static std::size_t getSCCSplitThreshold() {
+  std::size_t Threshold = 0;
+  if (auto S = std::getenv("NOTDEC_SCC_SPLIT_THRESHOLD")) {
+    char *End = nullptr;
+    auto V = std::strtoul(S, &End, 10);
+    if (End == S || *End != '\0') {
+      std::cerr << "Error: Unrecognized value in NOTDEC_SCC_SPLIT_THRESHOLD: "
+                << S << "\n";
+    } else {
+      Threshold = V;
+    }
+  }
+  return Threshold;
+}
+
+// NOTDEC_SCC_SPLIT_ROUNDS: max number of bottom-up rounds over the pieces of a
+// split SCC, stopping early when their summaries no longer change.
+static std::size_t getSCCSplitRounds() {
+  std::size_t Rounds = 3;
+  if (auto S = std::getenv("NOTDEC_SCC_SPLIT_ROUNDS")) {
+    char *End = nullptr;
+    auto V = std::strtoul(S, &End, 10);
+    if (End == S || *End != '\0' || V == 0) {
+      std::cerr << "Error: Unrecognized value in NOTDEC_SCC_SPLIT_ROUNDS: " << S
+                << "\n";
+    } else {
+      Rounds = V;
+    }
+  }
+  return Rounds;
+}
+
+std::optional<std::string> getSCCDebugDir(std::size_t SCCIndex,
+                                          const std::string &SCCName) {
   const char *DebugDir = getTRDebugDir();
-  if (DebugDir) {
+  if (DebugDir && DebugDump::get().shouldDumpSCC(SCCIndex, SCCName)) {
     std::string DirPath = join(DebugDir, "SCC" + std::to_string(SCCIndex));
     auto EC = llvm::sys::fs::create_directories(DirPath);
     if (EC) {
@@ -120,19 +211,52 @@ static inline TypeVariable makeTv(std::shared_ptr<retypd::TRContext> Ctx,
 }
 
 std::string getUniquePath(const std::string &basePath, const char *suffix) {
-  static unsigned int index = 0;
-  std::string candidate = basePath + "." + std::to_string(index) + suffix;
-
-  while (llvm::sys::fs::exists(candidate)) {
-    candidate = basePath + "." + std::to_string(index) + suffix;
-    ++index;
-  }
-
-  return candidate;
+  // Dumps may be queued, compressed or skipped, so the file system does not
+  // tell which names are taken.
+  return DebugDump::get().reservePath(basePath, suffix);
 }
 
 // #region TypeRecovery
 
+// Read a binary summary library (see notdec-summary --to-library) in place of
+// a JSON summary file, and return the binary summaries of the functions in M.
+static std::vector<std::pair<std::set<Function *>, std::string>>
+readLibraryFile(Module &M, const char *Path, long PointerSize,
+                bool AllowMultiFunction) {
+  auto Lib = retypd::SummaryLibrary::open(Path);
+  if (Lib == nullptr) {
+    llvm::errs() << "Error: " << Path
+                 << " is neither a JSON or dot file nor a summary library\n";
+    std::abort();
+  }
+  if (Lib->getPointerSize() != PointerSize) {
+    llvm::errs() << "Error: Summary library pointer size "
+                 << Lib->getPointerSize() << " does not match the module: "
+                 << PointerSize << "\n";
+    std::abort();
+  }
+  std::vector<std::pair<std::set<Function *>, std::string>> Ret;
+  for (auto &F : M) {
+    if (auto Data = Lib->lookup(F.getName())) {
+      Ret.push_back({{&F}, Data->str()});
+    }
+  }
+  if (AllowMultiFunction) {
+    for (auto &Ent : Lib->multiFunctionEntries()) {
+      std::set<Function *> FSet;
+      for (auto Str : split(Ent.first.str(), ',')) {
+        if (auto *F = M.getFunction(Str)) {
+          FSet.insert(F);
+        }
+      }
+      if (!FSet.empty()) {
+        Ret.push_back({FSet, Ent.second.str()});
+      }
+    }
+  }
+  return Ret;
+}
+
 void TypeRecovery::loadSummaryFile(Module &M, const char *SummaryFile) {
   if (getSuffix(SummaryFile) == ".json") {
     llvm::errs() << "Loading summary from: " << SummaryFile << "\n";
@@ -161,8 +285,91 @@ void TypeRecovery::loadSummaryFile(Module &M, const char *SummaryFile) {
       SummaryOverride[FSet] = CG;
     }
   } else if (getSuffix(SummaryFile) == ".dot") {
-    assert(false && "TODO");
+    llvm::errs() << "Loading dot summaries from: " << SummaryFile << "\n";
+    for (auto &Ent : retypd::parseDotSummary(readFileToString(SummaryFile))) {
+      // the comment before the graph names the functions.
+      std::set<Function *> FSet;
+      for (auto Str : split(llvm::StringRef(Ent.first).trim().str(), ',')) {
+        auto *F = M.getFunction(Str);
+        if (F == nullptr) {
+          llvm::errs() << "Warning: Function not found: " << Str << "\n";
+          continue;
+        }
+        FSet.insert(F);
+      }
+      if (FSet.empty()) {
+        continue;
+      }
+      if (auto CG = ConstraintsGenerator::fromDotSummary(*this, FSet,
+                                                         Ent.second)) {
+        SummaryOverride[FSet] = CG;
+      }
+    }
+  } else {
+    llvm::errs() << "Loading binary summaries from: " << SummaryFile << "\n";
+    for (auto &Ent : readLibraryFile(M, SummaryFile, pointer_size, true)) {
+      auto Summary = retypd::readBinarySummary(*TRCtx, Ent.second);
+      if (!Summary) {
+        std::abort();
+      }
+      SummaryOverride[Ent.first] =
+          ConstraintsGenerator::fromConstraints(*this, Ent.first, *Summary);
+    }
+  }
+}
+
+void TypeRecovery::loadSummaryLibrary(Module &M, const char *LibFile) {
+  SummaryLib = retypd::SummaryLibrary::open(LibFile);
+  if (SummaryLib == nullptr) {
+    std::abort();
+  }
+  llvm::errs() << "Loading summary library: " << LibFile << " ("
+               << SummaryLib->size() << " entries)\n";
+  if (SummaryLib->getPointerSize() != pointer_size) {
+    llvm::errs() << "Error: Summary library pointer size "
+                 << SummaryLib->getPointerSize()
+                 << " does not match the module: " << pointer_size
+                 << ", skipping the library.\n";
+    SummaryLib.reset();
+    return;
+  }
+  // Only external functions use the library, functions with a body are
+  // analyzed. They are never in a SCC with other functions, so the multi
+  // function entries do not apply. The summaries are decoded on first use, in
+  // getSummaryOverride.
+  for (auto &F : M) {
+    if (!F.isDeclaration() || F.isIntrinsic()) {
+      continue;
+    }
+    if (auto Data = SummaryLib->lookup(F.getName())) {
+      LibrarySummaries.insert({{&F}, *Data});
+    }
+  }
+  llvm::errs() << "Found " << LibrarySummaries.size()
+               << " library summaries for external functions\n";
+}
+
+std::shared_ptr<ConstraintsGenerator>
+TypeRecovery::getSummaryOverride(const std::set<llvm::Function *> &SCCSet) {
+  auto It = SummaryOverride.find(SCCSet);
+  if (It != SummaryOverride.end()) {
+    return It->second;
   }
+  auto LibIt = LibrarySummaries.find(SCCSet);
+  if (LibIt == LibrarySummaries.end()) {
+    return nullptr;
+  }
+  auto Data = LibIt->second;
+  LibrarySummaries.erase(LibIt);
+  auto Summary = retypd::readBinarySummary(*TRCtx, Data);
+  if (!Summary) {
+    llvm::errs() << "Warning: Broken summary in library: "
+                 << getFuncSetName(SCCSet) << "\n";
+    return nullptr;
+  }
+  auto CG = ConstraintsGenerator::fromConstraints(*this, SCCSet, *Summary);
+  SummaryOverride[SCCSet] = CG;
+  return CG;
 }
 
 void TypeRecovery::loadSignatureFile(Module &M, const char *SigFile) {
@@ -186,7 +393,32 @@ void TypeRecovery::loadSignatureFile(Module &M, const char *SigFile) {
       SignatureOverride[F] = CG;
     }
   } else if (getSuffix(SigFile) == ".dot") {
-    assert(false && "TODO");
+    llvm::errs() << "Loading dot signatures from: " << SigFile << "\n";
+    for (auto &Ent : retypd::parseDotSummary(readFileToString(SigFile))) {
+      auto Name = llvm::StringRef(Ent.first).trim();
+      auto *F = M.getFunction(Name);
+      if (F == nullptr) {
+        llvm::errs() << "Warning: Function not found: " << Name << "\n";
+        continue;
+      }
+      if (auto CG = ConstraintsGenerator::fromDotSummary(*this, {F},
+                                                         Ent.second)) {
+        CG->CG.linkPrimitives();
+        SignatureOverride[F] = CG;
+      }
+    }
+  } else {
+    llvm::errs() << "Loading binary signatures from: " << SigFile << "\n";
+    for (auto &Ent : readLibraryFile(M, SigFile, pointer_size, false)) {
+      auto Summary = retypd::readBinarySummary(*TRCtx, Ent.second);
+      if (!Summary) {
+        std::abort();
+      }
+      auto *F = *Ent.first.begin();
+      auto CG = ConstraintsGenerator::fromConstraints(*this, {F}, *Summary);
+      CG->CG.linkPrimitives();
+      SignatureOverride[F] = CG;
+    }
   }
 }
 
@@ -277,6 +509,54 @@ TypeRecovery::multiGraphDeterminizeTo(ConstraintsGenerator &CurrentTypes,
   return Ret;
 }
 
+CGNode *TypeRecovery::treeDeterminizeTo(TypeRecovery &Ctx,
+                                        ConstraintsGenerator &CurrentTypes,
+                                        std::vector<CGNode *> StartNodes,
+                                        const char *NamePrefix) {
+  assert(!StartNodes.empty());
+  std::size_t FanIn = getGlobalMergeFanIn();
+  // Determinizing all graphs at once creates a single powerset construction
+  // whose size grows with the sum of all graphs. Instead, determinize every
+  // FanIn graphs into an intermediate graph, and repeat on the results until
+  // the remaining nodes fit in one group. The language of the result is the
+  // same, because each intermediate node accepts the union of its group.
+  // Intermediate graphs are released as soon as the next level is built.
+  std::vector<std::shared_ptr<ConstraintsGenerator>> Level;
+  std::size_t Depth = 0;
+  while (FanIn != 0 && StartNodes.size() > FanIn) {
+    std::vector<std::shared_ptr<ConstraintsGenerator>> NextLevel;
+    std::vector<CGNode *> NextNodes;
+    for (std::size_t I = 0; I < StartNodes.size(); I += FanIn) {
+      auto E = std::min(StartNodes.size(), I + FanIn);
+      if (E - I == 1) {
+        // nothing to merge. The owner graph is kept alive below.
+        NextNodes.push_back(StartNodes[I]);
+        continue;
+      }
+      auto Part = std::make_shared<ConstraintsGenerator>(
+          Ctx, CurrentTypes.CG.getName() + "_L" + std::to_string(Depth) + "_" +
+                   std::to_string(I / FanIn));
+      std::set<CGNode *> Group(StartNodes.begin() + I, StartNodes.begin() + E);
+      NextNodes.push_back(multiGraphDeterminizeTo(*Part, Group, NamePrefix));
+      NextLevel.push_back(std::move(Part));
+    }
+    // keep graphs of nodes that are passed through unchanged.
+    for (auto &G : Level) {
+      for (auto *N : NextNodes) {
+        if (&N->Parent == &G->CG) {
+          NextLevel.push_back(G);
+          break;
+        }
+      }
+    }
+    StartNodes = std::move(NextNodes);
+    Level = std::move(NextLevel);
+    Depth++;
+  }
+  std::set<CGNode *> Nodes(StartNodes.begin(), StartNodes.end());
+  return multiGraphDeterminizeTo(CurrentTypes, Nodes, NamePrefix);
+}
+
 // #endregion TypeRecovery
 
 void ConstraintsGenerator::dumpV2N() {
@@ -321,6 +601,35 @@ void ConstraintsGenerator::offZeroToOne() {
   }
 }
 
+std::size_t ConstraintsGenerator::estimateBytes() const {
+  return CG.estimateBytes() + V2N.estimateBytes() + V2NContra.estimateBytes() +
+         PrimMap.estimateBytes() + estimateMapBytes(CallToInstance) +
+         estimateMapBytes(UnhandledCalls);
+}
+
+void TypeRecovery::reportMemory(const SCCData &Data, const char *Phase,
+                                const ConstraintsGenerator *G) {
+  auto &Report = MemoryReport::get();
+  if (!Report.isEnabled()) {
+    return;
+  }
+  std::size_t SCCIndex = &Data - AG.AllSCCs.data();
+  std::size_t Bytes = 0;
+  std::size_t Nodes = 0;
+  std::size_t Edges = 0;
+  if (G != nullptr) {
+    Bytes = G->estimateBytes();
+    Nodes = G->CG.Nodes.size();
+    Edges = G->CG.getNumEdges();
+  } else if (Data.TypeResult) {
+    Bytes = estimateTreeBytes<std::pair<const ExtValuePtr, ast::HType *>>(
+        Data.TypeResult->ValueTypes.size() +
+        Data.TypeResult->ValueTypesLowerBound.size());
+  }
+  Report.record(SCCIndex, Data.SCCName, Phase, Bytes, Nodes, Edges,
+                TRCtx->estimateBytes());
+}
+
 void ConstraintsGenerator::removeNode(retypd::CGNode &N) {
   assert(!TypeInfos.count(&N));
   CG.removeNode(N);
@@ -478,6 +787,8 @@ void ConstraintsGenerator::preSimplify() {
 
   auto DoSimplify = [&](CGNode *N) {
     assert(N != nullptr);
+    // the only edges of N, see MatchCritiria.
+    assert(N->outEdges.size() == 1 && N->inEdges.size() == 1);
     auto &O = *N->outEdges.begin();
     auto I = *N->inEdges.begin();
     // 优化该节点：1 处理V2N，V2NContra。
@@ -555,27 +866,97 @@ bool isSPGlobal(ExtValuePtr Val) {
   return false;
 }
 
+// Edges, labels and node types of a summary, with nodes numbered in breadth
+// first order from the start node instead of by their generated names, so
+// that summaries of different rounds compare equal when they have the same
+// content. Edges of a node are visited in label order.
+static std::string getSummaryShape(const ConstraintGraph &G) {
+  std::map<const CGNode *, std::size_t> Ids;
+  std::vector<const CGNode *> Order;
+  auto Visit = [&](const CGNode *N) {
+    if (Ids.emplace(N, Order.size()).second) {
+      Order.push_back(N);
+    }
+  };
+  if (G.Start != nullptr) {
+    Visit(G.Start);
+  }
+  std::string Ret;
+  llvm::raw_string_ostream OS(Ret);
+  for (std::size_t I = 0; I <= Order.size(); ++I) {
+    if (I == Order.size()) {
+      // nodes not reachable from the start, in creation order.
+      for (auto &N : G.Nodes) {
+        if (!Ids.count(&N)) {
+          Visit(&N);
+          break;
+        }
+      }
+      if (I == Order.size()) {
+        break;
+      }
+    }
+    auto *N = Order[I];
+    OS << I << (N == G.End ? " end " : " ")
+       << retypd::toString(N->key.SuffixVariance);
+    if (G.PG && N->getPNIVar() != nullptr) {
+      OS << " " << N->getPNIVar()->getLowTy();
+    }
+    OS << "\n";
+    std::vector<std::pair<std::string, const CGNode *>> Edges;
+    for (auto &E : N->outEdges) {
+      Edges.emplace_back(toString(E.getLabel()), &E.getTargetNode());
+    }
+    std::stable_sort(Edges.begin(), Edges.end(),
+                     [](auto &A, auto &B) { return A.first < B.first; });
+    for (auto &Ent : Edges) {
+      Visit(Ent.second);
+      OS << "  " << Ent.first << " -> " << Ids.at(Ent.second) << "\n";
+    }
+  }
+  OS.flush();
+  return Ret;
+}
+
 void TypeRecovery::bottomUpPhase() {
   assert(AG.CG != nullptr);
   // TODO: simplify call graph if one func does not have up constraints.
   std::vector<SCCData> &AllSCCs = AG.AllSCCs;
 
+  // The pieces of a split SCC are repeated until their summaries no longer
+  // change, so that the cut calls use the summaries of the previous round.
+  auto MaxSplitRounds = getSCCSplitRounds();
+  std::size_t SplitRound = 1;
+  std::size_t CutCalls = 0;
+  bool SummaryChanged = false;
+  std::map<std::size_t, std::string> SummaryShapes;
+  auto SplitStart = std::chrono::steady_clock::now();
+
   // 1 Bottom-up Phase: build the summary
-  // Walk the callgraph in bottom-up SCC order.
-  for (size_t SCCIndex = 0; SCCIndex < AllSCCs.size(); ++SCCIndex) {
+  // Walk the callgraph in bottom-up SCC order. A split SCC sets NextIndex back
+  // to its first piece to repeat a round.
+  std::size_t NextIndex = 0;
+  while (NextIndex < AllSCCs.size()) {
+    std::size_t SCCIndex = NextIndex++;
     SCCData &Data = AllSCCs.at(SCCIndex);
     const std::set<llvm::Function *> &SCCSet = Data.SCCSet;
     if (SCCSet.empty()) {
       continue;
     }
 
-    if (SCCIndex == (AllSCCs.size() - 1)) {
+    if (Data.isSplit() && SCCIndex == Data.SplitBegin && SplitRound == 1) {
+      SplitStart = std::chrono::steady_clock::now();
+    }
+
+    // the last piece of a split SCC still needs a summary for the cut calls.
+    if (SCCIndex == (AllSCCs.size() - 1) && !Data.isSplit()) {
       // no need to generate summary for last node in SCC
       continue;
     }
 
     // Print for debug dir
-    std::optional<std::string> DirPath = getSCCDebugDir(SCCIndex);
+    std::optional<std::string> DirPath =
+        getSCCDebugDir(SCCIndex, Data.SCCName);
     llvm::Optional<llvm::raw_fd_ostream> SCCsPerf;
     if (DirPath) {
       std::error_code EC;
@@ -595,8 +976,18 @@ void TypeRecovery::bottomUpPhase() {
     auto Start1 = std::chrono::steady_clock::now();
 
     Generator = getBottomUpGraph(Data, DirPath);
+    reportMemory(Data, "bottom-up", Generator.get());
+    if (Data.isSplit() && SplitRound == 1) {
+      for (auto &Ent : Generator->UnhandledCalls) {
+        auto *Target = Ent.first->getCalledFunction();
+        if (Target != nullptr && !Target->isDeclaration()) {
+          ++CutCalls;
+        }
+      }
+    }
     // 1.3 solve more subtype relations
     Generator->CG.solve();
+    reportMemory(Data, "saturate", Generator.get());
 
     if (DirPath) {
       auto SatOut =
@@ -608,16 +999,17 @@ void TypeRecovery::bottomUpPhase() {
     std::shared_ptr<ConstraintsGenerator> Summary;
     bool isDeclaration =
         SCCSet.size() == 1 && (*SCCSet.begin())->isDeclaration();
-    if (SummaryOverride.count(SCCSet)) {
+    if (auto Override = getSummaryOverride(SCCSet)) {
       // summary overriden
       std::cerr << "Summary Overriden: " << Name << ":\n";
-      Summary = SummaryOverride.at(SCCSet);
+      Summary = Override;
     } else if (isDeclaration) {
       Summary = Generator;
     } else {
       //!! normal case, generate summary
       std::cerr << "Generating Summary for " << Name << "\n";
       Summary = Generator->genSummary(DirPath);
+      reportMemory(Data, "summary", Summary.get());
     }
 
     if (SCCsPerf) {
@@ -629,8 +1021,22 @@ void TypeRecovery::bottomUpPhase() {
     // 1.5 save the summary
     for (auto F : SCCSet) {
       auto It2 = FuncSummaries.emplace(F, Summary);
+      if (!It2.second && Data.isSplit()) {
+        // repeated piece of a split SCC
+        It2.first->second = Summary;
+        continue;
+      }
       assert(It2.second && "Function summary already exist?");
     }
+    if (Data.isSplit()) {
+      std::string Shape;
+      if (Summary != nullptr) {
+        Shape = getSummaryShape(Summary->CG);
+      }
+      auto &Prev = SummaryShapes[SCCIndex];
+      SummaryChanged |= Prev != Shape;
+      Prev = std::move(Shape);
+    }
 
     Data.SCCName = Name;
     // print summary
@@ -646,6 +1052,28 @@ void TypeRecovery::bottomUpPhase() {
                      "}\n";
       }
     }
+
+    if (Data.isSplit() && SCCIndex + 1 == Data.SplitEnd) {
+      bool Repeat = SplitRound == 1 ? CutCalls > 0 : SummaryChanged;
+      if (Repeat && SplitRound < MaxSplitRounds) {
+        for (auto I = Data.SplitBegin; I < Data.SplitEnd; ++I) {
+          AllSCCs[I].BottomUpGenerator.reset();
+        }
+        ++SplitRound;
+        SummaryChanged = false;
+        NextIndex = Data.SplitBegin;
+        continue;
+      }
+      std::cerr << "Split SCC " << Data.SplitBegin << "-"
+                << (Data.SplitEnd - 1) << ": " << CutCalls << " cut calls, "
+                << SplitRound << " rounds, "
+                << (Repeat ? "not converged" : "converged") << ", "
+                << since(SplitStart).count() << " ms\n";
+      SplitRound = 1;
+      CutCalls = 0;
+      SummaryChanged = false;
+      SummaryShapes.clear();
+    }
   }
 }
 
@@ -665,10 +1093,14 @@ TypeRecovery::getBottomUpGraph(SCCData &Data,
   bool isExternalFunc =
       SCCSet.size() == 1 && (*SCCSet.begin())->isDeclaration();
   bool isOverride = false;
-  if (isExternalFunc && SummaryOverride.count(SCCSet)) {
+  std::shared_ptr<ConstraintsGenerator> Override;
+  if (isExternalFunc) {
+    Override = getSummaryOverride(SCCSet);
+  }
+  if (Override) {
     std::cerr << "Override summary for external function: " << Data.SCCName
               << ":\n";
-    Generator = SummaryOverride.at(SCCSet);
+    Generator = Override;
     Generator->checkSymmetry();
     isOverride = true;
   } else if (isExternalFunc) {
@@ -711,10 +1143,10 @@ TypeRecovery::getBottomUpGraph(SCCData &Data,
     if (CallsiteSummaryOverride.count(Call)) {
       llvm::errs() << "Override summary for callsite: " << *Call << "\n";
       TargetSummary = CallsiteSummaryOverride.at(Call);
-    } else if (SummaryOverride.count({Target})) {
+    } else if (auto Override = getSummaryOverride({Target})) {
       llvm::errs() << "Override summary for external function call: " << *Call
                    << "\n";
-      TargetSummary = SummaryOverride.at({Target});
+      TargetSummary = Override;
       assert(TargetSummary->CG.PG->Constraints.size() == 0);
     } else if (DisableInterFunc) {
       // inter function type recovery disabled !
@@ -725,8 +1157,15 @@ TypeRecovery::getBottomUpGraph(SCCData &Data,
         Generator->UnhandledCalls.insert(Ent);
       }
     } else if (!Target->isDeclaration()) {
-      // should have summary.
-      TargetSummary = FuncSummaries.at(Target);
+      auto It = FuncSummaries.find(Target);
+      if (It != FuncSummaries.end()) {
+        TargetSummary = It->second;
+      } else {
+        // call cut by SCC splitting, resolved in the next round.
+        assert(Data.isSplit() && "Missing summary of a callee!");
+        Generator->UnhandledCalls.insert(Ent);
+        continue;
+      }
     } else {
       // llvm::errs() << "Warning: Summary and result may be incorrect due
       // to external call: " << *Call << "\n";
@@ -754,7 +1193,7 @@ void TypeRecovery::topDownPhase() {
   // 2 Top-down Phase: build the result(Map from value to clang C type)
   // We have a big global type graph, corresponds to C AST that link the
   // declared struct type to the real definition to form a graph.
-  auto &FuncCallers = AG.FuncCallers;
+  auto &FuncCallers = *AG.FuncCallers;
   auto &AllSCCs = AG.AllSCCs;
   for (std::size_t Index1 = AllSCCs.size(); Index1 > 0; --Index1) {
     std::size_t SCCIndex = Index1 - 1;
@@ -766,7 +1205,8 @@ void TypeRecovery::topDownPhase() {
     // const std::set<llvm::Function *> &SCCSet = Data.SCCSet;
 
     // for debug print
-    std::optional<std::string> DirPath = getSCCDebugDir(SCCIndex);
+    std::optional<std::string> DirPath =
+        getSCCDebugDir(SCCIndex, Data.SCCName);
     llvm::Optional<llvm::raw_fd_ostream> SCCsPerf;
     if (DirPath) {
       std::error_code EC;
@@ -835,16 +1275,21 @@ void TypeRecovery::topDownPhase() {
         for (auto &Elem : Callers) {
 
           auto *Call = Elem.first;
-          auto CallerInd = AG.Func2SCCIndex.at(Elem.second);
+          assert(AG.Func2SCCIndex.count(Elem.second));
+          auto CallerInd = AG.Func2SCCIndex.lookup(Elem.second);
           auto &CallerData = AllSCCs.at(CallerInd);
           auto &CallerGenerator = CallerData.TopDownGenerator;
           if (CallerGenerator && CallerGenerator->CallToInstance.count(Call)) {
-            auto [FN, FNC] = CallerGenerator->CallToInstance.at(Call);
+            auto [FN, FNC] = CallerGenerator->CallToInstance.lookup(Call);
 
             FuncNodes.insert(FN);
             FuncNodesContra.insert(FNC);
           } else {
-            assert(Data.SCCSet.count(Elem.second->getFunction()));
+            // callers in an earlier piece of the same split SCC are not
+            // processed yet, their actual params are not used.
+            assert(Data.SCCSet.count(Elem.second->getFunction()) ||
+                   (Data.isSplit() && CallerInd >= Data.SplitBegin &&
+                    CallerInd < Data.SplitEnd));
           }
         }
       }
@@ -865,6 +1310,8 @@ void TypeRecovery::topDownPhase() {
       }
     }
 
+    reportMemory(Data, "determinize", SigTy.SignatureGenerator.get());
+
     if (DirPath) {
       if (SigTy.SignatureGenerator) {
         auto SigOut = getUniquePath(join(*DirPath, "03-Signature"), ".dot");
@@ -873,6 +1320,7 @@ void TypeRecovery::topDownPhase() {
     }
 
     auto TDG = getTopDownGraph(Data, DirPath);
+    reportMemory(Data, "top-down", TDG.get());
 
     if (SCCsPerf) {
       *SCCsPerf << "02 TopDown Elapsed: " << since(Start2).count() << " ms\n";
@@ -899,6 +1347,11 @@ TypeRecovery::getTopDownGraph(SCCData &Data,
   if (Generator) {
     Generator->cloneTo(CurrentTypes, Old2New);
   }
+  // callers instantiate the summary, which is a separate graph, so the
+  // bottom-up graph is not used after this clone.
+  if (!isKeepAllGraphs()) {
+    Data.BottomUpGenerator.reset();
+  }
 
   bool DisableInterFunc = isDisableInterFunction();
   if (!DisableInterFunc) {
@@ -941,14 +1394,12 @@ void SCCSignatureTypes::instantiate(ConstraintsGenerator &To) {
   }
 }
 
-void TypeRecovery::prepareSCC(CallGraph &CG) {
-  AG.CG = &CG;
-
-  all_scc_iterator<CallGraph *> CGI = notdec::scc_begin(AG.CG);
-  SingleNodeSCCIterator SNI(notdec::scc_begin(AG.CG));
+void TypeRecovery::prepareSCC(CallGraphSCCInfo &Info) {
+  AG.CG = &Info.CG;
+  AG.FuncCallers = &Info.FuncCallers;
 
   std::vector<SCCData> &AllSCCs = AG.AllSCCs;
-  std::map<CallGraphNode *, std::size_t> &Func2SCCIndex = AG.Func2SCCIndex;
+  auto &Func2SCCIndex = AG.Func2SCCIndex;
 
   auto PolyFuncFiles = std::getenv("NOTDEC_POLY_FUNCS");
   std::set<std::string> PolyFuncs;
@@ -971,14 +1422,16 @@ void TypeRecovery::prepareSCC(CallGraph &CG) {
   // poly, we cannot merge.
   bool HasPolymorphic = false;
   bool PrevPolymorphic = true;
+  // nothing is merged into the pieces of a split SCC.
+  bool PrevSplit = false;
+  auto SplitThreshold = getSCCSplitThreshold();
   bool NoSCC = this->NoSCC;
   bool DisableInterFunc = isDisableInterFunction();
   if (DisableInterFunc) {
     NoSCC = true;
   }
   // 1. Split by SCC post order
-  for (; (NoSCC ? !SNI.isAtEnd() : !CGI.isAtEnd()); (NoSCC ? ++SNI : ++CGI)) {
-    const std::vector<CallGraphNode *> &NodeVec = (NoSCC ? *SNI : *CGI);
+  auto AddSCC = [&](const std::vector<CallGraphNode *> &NodeVec) {
     PrevPolymorphic = HasPolymorphic;
     HasPolymorphic = false;
     bool AllDeclaration = true;
@@ -1004,16 +1457,45 @@ void TypeRecovery::prepareSCC(CallGraph &CG) {
     }
 
     if (AllDeclaration && AllIntrinsics) {
-      continue;
+      return;
     }
 
+    bool TooLarge = SplitThreshold != 0 && !AllSCCs.empty() &&
+                    AllSCCs.back().Nodes.size() + NodeVec.size() >
+                        SplitThreshold;
     if (!AllSCCs.empty() && !DisableInterFunc && !HasPolymorphic &&
-        !AllDeclaration && !PrevPolymorphic) {
+        !AllDeclaration && !PrevPolymorphic && !PrevSplit && !TooLarge) {
       auto &PrevNodes = AllSCCs.back().Nodes;
       PrevNodes.insert(PrevNodes.end(), NodeVec.begin(), NodeVec.end());
     } else {
       AllSCCs.push_back(SCCData{.Nodes = NodeVec});
     }
+    PrevSplit = false;
+  };
+  for (auto &SCC : Info.SCCs) {
+    if (!NoSCC && SplitThreshold != 0 && SCC.size() > SplitThreshold) {
+      auto Begin = AllSCCs.size();
+      for (auto &Piece : splitSCC(SCC, SplitThreshold)) {
+        AllSCCs.push_back(SCCData{.Nodes = Piece});
+      }
+      for (auto I = Begin; I < AllSCCs.size(); ++I) {
+        AllSCCs[I].SplitBegin = Begin;
+        AllSCCs[I].SplitEnd = AllSCCs.size();
+      }
+      std::cerr << "Split SCC of " << SCC.size() << " functions into "
+                << (AllSCCs.size() - Begin) << " pieces\n";
+      PrevSplit = true;
+      HasPolymorphic = false;
+      continue;
+    }
+    if (!NoSCC) {
+      AddSCC(SCC);
+      continue;
+    }
+    // iterate the functions one by one in the same order.
+    for (auto *CGN : SCC) {
+      AddSCC({CGN});
+    }
   }
   // assert(HasPolymorphic == false && "Last SCC cannot be polymorphic!");
 
@@ -1045,31 +1527,53 @@ void TypeRecovery::prepareSCC(CallGraph &CG) {
       *SCCsCatalog << "SCC" << SCCIndex << "," << Name << "\n";
     }
   }
+}
 
-  // 3. calc reverse call edge map
-  // map from function to all its callers
-  std::map<CallGraphNode *,
-           std::vector<std::pair<llvm::CallBase *, CallGraphNode *>>>
-      &FuncCallers = AG.FuncCallers;
-  for (auto &Ent : CG) {
-    CallGraphNode *CallerN = Ent.second.get();
-    if (CallerN == nullptr) {
-      continue;
+void TypeRecovery::refreshCallGraph(Module &M, ModuleAnalysisManager &MAM) {
+  auto *Cached = MAM.getCachedResult<CallGraphSCCAnalysis>(M);
+  if (Cached != nullptr && *Cached == CallG) {
+    return;
+  }
+  // The old graph is kept alive by CallG until the nodes are mapped.
+  auto New = MAM.getResult<CallGraphSCCAnalysis>(M);
+  // Nodes of erased functions point to freed functions, so they are only
+  // compared against the functions that are left, never dereferenced.
+  std::set<const Function *> LiveFuncs;
+  for (auto &F : M) {
+    LiveFuncs.insert(&F);
+  }
+  auto MapNode = [&](CallGraphNode *Old) -> CallGraphNode * {
+    if (Old == CallG->CG.getExternalCallingNode()) {
+      return New->CG.getExternalCallingNode();
     }
-    auto *Current = CallerN->getFunction();
-    if (Current == nullptr) {
-      continue;
+    if (Old == CallG->CG.getCallsExternalNode()) {
+      return New->CG.getCallsExternalNode();
     }
-    for (auto &Edge : *CallerN) {
-      auto *CalleeN = Edge.second;
-      if (!Edge.first.hasValue()) {
+    if (LiveFuncs.count(Old->getFunction()) == 0) {
+      return nullptr;
+    }
+    return New->CG.getOrInsertFunction(Old->getFunction());
+  };
+  AG.Func2SCCIndex.clear();
+  for (std::size_t SCCIndex = 0; SCCIndex < AG.AllSCCs.size(); ++SCCIndex) {
+    auto &Data = AG.AllSCCs[SCCIndex];
+    std::vector<CallGraphNode *> Nodes;
+    for (auto *CGN : Data.Nodes) {
+      auto *NewCGN = MapNode(CGN);
+      if (NewCGN == nullptr) {
+        Data.SCCSet.erase(CGN->getFunction());
         continue;
       }
-      CallBase *I = llvm::cast<llvm::CallBase>(&*Edge.first.getValue());
-      auto &CallVec = FuncCallers[CalleeN];
-      CallVec.emplace_back(I, CallerN);
+      if (NewCGN->getFunction() != nullptr) {
+        AG.Func2SCCIndex[NewCGN] = SCCIndex;
+      }
+      Nodes.push_back(NewCGN);
     }
+    Data.Nodes = std::move(Nodes);
   }
+  AG.CG = &New->CG;
+  AG.FuncCallers = &New->FuncCallers;
+  CallG = std::move(New);
 }
 
 void TypeRecovery::run(Module &M1, ModuleAnalysisManager &MAM) {
@@ -1088,7 +1592,11 @@ void TypeRecovery::run(Module &M1, ModuleAnalysisManager &MAM) {
   MemoryBytes = BytesManager::create(M);
 
   // 0 Preparation
-  // 0.1 load summary file
+  // 0.1 load summary library and summary file. Summaries from the file take
+  // precedence.
+  if (SummaryLibFile) {
+    loadSummaryLibrary(M, SummaryLibFile);
+  }
   if (SummaryFile) {
     loadSummaryFile(M, SummaryFile);
   }
@@ -1127,8 +1635,7 @@ void TypeRecovery::run(Module &M1, ModuleAnalysisManager &MAM) {
     printModule(M, join(DebugDir, "01-Optimized.ll").c_str());
   }
 
-  CallGraphAnalysis Ana;
-  CallG = std::make_unique<CallGraph>(Ana.run(M, MAM));
+  CallG = MAM.getResult<CallGraphSCCAnalysis>(M);
 
   if (DebugDir) {
     std::error_code EC;
@@ -1138,7 +1645,7 @@ void TypeRecovery::run(Module &M1, ModuleAnalysisManager &MAM) {
       llvm::errs() << "Error printing to " << Path << ", " << EC.message()
                    << "\n";
     }
-    CallG->print(CGTxt);
+    CallG->CG.print(CGTxt);
     CGTxt.close();
     // print dot
     Path = join(DebugDir, "CallGraph.dot");
@@ -1147,7 +1654,7 @@ void TypeRecovery::run(Module &M1, ModuleAnalysisManager &MAM) {
       llvm::errs() << "Error printing to " << Path << ", " << EC.message()
                    << "\n";
     }
-    notdec::utils::CallGraphDOTInfo CFGInfo(&M, &*CallG, nullptr);
+    notdec::utils::CallGraphDOTInfo CFGInfo(&M, &CallG->CG, nullptr);
     llvm::WriteGraph(CGDot, &CFGInfo, false);
     CGDot.close();
   }
@@ -1159,11 +1666,26 @@ void TypeRecovery::run(Module &M1, ModuleAnalysisManager &MAM) {
   }
 
   if (DisableInterFunction) {
+    DebugDump::get().flush();
     return;
   }
 
   bottomUpPhase();
 
+  // for comparing pipelines, e.g. with and without NOTDEC_DSROA.
+  if (MemoryReport::get().isEnabled()) {
+    std::size_t GraphNodes = 0;
+    std::size_t GraphEdges = 0;
+    for (auto &Data : AG.AllSCCs) {
+      if (Data.BottomUpGenerator == nullptr) {
+        continue;
+      }
+      GraphNodes += Data.BottomUpGenerator->CG.Nodes.size();
+      GraphEdges += Data.BottomUpGenerator->CG.getNumEdges();
+    }
+    MemoryReport::get().recordTotal("bottom-up", GraphNodes, GraphEdges);
+  }
+
   if (DebugDir) {
     printModule(M, join(DebugDir, "02-AfterBottomUp.ll").c_str());
   }
@@ -1171,6 +1693,7 @@ void TypeRecovery::run(Module &M1, ModuleAnalysisManager &MAM) {
   topDownPhase();
 
   std::cerr << "Bottom up phase done! SCC count:" << AG.AllSCCs.size() << "\n";
+  MemoryReport::get().recordPeakRSS("top-down");
 
   if (DebugDir) {
     printAnnotatedModule(M, join(DebugDir, "02-AfterBottomUp.anno1.ll").c_str(),
@@ -1184,6 +1707,7 @@ void TypeRecovery::run(Module &M1, ModuleAnalysisManager &MAM) {
     //   std::abort();
     // }
   }
+  DebugDump::get().flush();
 
   LLVM_DEBUG(
       errs() << " ============== TypeRecovery::run End ===============\n");
@@ -1199,7 +1723,8 @@ TypeRecovery::getGlobalGraph(std::optional<std::string> DebugDir) {
   // Create type for memory node
   std::shared_ptr<ConstraintsGenerator> &Global = AG.Global;
   Global = std::make_shared<ConstraintsGenerator>(*this, "Global");
-  std::set<CGNode *> MemoryNodes;
+  // ordered by SCC index, so that the merge tree is deterministic.
+  std::vector<CGNode *> MemoryNodes;
   // std::set<CGNode *> MemoryNodesC;
   auto &AllSCCs = AG.AllSCCs;
   for (auto &Ent : AllSCCs) {
@@ -1210,7 +1735,7 @@ TypeRecovery::getGlobalGraph(std::optional<std::string> DebugDir) {
       if (M->outEdges.empty()) {
         continue;
       }
-      MemoryNodes.insert(M);
+      MemoryNodes.push_back(M);
     }
     // if (auto *M = G.CG.getMemoryNodeOrNull(retypd::Contravariant)) {
     //   if (M->outEdges.empty()) {
@@ -1224,7 +1749,7 @@ TypeRecovery::getGlobalGraph(std::optional<std::string> DebugDir) {
     llvm::errs() << "No memory node found\n";
     MemNode = Global->CG.getMemoryNode(retypd::Covariant);
   } else {
-    MemNode = multiGraphDeterminizeTo(*Global, MemoryNodes, "mdtm");
+    MemNode = treeDeterminizeTo(*this, *Global, std::move(MemoryNodes), "mdtm");
     // Global->mergeAfterDeterminize();
   }
   // CGNode *MemNodeC = nullptr;
@@ -1277,10 +1802,30 @@ void TypeRecovery::genASTTypes(Module &M) {
   using notdec::ast::HTypeContext;
 
   auto &AllSCCs = AG.AllSCCs;
+  std::optional<std::string> DebugDir;
+  if (auto D = getTRDebugDir()) {
+    DebugDir.emplace(D);
+  }
+  bool KeepGraphs = isKeepAllGraphs();
+  // 3.1 the memory type merges the top-down graphs of all SCCs. Build it first,
+  // so that each top-down graph can be freed once its sketch is done.
+  if (!KeepGraphs) {
+    for (int i = 0; i < AllSCCs.size(); i++) {
+      auto &Data = AllSCCs[i];
+      auto &G = *getTopDownGraph(Data, getSCCDebugDir(i, Data.SCCName));
+      // postProcess does this first, which is the state the global graph saw
+      // when it was built after all sketches.
+      if (G.PG) {
+        G.PG->clearConstraints();
+      }
+    }
+    getGlobalGraph(DebugDir);
+  }
+
   for (int i = 0; i < AllSCCs.size(); i++) {
     auto &Data = AllSCCs[i];
 
-    auto Dir = getSCCDebugDir(i);
+    auto Dir = getSCCDebugDir(i, Data.SCCName);
     auto &G = *getTopDownGraph(Data, Dir);
     auto SCCName = Data.SCCName;
     assert(G.PG);
@@ -1294,7 +1839,7 @@ void TypeRecovery::genASTTypes(Module &M) {
     auto SCCTypes = getASTTypes(Data, Dir);
 
     // put the result into ResultVal
-    ConstraintsGenerator &G2 = *Data.SketchGenerator;
+    ConstraintsGenerator &G2 = *getSketchGraph(Data, Dir);
 
     for (auto &Ent : G2.V2N) {
       // TODO support function type.
@@ -1333,13 +1878,15 @@ void TypeRecovery::genASTTypes(Module &M) {
         }
       }
     }
+
+    // types are in ResultVal now, and the global graph is built.
+    if (!KeepGraphs) {
+      Data.TopDownGenerator.reset();
+      Data.SketchGenerator.reset();
+    }
   }
 
   // 3.4 build AST type for memory node
-  std::optional<std::string> DebugDir;
-  if (auto D = getTRDebugDir()) {
-    DebugDir.emplace(D);
-  }
   std::shared_ptr<ConstraintsGenerator> GlobalSkS =
       getGlobalSketchGraph(DebugDir);
 
@@ -1398,6 +1945,8 @@ void TypeRecovery::genASTTypes(Module &M) {
 
   // gen_json("retypd-constrains.json");
 
+  MemoryReport::get().recordPeakRSS("type-generation");
+
   if (DebugDir) {
     printAnnotatedModule(Mod, join(*DebugDir, "03-Final.anno2.ll").c_str(), 2);
   }
@@ -1463,6 +2012,7 @@ TypeRecovery::getASTTypes(SCCData &Data, std::optional<std::string> DebugDir) {
 
   //!! 3.1 post process the graph for type generation
   auto SkG = getSketchGraph(Data, DebugDir);
+  reportMemory(Data, "sketch", SkG.get());
   ConstraintsGenerator &G2 = *SkG;
 
   retypd::TypeBuilderContext TBC(*HTCtx, Mod.getName(), Mod.getDataLayout());
@@ -1624,6 +2174,7 @@ TypeRecovery::getASTTypes(SCCData &Data, std::optional<std::string> DebugDir) {
     }
   }
 
+  reportMemory(Data, "ast", nullptr);
   return Data.TypeResult;
 }
 
@@ -1675,12 +2226,13 @@ PreservedAnalyses TypeRecoveryOpt::run(Module &M, ModuleAnalysisManager &MAM) {
 
   const char *DebugDir = getTRDebugDir();
   std::vector<SCCData> &AllSCCs = TR.AG.AllSCCs;
+  std::vector<Function *> ChangedFuncs;
 
   for (size_t SCCIndex = 0; SCCIndex < AllSCCs.size(); ++SCCIndex) {
     SCCData &Data = AllSCCs.at(SCCIndex);
     bool SCCChanged = false;
 
-    auto SCCDebugDir = getSCCDebugDir(SCCIndex);
+    auto SCCDebugDir = getSCCDebugDir(SCCIndex, Data.SCCName);
     auto SCCTys = TR.getASTTypes(Data, SCCDebugDir);
 
     for (auto F : Data.SCCSet) {
@@ -1705,17 +2257,26 @@ PreservedAnalyses TypeRecoveryOpt::run(Module &M, ModuleAnalysisManager &MAM) {
 
       // 处理entry块中确定大小的alloca指令。
       StackBreaker SB;
-      SCCChanged |=
-          SB.runOnAlloca(*Stack, *SCCTys, &TR.getOrCreateFuncAllocaRange(F));
+      if (SB.runOnAlloca(*Stack, *SCCTys, &TR.getOrCreateFuncAllocaRange(F))) {
+        SCCChanged = true;
+        ChangedFuncs.push_back(F);
+      }
     }
 
     if (SCCChanged) {
       // invalidate all passes
       Data.onIRChanged();
+    } else if (!isKeepAllGraphs()) {
+      // only the stack types are needed here.
+      Data.TopDownGenerator.reset();
+      Data.SketchGenerator.reset();
     }
   }
 
   TR.AG.onIRChanged();
+  if (auto *Cached = MAM.getCachedResult<CallGraphSCCAnalysis>(M)) {
+    (*Cached)->updateFunctions(ChangedFuncs);
+  }
 
   if (DebugDir) {
     printModule(M, join(DebugDir, "TROpt.ll").c_str());
@@ -1723,6 +2284,7 @@ PreservedAnalyses TypeRecoveryOpt::run(Module &M, ModuleAnalysisManager &MAM) {
 
   auto PA = PreservedAnalyses::none();
   PA.preserve<CallGraphAnalysis>();
+  PA.preserve<CallGraphSCCAnalysis>();
   return PA;
 }
 
@@ -2029,14 +2591,14 @@ ConstraintsGenerator::genSketch(std::map<const CGNode *, CGNode *> &Old2New,
       if (Edge.getLabel().isForgetLabel() || Edge.getLabel().isRecallBase()) {
         continue;
       }
-      if (Edge.Label.isOne() && Node.key.Base.isPrimitive() &&
+      if (Edge.getLabel().isOne() && Node.key.Base.isPrimitive() &&
           Edge.getTargetNode().key.Base.isPrimitive()) {
         // one edge between primitive is invalid.
         continue;
       }
       auto &Target = Edge.getTargetNode();
       auto NewTarget = Old2New.at(&Target);
-      auto Label = Edge.Label;
+      auto Label = Edge.getLabel();
       if (retypd::isStore(Label)) {
         Label = retypd::toLoad(Label);
       }
@@ -2074,15 +2636,11 @@ ConstraintsGenerator::genSketch(std::map<const CGNode *, CGNode *> &Old2New,
   }
 
   // 更新V2N映射
-  for (auto &Ent : V2N) {
-    // this is NodeKey, no need to map.
-    auto It = To->V2N.insert(Ent.first, Old2New.at(Ent.second));
-    assert(It.second);
-  }
-  for (auto &Ent : V2NContra) {
-    auto It = To->V2NContra.insert(Ent.first, Old2New.at(Ent.second));
-    assert(It.second);
-  }
+  auto MapNode = [&](CGNode *N) { return Old2New.at(N); };
+  bool Inserted = To->V2N.insertMapped(V2N, MapNode);
+  Inserted &= To->V2NContra.insertMapped(V2NContra, MapNode);
+  assert(Inserted);
+  (void)Inserted;
 
   // 复制其他必要的信息
   To->SCCs = SCCs;
@@ -2109,15 +2667,11 @@ void ConstraintsGenerator::cloneTo(
   ConstraintGraph::clone(Old2New, CG, G.CG, isMergeClone, nullptr,
                          ConflictKeyRelation);
   assert(&Ctx == &G.Ctx);
-  for (auto &Ent : V2N) {
-    // this is NodeKey, no need to map.
-    auto It = G.V2N.insert(Ent.first, Old2New.at(Ent.second));
-    assert(It.second);
-  }
-  for (auto &Ent : V2NContra) {
-    auto It = G.V2NContra.insert(Ent.first, Old2New.at(Ent.second));
-    assert(It.second);
-  }
+  auto MapNode = [&](CGNode *N) { return Old2New.at(N); };
+  bool Inserted = G.V2N.insertMapped(V2N, MapNode);
+  Inserted &= G.V2NContra.insertMapped(V2NContra, MapNode);
+  assert(Inserted);
+  (void)Inserted;
   G.SCCs = SCCs;
   for (auto &Ent : CallToInstance) {
     G.CallToInstance.insert(
@@ -2176,7 +2730,7 @@ void ConstraintsGenerator::removeUnreachable() {
       // erase all out edges
       for (auto &Edge : Node.outEdges) {
         // CG.removeEdge(Edge.FromNode, Edge.TargetNode, Edge.Label);
-        ToRemove.emplace_back(&Edge.FromNode, &Edge.TargetNode, Edge.Label);
+        ToRemove.emplace_back(&Edge.FromNode, &Edge.TargetNode, Edge.getLabel());
       }
     }
   }
@@ -2207,101 +2761,54 @@ void ConstraintsGenerator::quotientMerge() {
   // 基于图上的等价关系，合并节点。
   // 子类型边已经被之前的算法处理了。现在只需要处理非子类型边。
   // 核心规则：如果某个节点在相同的出边下指向了两个不同的节点，则合并这两个节点。不断重复直到不再能合并节点
-  // TODO
-  bool changed = true;
+  // 合并只会让保留的节点多出新的出边，其他节点每个标签的目标只会变少。所以只需要
+  // 重新检查保留的节点和当前节点，而不用每次合并后遍历整个图。
+  // 按Id从小到大处理，并总是合并到Id较小的节点（避免非确定性）。
+  std::map<unsigned long, CGNode *> Worklist;
+  for (auto &Node : CG) {
+    if (Node.isStartOrEnd()) {
+      continue;
+    }
+    auto Inserted = Worklist.emplace(Node.getId(), &Node).second;
+    assert(Inserted && "quotientMerge: duplicate node id");
+    (void)Inserted;
+  }
 
-  while (changed) {
-    changed = false;
+  while (!Worklist.empty()) {
+    CGNode *Node = Worklist.begin()->second;
+    Worklist.erase(Worklist.begin());
 
-    // 遍历所有节点
-    for (auto &Node : CG) {
-      if (Node.isStartOrEnd()) {
+    // 按出边标签分组，检查相同标签是否指向不同节点
+    std::map<retypd::EdgeLabel, std::map<unsigned long, CGNode *>>
+        OutEdgesByLabel;
+    for (auto &Edge : Node->outEdges) {
+      CGNode *Target = const_cast<CGNode *>(&Edge.getTargetNode());
+      // 跳过指向自己的边（自环）
+      if (Target == Node) {
         continue;
       }
+      OutEdgesByLabel[Edge.getLabel()].emplace(Target->getId(), Target);
+    }
 
-      // 收集所有需要合并的节点对
-      // std::vector<std::pair<CGNode*, CGNode*>> toMerge;
-      std::map<CGNode *, CGNode *> toMerge;
-
-      // 查找根节点（路径压缩）
-      std::function<CGNode *(CGNode *)> Find = [&](CGNode *node) -> CGNode * {
-        auto It = toMerge.find(node);
-        if (It == toMerge.end()) {
-          // 如果节点不在并查集中，即表示没有被合并
-          return node;
-        }
-
-        if (It->second == node) {
-          return node;
-        }
-
-        // 路径压缩
-        auto To = Find(It->second);
-        if (To != It->second) {
-          It->second = To;
-        }
-        return To;
-      };
-
-      auto Merge = [&](CGNode *From, CGNode *To) {
-        CGNode *rootA = Find(From);
-        CGNode *rootB = Find(To);
-
-        if (rootA != rootB) {
-          // 总是合并到较小的节点（避免非确定性）
-          if (rootA->getId() < rootB->getId()) {
-            toMerge[rootB] = rootA;
-          } else {
-            toMerge[rootA] = rootB;
-          }
-        }
-      };
-
-      // 按出边标签分组，检查相同标签是否指向不同节点
-      std::map<retypd::EdgeLabel, std::set<CGNode *>> outEdgesByLabel;
-
-      for (auto &edge : Node.outEdges) {
-        CGNode *target = const_cast<CGNode *>(&edge.getTargetNode());
-        // 跳过指向自己的边（自环）
-        if (target == &Node) {
-          continue;
-        }
-        outEdgesByLabel[edge.getLabel()].insert(target);
-      }
-
-      // 对于每个标签，如果指向多个不同节点，则这些目标节点应该合并
-      for (auto &entry : outEdgesByLabel) {
-        auto &targets = entry.second;
-        if (targets.size() > 1) {
-          // 找到所有需要合并的节点对
-          auto it = targets.begin();
-          CGNode *firstTarget = *it;
-          ++it;
-
-          for (; it != targets.end(); ++it) {
-            CGNode *currentTarget = *it;
-            Merge(firstTarget, currentTarget);
-          }
-        }
+    for (auto &Ent : OutEdgesByLabel) {
+      auto &Targets = Ent.second;
+      if (Targets.size() < 2) {
+        continue;
       }
-
-      // 执行合并
-      for (auto &mergePair : toMerge) {
-        CGNode *from = mergePair.first;
-        CGNode *to = Find(mergePair.second);
-
-        // 确保两个节点都还存在且不同
-        if (from != to) {
-          if (TraceIds.count(from->getId()) || TraceIds.count(to->getId())) {
-            llvm::errs() << "quotientMerge: Merging Node "
-                         << toString(from->key) << " into " << toString(to->key)
-                         << "\n";
-          }
-
-          mergeNodeTo(*from, *to, false);
-          changed = true;
+      CGNode *To = Targets.begin()->second;
+      for (auto It = std::next(Targets.begin()); It != Targets.end(); ++It) {
+        CGNode *From = It->second;
+        if (TraceIds.count(From->getId()) || TraceIds.count(To->getId())) {
+          llvm::errs() << "quotientMerge: Merging Node " << toString(From->key)
+                       << " into " << toString(To->key) << "\n";
         }
+        Worklist.erase(From->getId());
+        mergeNodeTo(*From, *To, false);
       }
+      // the edges of both nodes changed, other labels are checked again.
+      Worklist.emplace(To->getId(), To);
+      Worklist.emplace(Node->getId(), Node);
+      break;
     }
   }
 }
@@ -2323,7 +2830,7 @@ void ConstraintsGenerator::makePointerEqual(
       std::set<CGNode *> ToMerge;
       for (auto &Edge : N.outEdges) {
         auto Target = const_cast<CGNode *>(&Edge.getTargetNode());
-        if (Edge.Label.isOne() && Target != &N) {
+        if (Edge.getLabel().isOne() && Target != &N) {
           // ToAdd.emplace_back(&Edge.TargetNode, &Edge.FromNode, Edge.Label);
           ToMerge.insert(Target);
         }
@@ -2355,87 +2862,115 @@ void ConstraintsGenerator::eliminateCycle(std::optional<std::string> DebugDir) {
   all_scc_iterator<OffsetOnly<ConstraintGraph *>> SCCI =
       notdec::scc_begin(OffsetOnly<ConstraintGraph *>(&CG));
 
+  // SCC index of each node. Edges are classified by comparing the indices of
+  // their ends, instead of copying them into tuple sets.
+  llvm::DenseMap<const CGNode *, std::size_t> SCCOf;
   std::vector<std::set<CGNode *>> SCCs;
   for (; !SCCI.isAtEnd(); ++SCCI) {
+    auto &Nodes = *SCCI;
+    if (Nodes.size() == 1) {
+      // nothing to do for a single node without self loop.
+      auto *N = Nodes.front().Graph;
+      bool HasSelfLoop = false;
+      for (auto &E : N->outEdges) {
+        if (&E.getTargetNode() == N) {
+          HasSelfLoop = true;
+          break;
+        }
+      }
+      if (!HasSelfLoop) {
+        continue;
+      }
+    }
     SCCs.emplace_back();
     auto &SCCSet = SCCs.back();
-    for (auto N : *SCCI) {
+    for (auto N : Nodes) {
       SCCSet.insert(N.Graph);
+      SCCOf[N.Graph] = SCCs.size() - 1;
     }
   }
 
-  for (const auto &SCCSet : SCCs) {
-    std::set<std::tuple<CGNode *, CGNode *, retypd::EdgeLabel>> inSCCEdges;
-    std::set<std::tuple<CGNode *, CGNode *, retypd::EdgeLabel>> outSCCEdges;
-    std::set<std::tuple<CGNode *, CGNode *, retypd::EdgeLabel>>
-        InternalSCCEdges;
+  // same order as a set of (source, target, label) tuples.
+  auto EdgeLess = [](const CGEdge *A, const CGEdge *B) {
+    if (&A->getSourceNode() != &B->getSourceNode()) {
+      return &A->getSourceNode() < &B->getSourceNode();
+    }
+    if (&A->getTargetNode() != &B->getTargetNode()) {
+      return &A->getTargetNode() < &B->getTargetNode();
+    }
+    return A->getLabel() < B->getLabel();
+  };
 
-    // 1. Collect and classify all edges.
+  for (std::size_t SCCIndex = 0; SCCIndex < SCCs.size(); ++SCCIndex) {
+    const auto &SCCSet = SCCs[SCCIndex];
+    auto InSCC = [&](const CGNode &N) {
+      auto It = SCCOf.find(&N);
+      return It != SCCOf.end() && It->second == SCCIndex;
+    };
+    std::vector<const CGEdge *> inSCCEdges;
+    std::vector<const CGEdge *> outSCCEdges;
+    std::vector<const CGEdge *> InternalSCCEdges;
+
+    // 1. Collect and classify all edges. Internal edges are collected from
+    // the out edges only, so each edge is seen once.
     for (auto N : SCCSet) {
       for (auto E : N->inEdges) {
-        bool SourceInSCC = SCCSet.count(&E->getSourceNode());
-        if (SourceInSCC) {
-          InternalSCCEdges.insert(std::make_tuple(
-              &E->getSourceNode(), &E->getTargetNode(), E->getLabel()));
-        } else {
-          inSCCEdges.insert(std::make_tuple(
-              &E->getSourceNode(), &E->getTargetNode(), E->getLabel()));
+        if (!InSCC(E->getSourceNode())) {
+          inSCCEdges.push_back(E);
         }
       }
       for (auto &E : N->outEdges) {
-        auto Src = const_cast<CGNode *>(&E.getSourceNode());
-        auto Dst = const_cast<CGNode *>(&E.getTargetNode());
-
-        bool TargetInSCC = SCCSet.count(Dst);
-        if (TargetInSCC) {
-          InternalSCCEdges.insert(std::make_tuple(Src, Dst, E.getLabel()));
+        if (InSCC(E.getTargetNode())) {
+          InternalSCCEdges.push_back(&E);
         } else {
-          outSCCEdges.insert(std::make_tuple(Src, Dst, E.getLabel()));
+          outSCCEdges.push_back(&E);
         }
       }
     }
+    // The relinking below is order dependent when two edges are mapped to
+    // the same edge.
+    std::sort(inSCCEdges.begin(), inSCCEdges.end(), EdgeLess);
+    std::sort(outSCCEdges.begin(), outSCCEdges.end(), EdgeLess);
 
     // for each SCCEdge, find the lowest offset
     std::optional<long> MinOffset;
-    std::tuple<CGNode *, CGNode *, retypd::EdgeLabel> MinOffEdge = {};
+    const CGEdge *MinOffEdge = nullptr;
 
     // find min offset and store in MinOffset. Update MinOffEdge accordingly.
-    auto VisitOffset =
-        [&](int64_t Off,
-            const std::tuple<CGNode *, CGNode *, retypd::EdgeLabel> &Ent) {
-          // visit offset
-          if (Off > 0) {
-            if (!MinOffset.has_value()) {
-              MinOffset = Off;
-              MinOffEdge = Ent;
-            } else {
-              if (Off < *MinOffset) {
-                MinOffset = Off;
-                MinOffEdge = Ent;
-              }
-            }
-          }
-        };
-
-    for (auto &Ent : InternalSCCEdges) {
-      // auto Src = std::get<0>(Ent);
-      // auto Dst = std::get<1>(Ent);
-      auto &L = std::get<2>(Ent);
-      if (auto Off = retypd::getOffsetLabel(L)) {
-        VisitOffset(Off->range.offset, Ent);
+    // On ties, keep the smallest edge.
+    auto VisitOffset = [&](int64_t Off, const CGEdge *E) {
+      // visit offset
+      if (Off > 0) {
+        if (!MinOffset.has_value() || Off < *MinOffset ||
+            (Off == *MinOffset && EdgeLess(E, MinOffEdge))) {
+          MinOffset = Off;
+          MinOffEdge = E;
+        }
+      }
+    };
+
+    for (auto *E : InternalSCCEdges) {
+      if (auto Off = retypd::getOffsetLabel(E->getLabel())) {
+        VisitOffset(Off->range.offset, E);
         for (auto A : Off->range.access) {
-          VisitOffset(A.Size, Ent);
+          VisitOffset(A.Size, E);
         }
       }
     }
 
+    CGNode *N1 = nullptr;
+    CGNode *N2 = nullptr;
+    if (MinOffEdge != nullptr) {
+      N1 = const_cast<CGNode *>(&MinOffEdge->getSourceNode());
+      N2 = const_cast<CGNode *>(&MinOffEdge->getTargetNode());
+    }
+
     // 1 remove all edges within SCC.
-    for (auto Ent : InternalSCCEdges) {
-      auto Src = std::get<0>(Ent);
-      auto Dst = std::get<1>(Ent);
-      auto &L = std::get<2>(Ent);
-      CG.removeEdge(*Src, *Dst, L);
+    for (auto *E : InternalSCCEdges) {
+      CG.removeEdge(const_cast<CGNode &>(E->getSourceNode()),
+                    const_cast<CGNode &>(E->getTargetNode()), E->getLabel());
     }
+    InternalSCCEdges.clear();
 
     if (!MinOffset.has_value()) {
       if (SCCSet.size() != 1) {
@@ -2468,8 +3003,6 @@ void ConstraintsGenerator::eliminateCycle(std::optional<std::string> DebugDir) {
 
       // move incoming and outgoing edges, remove unnecessary incoming or
       // outgoing offset
-      auto N1 = std::get<0>(MinOffEdge);
-      auto N2 = std::get<1>(MinOffEdge);
       EdgeLabel L1 = {retypd::RecallLabel{OffsetLabel{
           .range =
               OffsetRange{.offset = 0, .access = {ArrayOffset(*MinOffset)}}}}};
@@ -2489,10 +3022,10 @@ void ConstraintsGenerator::eliminateCycle(std::optional<std::string> DebugDir) {
         Out.close();
       }
 
-      for (auto Ent : inSCCEdges) {
-        auto Src = std::get<0>(Ent);
-        auto Dst = std::get<1>(Ent);
-        auto L = std::get<2>(Ent);
+      for (auto *E : inSCCEdges) {
+        auto Src = const_cast<CGNode *>(&E->getSourceNode());
+        auto Dst = const_cast<CGNode *>(&E->getTargetNode());
+        auto L = E->getLabel();
         CG.removeEdge(*Src, *Dst, L);
 
         auto LinkTo = N1;
@@ -2512,10 +3045,10 @@ void ConstraintsGenerator::eliminateCycle(std::optional<std::string> DebugDir) {
         }
         CG.addEdge(*Src, *LinkTo, L);
       }
-      for (auto Ent : outSCCEdges) {
-        auto Src = std::get<0>(Ent);
-        auto Dst = std::get<1>(Ent);
-        auto L = std::get<2>(Ent);
+      for (auto *E : outSCCEdges) {
+        auto Src = const_cast<CGNode *>(&E->getSourceNode());
+        auto Dst = const_cast<CGNode *>(&E->getTargetNode());
+        auto L = E->getLabel();
         CG.removeEdge(*Src, *Dst, L);
         auto LinkFrom = N2;
         if (auto Off = retypd::getOffsetLabel(L)) {
@@ -2560,44 +3093,67 @@ void ConstraintsGenerator::mergeOnlySubtype() {
   // perform merging: if node A -> B, and there is no other edge from A to other
   // node, then merge A to B
   // for each node and outgoing edge, check if is one edge
-  auto findMergePair = [&]() -> std::pair<CGNode *, CGNode *> {
-    for (auto &Node : CG.Nodes) {
-      if (Node.isSpecial()) {
-        continue;
-      }
-      if (Node.key.Base.isPrimitive()) {
-        continue;
-      }
+  auto getMergeTarget = [&](CGNode &Node) -> CGNode * {
+    if (Node.isSpecial()) {
+      return nullptr;
+    }
+    if (Node.key.Base.isPrimitive()) {
+      return nullptr;
+    }
+    if (Node.outEdges.size() != 1) {
+      return nullptr;
+    }
+    // the only out edge, independent of the edge order.
+    auto &Edge = *Node.outEdges.begin();
+    if (!Edge.getLabel().isOne()) {
+      return nullptr;
+    }
+    auto &Target = const_cast<CGNode &>(Edge.getTargetNode());
+    if (&Target == CG.getStartNode() || &Target == CG.getEndNode()) {
+      return nullptr;
+    }
+    if (Target.key.Base.isPrimitive()) {
+      return nullptr;
+    }
+    assert(Node.getPNIVar() == Target.getPNIVar());
+    return &Target;
+  };
 
-      for (auto &Edge : Node.outEdges) {
-        if (!Edge.getLabel().isOne()) {
-          continue;
-        }
-        auto &Target = const_cast<CGNode &>(Edge.getTargetNode());
-        if (&Target == CG.getStartNode() || &Target == CG.getEndNode()) {
-          continue;
-        }
-        if (Target.key.Base.isPrimitive()) {
-          continue;
-        }
-        if (Node.outEdges.size() == 1) {
-          assert(Node.getPNIVar() == Target.getPNIVar());
-          return {&Node, &Target};
-        }
+  // Visit nodes in list order, so that the first pair is merged first, as a
+  // full rescan would do. Merging A to B only changes the out edges of B and
+  // of A's predecessors, so only they are revisited.
+  std::map<CGNode *, std::size_t> Order;
+  std::map<std::size_t, CGNode *> Worklist;
+  for (auto &Node : CG.Nodes) {
+    auto Index = Order.size();
+    Order.emplace(&Node, Index);
+    Worklist.emplace(Index, &Node);
+  }
+  while (!Worklist.empty()) {
+    CGNode *A = Worklist.begin()->second;
+    Worklist.erase(Worklist.begin());
+    CGNode *B = getMergeTarget(*A);
+    if (B == nullptr) {
+      continue;
+    }
+    std::vector<CGNode *> Affected = {B};
+    for (auto *Edge : A->inEdges) {
+      auto *Source = &Edge->getSourceNode();
+      if (Source != A) {
+        Affected.push_back(Source);
       }
     }
-    return {nullptr, nullptr};
-  };
-  CGNode *A, *B;
-  std::tie(A, B) = findMergePair();
-  while (A != nullptr && B != nullptr) {
     // merge A to B
     LLVM_DEBUG(llvm::dbgs() << "Merge: " << toString(A->key) << " to "
                             << toString(B->key) << "\n");
+    Order.erase(A);
     mergeNodeTo(*A, *B, false);
-    A = nullptr;
-    B = nullptr;
-    std::tie(A, B) = findMergePair();
+    for (auto *N : Affected) {
+      auto It = Order.find(N);
+      if (It != Order.end()) {
+        Worklist.emplace(It->second, N);
+      }
+    }
   }
 }
 
@@ -2803,12 +3359,9 @@ void ConstraintsGenerator::recoverNodes(ConstraintsGenerator &From) {
   // }
 
   // recover V2N Maps
-  for (auto &Ent : From.V2N) {
-    V2N.insert(Ent.first, V2NMap.at(Ent.second));
-  }
-  for (auto &Ent : From.V2NContra) {
-    V2NContra.insert(Ent.first, V2NMap.at(Ent.second));
-  }
+  auto MapNode = [&](CGNode *N) { return V2NMap.at(N); };
+  V2N.insertMapped(From.V2N, MapNode);
+  V2NContra.insertMapped(From.V2NContra, MapNode);
 
   // remove all start and end edges.
   CG.Start->removeOutEdges();
@@ -2935,7 +3488,7 @@ void ConstraintsGenerator::determinize() {
   for (auto &N : CG) {
     for (auto &Edge : N.outEdges) {
       // CG.removeEdge(Edge.FromNode, Edge.TargetNode, Edge.Label);
-      ToRemove.push_back({&Edge.FromNode, &Edge.TargetNode, Edge.Label});
+      ToRemove.push_back({&Edge.FromNode, &Edge.TargetNode, Edge.getLabel()});
     }
   }
   for (auto &Ent : ToRemove) {
@@ -3135,25 +3688,59 @@ void ConstraintsGenerator::mergeAfterDeterminize() {
             << " Nodes in " << DurationMS << "ms for " << CG.Name << ".\n";
 }
 
+void ConstraintsGenerator::createFuncNodes(llvm::Function &Func) {
+  // the function node alone may exist, when the function is used as a value.
+  bool HasRet = Func.getReturnType()->isVoidTy() ||
+                lookupNode(ReturnValue{.Func = &Func}, retypd::Covariant);
+  bool HasArgs =
+      Func.arg_size() == 0 ||
+      lookupNode(Func.getArg(Func.arg_size() - 1), retypd::Contravariant);
+  if (lookupNode(&Func, retypd::Covariant) != nullptr && HasRet && HasArgs) {
+    return;
+  }
+  auto &F = getOrInsertNode(&Func, nullptr, -1, retypd::Covariant);
+  for (int i = 0; i < Func.arg_size(); i++) {
+    auto &Arg =
+        getOrInsertNode(Func.getArg(i), nullptr, i, retypd::Contravariant);
+    addConstraint(F, Arg, {retypd::InLabel{.name = std::to_string(i)}});
+  }
+  if (!Func.getReturnType()->isVoidTy()) {
+    auto &Ret = getOrInsertNode(ReturnValue{.Func = &Func}, nullptr, -1,
+                                retypd::Covariant);
+    addConstraint(F, Ret, {retypd::OutLabel{}});
+  }
+}
+
+std::vector<llvm::Function *> ConstraintsGenerator::getOrderedFuncs() const {
+  if (SCCs.size() <= 1) {
+    return {SCCs.begin(), SCCs.end()};
+  }
+  std::vector<llvm::Function *> Funcs;
+  for (auto &F : Ctx.Mod) {
+    auto *Func = const_cast<llvm::Function *>(&F);
+    if (SCCs.count(Func)) {
+      Funcs.push_back(Func);
+    }
+  }
+  assert(Funcs.size() == SCCs.size());
+  return Funcs;
+}
+
 void ConstraintsGenerator::run() {
-  for (llvm::Function *Func : SCCs) {
-    // create function nodes
-    auto &F = getOrInsertNode(Func, nullptr, -1, retypd::Covariant);
-    for (int i = 0; i < Func->arg_size(); i++) {
-      auto &Arg =
-          getOrInsertNode(Func->getArg(i), nullptr, i, retypd::Contravariant);
-      addConstraint(F, Arg, {retypd::InLabel{.name = std::to_string(i)}});
-    }
-    if (!Func->getReturnType()->isVoidTy()) {
-      auto &Ret = getOrInsertNode(ReturnValue{.Func = Func}, nullptr, -1,
-                                  retypd::Covariant);
-      addConstraint(F, Ret, {retypd::OutLabel{}});
-    }
-  }
-  for (llvm::Function *Func : SCCs) {
-    RetypdGeneratorVisitor Visitor(*this);
-    Visitor.visit(Func);
-    Visitor.handlePHINodes();
+  auto Funcs = getOrderedFuncs();
+  for (llvm::Function *Func : Funcs) {
+    createFuncNodes(*Func);
+  }
+  if (SCCs.size() > 1) {
+    // Also with one thread, so the names do not depend on the thread count.
+    runParallel(getGenerationThreads());
+  } else {
+    for (llvm::Function *Func : Funcs) {
+      createValueNodes(*Func);
+      RetypdGeneratorVisitor Visitor(*this);
+      Visitor.visit(Func);
+      Visitor.handlePHINodes();
+    }
   }
   CG.PG->solve();
   // preSimplify();
@@ -3164,11 +3751,134 @@ void ConstraintsGenerator::run() {
   }
 }
 
+void ConstraintsGenerator::runParallel(unsigned Threads) {
+  auto Funcs = getOrderedFuncs();
+  // Name the values, callees and function operands in order before the
+  // workers start, so that the names do not depend on the scheduling, and
+  // workers do not write the symbol tables. Constants get scoped names in
+  // the parts, see getNewName.
+  std::vector<std::string> Scopes;
+  std::function<void(Value *)> NameOperand = [&](Value *Op) {
+    if (auto *Target = dyn_cast<Function>(Op)) {
+      getFuncTvName(Target);
+    } else if (auto *CE = dyn_cast<ConstantExpr>(Op)) {
+      for (auto &COp : CE->operands()) {
+        NameOperand(COp);
+      }
+    } else if (!isa<Constant, Argument, Instruction, BasicBlock,
+                    MetadataAsValue>(Op)) {
+      getLockedName(*Op, ValueNamer::NewPrefix, true);
+    }
+  };
+  for (llvm::Function *Func : Funcs) {
+    Scopes.push_back(getFuncTvName(Func));
+    for (auto &I : llvm::instructions(*Func)) {
+      if (!I.getType()->isVoidTy()) {
+        getLockedName(I, getInstPrefix(I), true);
+      }
+      for (auto &Op : I.operands()) {
+        NameOperand(Op);
+      }
+    }
+  }
+  // getMetadata registers a custom kind on its first use.
+  Ctx.Mod.getContext().getMDKindID(KIND_ALLOC_SIZE);
+  Ctx.Mod.getContext().getMDKindID(KIND_STACK_DIRECTION);
+
+  std::vector<std::unique_ptr<ConstraintsGenerator>> Parts(Funcs.size());
+  auto GenPart = [&](std::size_t I) {
+    auto Part = std::make_unique<ConstraintsGenerator>(Ctx, CG.Name, SCCs);
+    Part->NameScope = Scopes[I];
+    Part->createFuncNodes(*Funcs[I]);
+    Part->createValueNodes(*Funcs[I]);
+    RetypdGeneratorVisitor Visitor(*Part);
+    Visitor.visit(Funcs[I]);
+    Visitor.handlePHINodes();
+    Parts[I] = std::move(Part);
+  };
+  if (Threads <= 1) {
+    for (std::size_t I = 0; I < Funcs.size(); ++I) {
+      GenPart(I);
+    }
+  } else {
+    ConcurrentScope Scope;
+    llvm::ThreadPool Pool(llvm::hardware_concurrency(Threads));
+    for (std::size_t I = 0; I < Funcs.size(); ++I) {
+      Pool.async([&, I]() { GenPart(I); });
+    }
+    Pool.wait();
+  }
+  // merge in the order of the SCC, so node ids do not depend on scheduling.
+  for (auto &Part : Parts) {
+    mergeFrom(*Part);
+    Part.reset();
+  }
+}
+
+void ConstraintsGenerator::mergeFrom(ConstraintsGenerator &Part) {
+  std::map<const CGNode *, CGNode *> Old2New;
+  ConstraintGraph::clone(Old2New, Part.CG, CG, true);
+
+  std::vector<std::pair<CGNode *, CGNode *>> ToMerge;
+  auto LinkValues = [&](ValueNodeMap &To, const ValueNodeMap &From) {
+    for (auto &Ent : From) {
+      auto *New = Old2New.at(Ent.second);
+      auto It = To.find(Ent.first);
+      if (It == To.end()) {
+        To.insert(Ent.first, New);
+      } else if (It->second != New) {
+        ToMerge.emplace_back(New, It->second);
+      }
+    }
+  };
+  LinkValues(V2N, Part.V2N);
+  LinkValues(V2NContra, Part.V2NContra);
+  for (auto &Ent : Part.PrimMap) {
+    auto *New = Old2New.at(Ent.second);
+    auto It = PrimMap.find(Ent.first);
+    if (It == PrimMap.end()) {
+      PrimMap.insert(Ent.first, New);
+    } else if (It->second != New) {
+      ToMerge.emplace_back(New, It->second);
+      ToMerge.emplace_back(&CG.getReverseVariant(*New),
+                           &CG.getReverseVariant(*It->second));
+    }
+  }
+  for (auto &Ent : Part.CallToInstance) {
+    CallToInstance.insert({Ent.first,
+                           std::make_pair(Old2New.at(Ent.second.first),
+                                          Old2New.at(Ent.second.second))});
+  }
+  for (auto &Ent : Part.UnhandledCalls) {
+    UnhandledCalls.insert({Ent.first,
+                           std::make_pair(Old2New.at(Ent.second.first),
+                                          Old2New.at(Ent.second.second))});
+  }
+
+  // a merged node may be the target of a later pair.
+  std::map<CGNode *, CGNode *> Forward;
+  auto Resolve = [&](CGNode *N) {
+    for (auto It = Forward.find(N); It != Forward.end(); It = Forward.find(N)) {
+      N = It->second;
+    }
+    return N;
+  };
+  for (auto &Ent : ToMerge) {
+    auto *From = Resolve(Ent.first);
+    auto *To = Resolve(Ent.second);
+    if (From != To) {
+      mergeNodeTo(*From, *To);
+      Forward.emplace(From, To);
+    }
+  }
+}
+
 void ConstraintsGenerator::instantiateSummary(
     llvm::CallBase *Inst, llvm::Function *Target,
     const ConstraintsGenerator &Summary) {
   // checkSymmetry();
-  auto [FI, FIC] = CallToInstance.at(Inst);
+  assert(CallToInstance.count(Inst));
+  auto [FI, FIC] = CallToInstance.lookup(Inst);
   assert(FI->key.Base.getContextId().size() == 1);
   auto CurrentId = FI->key.Base.getContextId().front();
   auto NKN = FI->key.Base.getBaseName();
@@ -3327,18 +4037,7 @@ retypd::CGNode *ConstraintsGenerator::getNodeOrNull(ExtValuePtr Val, User *User,
                                                     long OpInd,
                                                     retypd::Variance V) {
   llvmValue2ExtVal(Val, User, OpInd);
-
-  if (V == retypd::Covariant) {
-    if (V2N.count(Val)) {
-      return V2N.at(Val);
-    }
-    return nullptr;
-  } else {
-    if (V2NContra.count(Val)) {
-      return V2NContra.at(Val);
-    }
-    return nullptr;
-  }
+  return lookupNode(Val, V);
 }
 
 retypd::CGNode &ConstraintsGenerator::getNode(ExtValuePtr Val, User *User,
@@ -3388,7 +4087,7 @@ retypd::CGNode &ConstraintsGenerator::getOrInsertNode(ExtValuePtr Val,
                                                       User *User, long OpInd,
                                                       retypd::Variance V) {
   llvmValue2ExtVal(Val, User, OpInd);
-  auto Node = getNodeOrNull(Val, User, OpInd, V);
+  auto Node = lookupNode(Val, V);
   if (Node != nullptr) {
     return *Node;
   }
@@ -3413,6 +4112,50 @@ retypd::CGNode &ConstraintsGenerator::getOrInsertNode(ExtValuePtr Val,
   }
 }
 
+// Access to the function pointer table through a constant GEP, maybe behind a
+// bitcast. Load and store visitors ignore these.
+static bool isTableAccess(Value *Ptr) {
+  auto CE = dyn_cast<ConstantExpr>(Ptr);
+  if (CE == nullptr) {
+    return false;
+  }
+  if (CE->getOpcode() == Instruction::BitCast) {
+    if (auto CE2 = dyn_cast<ConstantExpr>(CE->getOperand(0))) {
+      CE = CE2;
+    }
+  }
+  return CE->getOpcode() == Instruction::GetElementPtr;
+}
+
+// Whether the visitor of I creates the node of I only on some conditions, so
+// that createValueNodes must leave it to the visitor.
+static bool hasConditionalNode(Instruction &I) {
+  if (auto Call = dyn_cast<CallBase>(&I)) {
+    // indirect calls are skipped
+    return Call->getCalledFunction() == nullptr;
+  } else if (auto Gep = dyn_cast<GetElementPtrInst>(&I)) {
+    return Gep->getPointerOperand()->getName().startswith("table_");
+  } else if (auto Load = dyn_cast<LoadInst>(&I)) {
+    return isTableAccess(Load->getPointerOperand());
+  }
+  // casts propagate the node of the operand only if it has one.
+  return isa<BitCastInst, PtrToIntInst, IntToPtrInst>(I);
+}
+
+void ConstraintsGenerator::createValueNodes(llvm::Function &F) {
+  for (auto &I : llvm::instructions(F)) {
+    if (I.getType()->isVoidTy() || I.getType()->isAggregateType()) {
+      continue;
+    }
+    if (hasConditionalNode(I)) {
+      continue;
+    }
+    if (lookupNode(&I, retypd::Covariant) == nullptr) {
+      createNode(&I, nullptr, -1);
+    }
+  }
+}
+
 const TypeVariable &ConstraintsGenerator::getTypeVar(ExtValuePtr Val,
                                                      User *User, long OpInd) {
   return getOrInsertNode(Val, User, OpInd, retypd::Covariant).key.Base;
@@ -3498,7 +4241,7 @@ TypeVariable ConstraintsGenerator::convertTypeVarVal(Value *Val, User *User,
             << "Error: convertTypeVarVal: direct use of stack pointer?, ensure "
                "StackAllocationRecovery is run before, Or add external summary "
                "for this function.\n";
-        return makeTv(Ctx.TRCtx, ValueNamer::getName());
+        return makeTv(Ctx.TRCtx, getNewName());
       } else if (auto Func = dyn_cast<Function>(C)) {
         return makeTv(Ctx.TRCtx, getFuncTvName(Func));
       }
@@ -3507,13 +4250,13 @@ TypeVariable ConstraintsGenerator::convertTypeVarVal(Value *Val, User *User,
       if (auto CI = dyn_cast<ConstantInt>(C)) {
         assert(false && "Should be converted earlier");
       }
-      return makeTv(Ctx.TRCtx, ValueNamer::getName("constant_"));
+      return makeTv(Ctx.TRCtx, getNewName("constant_"));
       // auto Ty = C->getType();
       // return getLLVMTypeVar(Ctx.TRCtx, Ty);
     } else if (isa<ConstantPointerNull>(C)) {
-      return makeTv(Ctx.TRCtx, ValueNamer::getName("null_"));
+      return makeTv(Ctx.TRCtx, getNewName("null_"));
     } else if (isa<UndefValue>(C)) {
-      return makeTv(Ctx.TRCtx, ValueNamer::getName("undef_"));
+      return makeTv(Ctx.TRCtx, getNewName("undef_"));
     }
     llvm::errs()
         << __FILE__ << ":" << __LINE__ << ": "
@@ -3528,41 +4271,37 @@ TypeVariable ConstraintsGenerator::convertTypeVarVal(Value *Val, User *User,
     return tv;
   }
 
-  // Use different suffix for different type of value.
-  if (auto *Sel = dyn_cast<SelectInst>(Val)) {
-    return makeTv(Ctx.TRCtx,
-                  ValueNamer::getName(*Sel, ValueNamer::SelectPrefix, true));
-  } else if (auto *Alloca = dyn_cast<AllocaInst>(Val)) {
-    const char *prefix = ValueNamer::AllocaPrefix;
-    if (Alloca->getParent()->isEntryBlock()) {
-      prefix = ValueNamer::StackPrefix;
-    }
-    return makeTv(Ctx.TRCtx, ValueNamer::getName(*Alloca, prefix, true));
-  } else if (auto Phi = dyn_cast<PHINode>(Val)) {
-    return makeTv(Ctx.TRCtx,
-                  ValueNamer::getName(*Phi, ValueNamer::PhiPrefix, true));
-  } else if (auto *I = dyn_cast<Instruction>(Val)) {
-    return makeTv(Ctx.TRCtx,
-                  ValueNamer::getName(*I, ValueNamer::NewPrefix, true));
-  } else if (auto *Load = dyn_cast<LoadInst>(Val)) {
-    return makeTv(Ctx.TRCtx,
-                  ValueNamer::getName(*Load, ValueNamer::LoadPrefix, true));
-  } else if (auto *Store = dyn_cast<StoreInst>(Val)) {
-    return makeTv(Ctx.TRCtx,
-                  ValueNamer::getName(*Store, ValueNamer::StorePrefix, true));
-  } else if (auto *Add = dyn_cast<BinaryOperator>(Val)) {
-    return makeTv(Ctx.TRCtx,
-                  ValueNamer::getName(*Add, ValueNamer::AddPrefix, true));
-  } else if (auto *Sub = dyn_cast<BinaryOperator>(Val)) {
-    return makeTv(Ctx.TRCtx,
-                  ValueNamer::getName(*Sub, ValueNamer::SubPrefix, true));
+  if (auto *I = dyn_cast<Instruction>(Val)) {
+    return makeTv(Ctx.TRCtx, getLockedName(*I, getInstPrefix(*I), true));
   }
 
   llvm::errs() << __FILE__ << ":" << __LINE__ << ": "
                << "WARN: RetypdGenerator::getTypeVar unhandled value: " << *Val
                << "\n";
-  return makeTv(Ctx.TRCtx,
-                ValueNamer::getName(*Val, ValueNamer::NewPrefix, true));
+  return makeTv(Ctx.TRCtx, getLockedName(*Val, ValueNamer::NewPrefix, true));
+}
+
+std::string ConstraintsGenerator::getNewName(const char *Prefix) {
+  if (NameScope.empty()) {
+    return Prefix != nullptr ? getLockedName(Prefix) : getLockedName();
+  }
+  return std::string(Prefix != nullptr ? Prefix : "v_") + NameScope + "_" +
+         std::to_string(NextScopedName++);
+}
+
+// Use different suffix for different type of value.
+const char *ConstraintsGenerator::getInstPrefix(llvm::Instruction &I) {
+  if (isa<SelectInst>(I)) {
+    return ValueNamer::SelectPrefix;
+  } else if (auto *Alloca = dyn_cast<AllocaInst>(&I)) {
+    if (Alloca->getParent()->isEntryBlock()) {
+      return ValueNamer::StackPrefix;
+    }
+    return ValueNamer::AllocaPrefix;
+  } else if (isa<PHINode>(I)) {
+    return ValueNamer::PhiPrefix;
+  }
+  return ValueNamer::NewPrefix;
 }
 
 // TODO: accept any character in name by using single quotes like LLVM IR.
@@ -3613,7 +4352,7 @@ void ConstraintsGenerator::RetypdGeneratorVisitor::visitExtractValueInst(
         auto Ind = I.getIndices()[0];
         if (Ind == 0) {
           if (isWithOverflowIntrinsicSigned(Target->getIntrinsicID())) {
-            auto &N = cg.createNodeCovariant(&I, nullptr, -1);
+            auto &N = cg.getNode(&I, nullptr, -1, retypd::Covariant);
             if (N.getPNIVar()->isPNRelated()) {
               N.getPNIVar()->setNonPtr();
             }
@@ -3623,7 +4362,7 @@ void ConstraintsGenerator::RetypdGeneratorVisitor::visitExtractValueInst(
             return;
           } else if (isWithOverflowIntrinsicUnsigned(
                          Target->getIntrinsicID())) {
-            auto &N = cg.createNodeCovariant(&I, nullptr, -1);
+            auto &N = cg.getNode(&I, nullptr, -1, retypd::Covariant);
             if (N.getPNIVar()->isPNRelated()) {
               N.getPNIVar()->setNonPtr();
             }
@@ -3635,7 +4374,7 @@ void ConstraintsGenerator::RetypdGeneratorVisitor::visitExtractValueInst(
         } else if (Ind == 1) {
           assert(I.getType()->isIntegerTy(1));
           // auto &N =
-          cg.createNodeCovariant(&I, nullptr, -1);
+          cg.getNode(&I, nullptr, -1, retypd::Covariant);
 
           return;
         }
@@ -3680,7 +4419,9 @@ void ConstraintsGenerator::RetypdGeneratorVisitor::visitCallBase(CallBase &I) {
   if (handleIntrinsicCall(I)) {
     return;
   } else if (cg.SCCs.count(Target)) { // Call within the SCC:
-    // directly link to the function tv.
+    // directly link to the function tv. When functions are generated
+    // separately, the callee nodes are unified in mergeFrom.
+    cg.createFuncNodes(*Target);
     for (int i = 0; i < I.arg_size(); i++) {
       auto &ArgVar = cg.getNode(Target->getArg(i), &I, i, retypd::Covariant);
       auto &ValVar =
@@ -3705,7 +4446,7 @@ void ConstraintsGenerator::RetypdGeneratorVisitor::visitCallBase(CallBase &I) {
     FuncVar.pushContextId(ContextId);
     auto [FuncNode, FNC] =
         cg.CG.createNodePair(FuncVar, Target->getFunctionType());
-    cg.CallToInstance.emplace(&I, std::make_pair(&FuncNode, &FNC));
+    cg.CallToInstance.insert({&I, std::make_pair(&FuncNode, &FNC)});
 
     for (int i = 0; i < I.arg_size(); i++) {
       auto ArgVar = getCallArgTV(FuncVar, i);
@@ -3733,7 +4474,7 @@ void ConstraintsGenerator::RetypdGeneratorVisitor::visitCallBase(CallBase &I) {
 
 void ConstraintsGenerator::RetypdGeneratorVisitor::visitSelectInst(
     SelectInst &I) {
-  auto &DstVar = cg.createNodeCovariant(&I, nullptr, -1);
+  auto &DstVar = cg.getNode(&I, nullptr, -1, retypd::Covariant);
   auto *Src1 = I.getTrueValue();
   auto *Src2 = I.getFalseValue();
   auto &Src1Var = cg.getOrInsertNode(Src1, &I, 0);
@@ -3745,7 +4486,7 @@ void ConstraintsGenerator::RetypdGeneratorVisitor::visitSelectInst(
 
 void ConstraintsGenerator::RetypdGeneratorVisitor::visitAllocaInst(
     AllocaInst &I) {
-  auto &Node = cg.createNodeCovariant(&I, nullptr, -1);
+  auto &Node = cg.getNode(&I, nullptr, -1, retypd::Covariant);
   // set as pointer type
   cg.setPointer(Node);
   // if has size hint, then we add forget size edge.
@@ -3759,7 +4500,7 @@ void ConstraintsGenerator::RetypdGeneratorVisitor::visitAllocaInst(
 
 void ConstraintsGenerator::RetypdGeneratorVisitor::visitPHINode(PHINode &I) {
   // auto &Node =
-  cg.createNodeCovariant(&I, nullptr, -1);
+  cg.getNode(&I, nullptr, -1, retypd::Covariant);
   // Defer constraints generation (and unification) to handlePHINodes
   phiNodes.push_back(&I);
 }
@@ -3873,7 +4614,7 @@ void ConstraintsGenerator::RetypdGeneratorVisitor::visitICmpInst(ICmpInst &I) {
 
   // type the inst as bool?
   assert(I.getType()->isIntegerTy(1));
-  cg.createNode(&I, nullptr, -1);
+  cg.getNode(&I, nullptr, -1, retypd::Covariant);
 }
 
 // #region LoadStore
@@ -3881,25 +4622,22 @@ void ConstraintsGenerator::RetypdGeneratorVisitor::visitICmpInst(ICmpInst &I) {
 // =========== begin: load/store insts and deref analysis ===========
 
 unsigned ConstraintsGenerator::getPointerElemSize(Type *ty) {
+  auto It = ElemSizeCache.find(ty);
+  if (It != ElemSizeCache.end()) {
+    return It->second;
+  }
   Type *Elem = ty->getPointerElementType();
-  return llvm2c::getLLVMTypeSize(Elem, Ctx.pointer_size);
+  auto Size = llvm2c::getLLVMTypeSize(Elem, Ctx.pointer_size);
+  ElemSizeCache.try_emplace(ty, Size);
+  return Size;
 }
 
 void ConstraintsGenerator::RetypdGeneratorVisitor::visitStoreInst(
     StoreInst &I) {
   // if this is access to table, then we ignore the type, and return func ptr.
   auto Node = cg.getNodeOrNull(I.getPointerOperand(), &I, 0, retypd::Covariant);
-  if (!Node) {
-    if (auto CE = dyn_cast<ConstantExpr>(I.getPointerOperand())) {
-      if (CE->getOpcode() == Instruction::BitCast) {
-        if (auto CE2 = dyn_cast<ConstantExpr>(CE->getOperand(0))) {
-          CE = CE2;
-        }
-      }
-      if (CE->getOpcode() == Instruction::GetElementPtr) {
-        return;
-      }
-    }
+  if (!Node && isTableAccess(I.getPointerOperand())) {
+    return;
   }
   if (!Node) {
     Node = &cg.getOrInsertNode(I.getPointerOperand(), &I, 0, retypd::Covariant);
@@ -3928,23 +4666,14 @@ void ConstraintsGenerator::RetypdGeneratorVisitor::visitStoreInst(
 
 void ConstraintsGenerator::RetypdGeneratorVisitor::visitLoadInst(LoadInst &I) {
   // if this is access to table, then we ignore the type, and return func ptr.
-  auto Node = cg.getNodeOrNull(I.getPointerOperand(), &I, 0, retypd::Covariant);
-  if (!Node) {
-    if (auto CE = dyn_cast<ConstantExpr>(I.getPointerOperand())) {
-      if (CE->getOpcode() == Instruction::BitCast) {
-        if (auto CE2 = dyn_cast<ConstantExpr>(CE->getOperand(0))) {
-          CE = CE2;
-        }
-      }
-      if (CE->getOpcode() == Instruction::GetElementPtr) {
-        return;
-      }
-    }
+  // The constant pointer operand is keyed by this load, so it has no node yet.
+  if (isTableAccess(I.getPointerOperand())) {
+    return;
   }
 
   auto &PtrVal = cg.getOrInsertNode(I.getPointerOperand(), &I, 0);
   auto BitSize = cg.getPointerElemSize(I.getPointerOperandType());
-  auto &LoadNode = cg.createNodeCovariant(&I, nullptr, -1);
+  auto &LoadNode = cg.getNode(&I, nullptr, -1, retypd::Covariant);
 
   if (TraceIds.count(LoadNode.getId())) {
     llvm::errs() << "TraceID=" << LoadNode.getId()
@@ -4139,7 +4868,7 @@ bool strEq(const char *S1, const char *S2) { return strcmp(S1, S2) == 0; }
 bool ConstraintsGenerator::PcodeOpType::addRetConstraint(
     Instruction *I, ConstraintsGenerator &cg) const {
   // only create Covariant constraints, use addSubtype to handle contra-variant.
-  auto &N = cg.createNodeCovariant(I, nullptr, -1);
+  auto &N = cg.getNode(I, nullptr, -1, retypd::Covariant);
   if (I->getType()->isVoidTy()) {
     return false;
   }
@@ -4215,7 +4944,7 @@ class CGAnnotationWriter : public llvm::AssemblyAnnotationWriter {
       return nullptr;
     }
     std::shared_ptr<ConstraintsGenerator> CG = nullptr;
-    auto Ind = AG.Func2SCCIndex.at(CGN);
+    auto Ind = AG.Func2SCCIndex.lookup(CGN);
     if (Level == 0) {
       CG = AG.AllSCCs.at(Ind).BottomUpGenerator;
     } else if (Level == 1) {
@@ -4306,15 +5035,11 @@ void TypeRecovery::print(llvm::Module &M, std::string path) {
 
 void TypeRecovery::printAnnotatedModule(const llvm::Module &M, std::string path,
                                         int level) {
-  std::error_code EC;
-  llvm::raw_fd_ostream os(path, EC);
-  if (EC) {
-    std::cerr << "Cannot open output file: " << path << std::endl;
-    std::cerr << EC.message() << std::endl;
-    std::abort();
-  }
   CGAnnotationWriter AW(AG, level);
-  M.print(os, &AW);
+  auto &Dump = DebugDump::get();
+  Dump.render(std::move(path), [&](llvm::raw_ostream &os) {
+    Dump.printModule(M, os, &AW);
+  });
 }
 
 std::shared_ptr<ConstraintsGenerator> ConstraintsGenerator::fromConstraints(
@@ -4345,8 +5070,9 @@ std::shared_ptr<ConstraintsGenerator> ConstraintsGenerator::fromConstraints(
 std::shared_ptr<ConstraintsGenerator> ConstraintsGenerator::fromDotSummary(
     TypeRecovery &Ctx, std::set<llvm::Function *> SCCs, retypd::DotGraph &G) {
   auto Ret = std::make_shared<ConstraintsGenerator>(Ctx, G.name, SCCs);
-  // Ret->CG.fromDotSummary(G);
-  assert(false && "TODO!");
+  if (!Ret->CG.fromDotSummary(G)) {
+    std::abort();
+  }
   Ret->fixSCCFuncMappings();
   if (Ret->V2N.size() == 0 && Ret->V2NContra.size() == 0) {
     return nullptr;
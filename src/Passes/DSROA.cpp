@@ -1,4 +1,6 @@
 
+#include <cstdlib>
+#include <cstring>
 #include <set>
 
 #include <llvm/ADT/APInt.h>
@@ -19,6 +21,7 @@
 #include <llvm/Transforms/Utils/PromoteMemToReg.h>
 
 #include "Passes/DSROA.h"
+#include "Passes/StackAlloca.h"
 
 #define DEBUG_TYPE "dsroa"
 
@@ -560,6 +563,12 @@ class AllocaSlices::SliceBuilder : public PtrUseVisitor<SliceBuilder> {
 
   const uint64_t AllocSize;
   AllocaSlices &AS;
+  AllocaInst &Alloca;
+  /// The stack from LinearAllocationRecovery, which has the stack direction
+  /// metadata. Only its integer addresses are followed.
+  const bool IsStack;
+  /// Its integer address is the end of the alloca, see isGrowNegative.
+  const bool GrowNegative;
 
   SmallDenseMap<Instruction *, unsigned> MemTransferSliceMap;
   SmallDenseMap<Instruction *, uint64_t> PHIOrSelectSizes;
@@ -571,7 +580,9 @@ public:
   SliceBuilder(const DataLayout &DL, AllocaInst &AI, AllocaSlices &AS)
       : PtrUseVisitor<SliceBuilder>(DL),
         AllocSize(DL.getTypeAllocSize(AI.getAllocatedType()).getFixedSize()),
-        AS(AS) {}
+        AS(AS), Alloca(AI),
+        IsStack(AI.getMetadata(KIND_STACK_DIRECTION) != nullptr),
+        GrowNegative(isGrowNegative(&AI)) {}
 
 private:
   void markAsDead(Instruction &I) {
@@ -677,6 +688,58 @@ private:
     return Base::visitGetElementPtrInst(GEPI);
   }
 
+  // The recovered stack is addressed with integer arithmetic:
+  // inttoptr (add (ptrtoint %stack), C). Follow it like a GEP. The address of
+  // any other alloca escapes through ptrtoint, as in LLVM SROA.
+  void visitPtrToIntInst(PtrToIntInst &I) {
+    if (!IsStack)
+      return Base::visitPtrToIntInst(I);
+    if (I.use_empty())
+      return markAsDead(I);
+
+    if (GrowNegative) {
+      if (*U != &Alloca)
+        return PI.setAborted(&I);
+      Offset += APInt(Offset.getBitWidth(), AllocSize);
+    }
+    enqueueUsers(I);
+  }
+
+  void visitBinaryOperator(BinaryOperator &I) {
+    if (!IsStack)
+      return PI.setAborted(&I);
+    if (I.use_empty())
+      return markAsDead(I);
+
+    bool IsLHS = I.getOperand(0) == *U;
+    auto *C = dyn_cast<ConstantInt>(I.getOperand(IsLHS ? 1 : 0));
+    if (C == nullptr) {
+      return PI.setAborted(&I);
+    }
+    APInt Delta = C->getValue().sextOrTrunc(Offset.getBitWidth());
+    if (I.getOpcode() == Instruction::Add) {
+      Offset += Delta;
+    } else if (I.getOpcode() == Instruction::Sub && IsLHS) {
+      Offset -= Delta;
+    } else {
+      return PI.setAborted(&I);
+    }
+    enqueueUsers(I);
+  }
+
+  void visitIntToPtrInst(IntToPtrInst &I) {
+    if (!IsStack)
+      return PI.setAborted(&I);
+    if (I.use_empty())
+      return markAsDead(I);
+
+    // An integer address may legally point outside of the alloca (e.g. the
+    // caller's frame), so do not drop such accesses as dead.
+    if (IsOffsetKnown && Offset.uge(AllocSize))
+      return PI.setAborted(&I);
+    enqueueUsers(I);
+  }
+
   void handleLoadOrStore(Type *Ty, Instruction &I, const APInt &Offset,
                          uint64_t Size, bool IsVolatile) {
     // We allow splitting of non-volatile loads and stores where the type is an
@@ -923,6 +986,10 @@ private:
     if (I.use_empty())
       return markAsDead(I);
 
+    // PHI/select of integer addresses
+    if (!I.getType()->isPointerTy())
+      return PI.setAborted(&I);
+
     // If this is a PHI node before a catchswitch, we cannot insert any non-PHI
     // instructions in this BB, which may be required during rewriting. Bail out
     // on these cases.
@@ -3120,6 +3187,13 @@ private:
 
 }; // namespace dsroa
 
+bool isDSROAEnabled() {
+  if (auto E = std::getenv("NOTDEC_DSROA")) {
+    return std::strcmp(E, "1") == 0;
+  }
+  return false;
+}
+
 using dsroa::AllocaSliceRewriter;
 using dsroa::AllocaSlices;
 using dsroa::Partition;
@@ -4405,7 +4479,10 @@ AllocaInst *DSROAPass::rewritePartition(AllocaInst &AI, AllocaSlices &AS,
   // P.beginOffset() can be non-zero even with the same type in a case with
   // out-of-bounds access (e.g. @PR35657 function in SROA/basictest.ll).
   AllocaInst *NewAI;
-  if (SliceTy == AI.getAllocatedType() && P.beginOffset() == 0) {
+  // The recovered stack is never reused, because its offsets are relative to
+  // its end.
+  if (SliceTy == AI.getAllocatedType() && P.beginOffset() == 0 &&
+      !isGrowNegative(&AI)) {
     NewAI = &AI;
     // FIXME: We should be able to bail at this point with "nothing changed".
     // FIXME: We might want to defer PHI speculation until after here.
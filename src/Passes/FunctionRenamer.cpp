@@ -4,6 +4,9 @@
 #include <llvm/IR/Module.h>
 #include <llvm/IR/PassManager.h>
 #include <llvm/Support/raw_ostream.h>
+#include <vector>
+
+#include "Passes/CallGraphSCC.h"
 using namespace llvm;
 
 namespace notdec::frontend::passes {
@@ -12,6 +15,7 @@ namespace notdec::frontend::passes {
 class FunctionRenamer : public PassInfoMixin<FunctionRenamer> {
 public:
   PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM) {
+    std::vector<Function *> Renamed;
     for (Function &F : M.functions()) {
       unsigned int instCount = F.size();
       unsigned short callInstCount = 0;
@@ -26,16 +30,21 @@ public:
           }
         }
 
-        if (callInstCount == 1) {
+        if (callInstCount == 1 && callee != nullptr) {
           if (callee->getName().str().find("func_") == 0) {
             std::string funcName = F.getName().str();
             F.setName("jmp_" + funcName);
             callee->setName(funcName);
+            Renamed.push_back(&F);
+            Renamed.push_back(callee);
           }
         }
       }
     }
 
+    if (auto *Cached = MAM.getCachedResult<notdec::CallGraphSCCAnalysis>(M)) {
+      (*Cached)->updateFunctions(Renamed);
+    }
     return PreservedAnalyses::all();
   }
 };
@@ -1,3 +1,5 @@
+#include <numeric>
+
 #include "Passes/ConstraintGenerator.h"
 #include "TypeRecovery/NFAMinimize.h"
 #include "TypeRecovery/retypd/Schema.h"
@@ -15,7 +17,7 @@ using retypd::OffsetLabel;
 bool ConstraintsGenerator::hasNoOnes() {
   for (auto &N : CG) {
     for (auto &E : N.outEdges) {
-      if (E.Label.isOne()) {
+      if (E.getLabel().isOne()) {
         llvm::errs() << "organizeTypes: Node " << N.key.str()
                      << " has one edge, should not exist\n";
         std::abort();
@@ -33,17 +35,17 @@ std::map<CGNode *, TypeInfo> ConstraintsGenerator::organizeTypes() {
   // determinize)
   for (auto &N : CG) {
     for (auto &E : N.outEdges) {
-      if (E.Label.isOne()) {
+      if (E.getLabel().isOne()) {
         llvm::errs() << "organizeTypes: Node " << N.key.str()
                      << " has one edge, should not exist\n";
         std::abort();
       }
-      if (E.Label.isForgetLabel()) {
+      if (E.getLabel().isForgetLabel()) {
         llvm::errs() << "organizeTypes: Node " << N.key.str()
                      << " has forget label, should not exist\n";
         std::abort();
       }
-      if (retypd::isStore(E.Label)) {
+      if (retypd::isStore(E.getLabel())) {
         llvm::errs() << "organizeTypes: Node " << N.key.str()
                      << " has store label, should not exist\n";
         std::abort();
@@ -69,7 +71,7 @@ std::map<CGNode *, TypeInfo> ConstraintsGenerator::organizeTypes() {
     CG.addEdge(Source, *NewNode, E1);
     CG.addEdge(*NewNode, Target, E2);
     // remove old edge.
-    CG.removeEdge(Source, Target, E.Label);
+    CG.removeEdge(Source, Target, E.getLabel());
     return *NewNode;
   };
 
@@ -95,7 +97,7 @@ std::map<CGNode *, TypeInfo> ConstraintsGenerator::organizeTypes() {
     std::set<const CGEdge *> SelfEdges;
     for (auto &E : N.outEdges) {
       if (&E.getTargetNode() == &N) {
-        if (auto *OL = retypd::getOffsetLabel(E.Label)) {
+        if (auto *OL = retypd::getOffsetLabel(E.getLabel())) {
           SelfEdges.insert(&E);
         }
       }
@@ -115,7 +117,7 @@ std::map<CGNode *, TypeInfo> ConstraintsGenerator::organizeTypes() {
       // Check for load or store edge
       std::optional<const retypd::CGEdge *> LoadEdge;
       for (auto &Edge : N.outEdges) {
-        if (retypd::isLoadOrStore(Edge.Label)) {
+        if (retypd::isLoadOrStore(Edge.getLabel())) {
           assert(!LoadEdge.has_value());
           LoadEdge = &Edge;
         }
@@ -125,7 +127,7 @@ std::map<CGNode *, TypeInfo> ConstraintsGenerator::organizeTypes() {
         // has no edge, a void pointer?
         LoadEdge = nullptr;
       } else {
-        LoadSize = retypd::getLoadOrStoreSize((*LoadEdge)->Label);
+        LoadSize = retypd::getLoadOrStoreSize((*LoadEdge)->getLabel());
       }
       assert(LoadSize % 8 == 0);
       TypeInfos[&N] = TypeInfo{.Size = LoadSize / 8,
@@ -137,16 +139,16 @@ std::map<CGNode *, TypeInfo> ConstraintsGenerator::organizeTypes() {
     unsigned edgeCount = 0;
     const CGEdge *OffsetEdge = nullptr;
     for (auto &Edge : N.outEdges) {
-      if (retypd::getOffsetLabel(Edge.Label)) {
+      if (retypd::getOffsetLabel(Edge.getLabel())) {
         edgeCount++;
         OffsetEdge = &Edge;
-      } else if (retypd::isLoadOrStore(Edge.Label)) {
+      } else if (retypd::isLoadOrStore(Edge.getLabel())) {
         edgeCount++;
       }
     }
     if (!mustBeStruct && edgeCount == 1 && OffsetEdge != nullptr) {
       auto &Target = const_cast<CGNode &>(OffsetEdge->getTargetNode());
-      if (auto *OL = retypd::getOffsetLabel(OffsetEdge->Label)) {
+      if (auto *OL = retypd::getOffsetLabel(OffsetEdge->getLabel())) {
         if (OL->range.offset == 0 && OL->range.access.size() == 1) {
           // this is an array, but we first assume element count = 1
           auto AccessSize = OL->range.access.begin()->Size;
@@ -164,27 +166,27 @@ std::map<CGNode *, TypeInfo> ConstraintsGenerator::organizeTypes() {
 
     std::vector<CGEdge> OE1;
     for (auto &Edge : N.outEdges) {
-      if (retypd::isLoadOrStore(Edge.Label)) {
+      if (retypd::isLoadOrStore(Edge.getLabel())) {
         OE1.emplace_back(Edge);
       }
     }
     // normalize load edge as zero offset
     for (auto &E : OE1) {
-      splitEdge(E, {retypd::RecallLabel{OffsetLabel{OffsetRange()}}}, E.Label,
+      splitEdge(E, {retypd::RecallLabel{OffsetLabel{OffsetRange()}}}, E.getLabel(),
                 ValueNamer::getName("F0_"));
     }
 
     // 处理所有数组类型的成员
     // 提取所有乘数项
+    // 从节点的offset索引按偏移顺序取出所有offset边。
     std::set<int64_t> AllStrides;
-    std::set<const CGEdge *> RemainingOffsetEdges;
-    for (auto &E : N.outEdges) {
-      if (auto *OL = retypd::getOffsetLabel(E.Label)) {
-        RemainingOffsetEdges.insert(&E);
-        for (auto &A : OL->range.access) {
-          if (A.Size > 0) {
-            AllStrides.insert(A.Size);
-          }
+    std::vector<const CGEdge *> RemainingOffsetEdges;
+    for (auto &Ent : N.OffsetEdges) {
+      auto *OL = retypd::getOffsetLabel(Ent.second->getLabel());
+      RemainingOffsetEdges.push_back(Ent.second);
+      for (auto &A : OL->range.access) {
+        if (A.Size > 0) {
+          AllStrides.insert(A.Size);
         }
       }
     }
@@ -194,58 +196,44 @@ std::map<CGNode *, TypeInfo> ConstraintsGenerator::organizeTypes() {
       assert(MaxStride > 0);
       AllStrides.erase(MaxStride);
 
-      // 提取包含max_stride的模式
+      // 提取包含max_stride的模式，两部分都保持按基址从小到大的顺序。
       std::vector<const CGEdge *> HasStrideOffsetEdges;
+      std::vector<const CGEdge *> OtherOffsetEdges;
       for (auto *Edge : RemainingOffsetEdges) {
-        auto *OL = retypd::getOffsetLabel(Edge->Label);
+        auto *OL = retypd::getOffsetLabel(Edge->getLabel());
         assert(OL != nullptr);
         if (std::find(OL->range.access.begin(), OL->range.access.end(),
                       MaxStride) != OL->range.access.end()) {
           HasStrideOffsetEdges.push_back(Edge);
+        } else {
+          OtherOffsetEdges.push_back(Edge);
         }
       }
-      for (auto *Edge : HasStrideOffsetEdges) {
-        RemainingOffsetEdges.erase(Edge);
+      RemainingOffsetEdges = std::move(OtherOffsetEdges);
+      if (HasStrideOffsetEdges.empty()) {
+        continue;
       }
 
-      // 按基址从小到大排序
-      std::sort(HasStrideOffsetEdges.begin(), HasStrideOffsetEdges.end(),
-                [](const CGEdge *E1, const CGEdge *E2) {
-                  auto *OL1 = retypd::getOffsetLabel(E1->Label);
-                  auto *OL2 = retypd::getOffsetLabel(E2->Label);
-                  return OL1->range.offset < OL2->range.offset;
-                });
-
-      while (!HasStrideOffsetEdges.empty()) {
+      // 已排序，每组是从Pos开始的连续区间，不必从头部erase。
+      size_t Pos = 0;
+      while (Pos < HasStrideOffsetEdges.size()) {
         auto FrontLabel =
-            retypd::getOffsetLabel(HasStrideOffsetEdges.front()->getLabel());
+            retypd::getOffsetLabel(HasStrideOffsetEdges[Pos]->getLabel());
         auto RangeStart = FrontLabel->range.offset;
         auto RangeEnd = FrontLabel->range.offset + MaxStride;
 
         // 提取当前组中Base在当前范围内的模式
-        auto InitialSize = HasStrideOffsetEdges.size();
         std::vector<const CGEdge *> InRangeEdges;
-        std::optional<size_t> RemoveStart = std::nullopt;
-        std::optional<size_t> RemoveEnd = HasStrideOffsetEdges.size();
-        for (size_t I = 0; I < HasStrideOffsetEdges.size(); I++) {
-          auto *Edge = HasStrideOffsetEdges.at(I);
+        for (; Pos < HasStrideOffsetEdges.size(); Pos++) {
+          auto *Edge = HasStrideOffsetEdges[Pos];
           auto CurrentLabel = retypd::getOffsetLabel(Edge->getLabel());
-          if (CurrentLabel->range.offset >= RangeStart &&
-              CurrentLabel->range.offset < RangeEnd) {
-            InRangeEdges.push_back(Edge);
-            if (!RemoveStart) {
-              RemoveStart = I;
-            }
-          } else {
-            RemoveEnd = I;
+          assert(CurrentLabel->range.offset >= RangeStart);
+          if (CurrentLabel->range.offset >= RangeEnd) {
             break;
           }
+          InRangeEdges.push_back(Edge);
         }
-        assert(RemoveStart);
-        HasStrideOffsetEdges.erase(HasStrideOffsetEdges.begin() + *RemoveStart,
-                                   HasStrideOffsetEdges.begin() + *RemoveEnd);
-        assert(InitialSize ==
-               (HasStrideOffsetEdges.size() + InRangeEdges.size()));
+        assert(!InRangeEdges.empty());
 
         // 处理子问题仅有一条offset=0的边的简单情况:
         if (InRangeEdges.size() == 1) {
@@ -327,7 +315,7 @@ std::map<CGNode *, TypeInfo> ConstraintsGenerator::organizeTypes() {
     for (auto *EP : RemainingOffsetEdges) {
       auto &E = *EP;
       auto &Target = const_cast<CGNode &>(E.getTargetNode());
-      auto *OL = retypd::getOffsetLabel(E.Label);
+      auto *OL = retypd::getOffsetLabel(E.getLabel());
       assert(OL && "Other kinds of Edge should already be eliminated!");
       assert(OL->range.access.size() == 0 &&
              "should be handled by previous array pass");
@@ -340,202 +328,157 @@ std::map<CGNode *, TypeInfo> ConstraintsGenerator::organizeTypes() {
       }
     }
 
-    auto IsOverlap = [](OffsetTy S1, OffsetTy E1, OffsetTy S2, OffsetTy E2) {
-      assert(S1 < E1);
-      assert(S2 < E2);
-      if (std::max(S1, S2) < std::min(E1, E2)) {
-        return true;
+    // Group the fields into clusters of transitively overlapping ranges, with
+    // one sweep over the fields sorted by start offset. Every cluster with
+    // more than one field becomes a union, in ascending offset order.
+    std::vector<size_t> ByStart(Fields.size());
+    std::iota(ByStart.begin(), ByStart.end(), 0);
+    std::stable_sort(ByStart.begin(), ByStart.end(), [&](size_t A, size_t B) {
+      return Fields[A].R.Start < Fields[B].R.Start;
+    });
+    std::vector<std::vector<size_t>> Clusters;
+    OffsetTy ClusterEnd = 0;
+    for (auto Ind : ByStart) {
+      auto &F = Fields[Ind];
+      assert(F.R.Size > 0);
+      if (Clusters.empty() || F.R.Start >= ClusterEnd) {
+        Clusters.emplace_back();
+        ClusterEnd = F.R.end();
+      } else {
+        ClusterEnd = std::max(ClusterEnd, F.R.end());
       }
-      return false;
-    };
-
-    // Fields should not be mutated during the lifetime of ret vector
-    auto FilterInRange = [&](const std::vector<FieldEntry> &Fields,
-                             OffsetTy Start,
-                             OffsetTy End) -> std::vector<size_t> {
-      std::vector<size_t> Ret;
-      for (size_t I = 0; I < Fields.size(); I++) {
-        auto &F = Fields.at(I);
-        auto FS = F.R.Start;
-        auto FE = F.R.Size + FS;
-        // overlaps
-        if (IsOverlap(Start, End, FS, FE)) {
-          Ret.push_back(I);
-        }
+      Clusters.back().push_back(Ind);
+    }
+
+    std::vector<FieldEntry> NewFields;
+    for (auto &Cluster : Clusters) {
+      if (Cluster.size() == 1) {
+        NewFields.push_back(Fields[Cluster.front()]);
+        continue;
       }
-      return Ret;
-    };
-
-    while (true) {
-      // 收集所有分割点
-      std::set<OffsetTy> AllIndex;
-      for (auto &F : Fields) {
-        AllIndex.insert(F.R.Start);
-        AllIndex.insert(F.R.end());
+      // 保持Fields中的原始顺序，它决定了union的panel划分。
+      std::sort(Cluster.begin(), Cluster.end());
+      OffsetTy UnionStart = Fields[Cluster.front()].R.Start;
+      OffsetTy UnionEnd = Fields[Cluster.front()].R.end();
+      for (auto Ind : Cluster) {
+        UnionStart = std::min(UnionStart, Fields[Ind].R.Start);
+        UnionEnd = std::max(UnionEnd, Fields[Ind].R.end());
       }
+      std::vector<FieldEntry> OverlapFields;
+      for (auto Ind : Cluster) {
+        auto &F = Fields[Ind];
+        OverlapFields.push_back(
+            FieldEntry{.R = {.Start = F.R.Start - UnionStart, .Size = F.R.Size},
+                       .Edge = F.Edge});
+      }
+      // #region build members using OverlapFields;
 
-      // 遍历所有最小范围区间，如果出现重叠则以此开始创建union类型。
-      bool NoUpdate = true;
-      for (auto It = AllIndex.begin(); It != AllIndex.end(); ++It) {
-        auto NextIt = std::next(It);
-        if (NextIt == AllIndex.end()) {
-          break;
-        }
-        auto Start = *It;
-        auto End = *NextIt;
-        auto InRangeFieldIndex = FilterInRange(Fields, Start, End);
-        if (InRangeFieldIndex.size() <= 1) {
-          continue;
-        }
-        NoUpdate = false;
-
-        // create a union here.
-        auto OldSize = 1;
-        auto NewSize = InRangeFieldIndex.size();
-        while (
-            NewSize >
-            OldSize) { // 根据小的重叠区域，左右拓展找到需要处理创建union的所有Fields。
-          OldSize = NewSize;
-          for (auto Ind : InRangeFieldIndex) {
-            auto &F = Fields.at(Ind);
-            Start = std::min(Start, F.R.Start);
-            End = std::max(End, F.R.end());
-          }
-          InRangeFieldIndex = FilterInRange(Fields, Start, End);
-          NewSize = InRangeFieldIndex.size();
-          assert(NewSize >= 2);
-        }
-
-        auto UnionStart = Start;
-        auto UnionEnd = End;
-        std::vector<FieldEntry> OtherFields;
-        std::vector<FieldEntry> OverlapFields;
-        for (auto &F : Fields) {
-          if (IsOverlap(Start, End, F.R.Start, F.R.end())) {
-            OverlapFields.push_back(FieldEntry{
-                .R = {.Start = F.R.Start - UnionStart, .Size = F.R.Size},
-                .Edge = F.Edge});
-          } else {
-            OtherFields.push_back(F);
-          }
-        }
-        // #region build members using OverlapFields;
-
-        // sort the entry by end offset.
-        std::sort(OverlapFields.begin(), OverlapFields.end(),
-                  [](const FieldEntry &A, const FieldEntry &B) {
-                    return A.R.end() < B.R.end();
-                  });
-        // use std::min to find the min start offset.
-        auto MinStartOff =
-            std::min_element(OverlapFields.begin(), OverlapFields.end(),
-                             [](const FieldEntry &A, const FieldEntry &B) {
-                               return A.R.Start < B.R.Start;
-                             })
-                ->R.Start;
-        auto MaxOff = OverlapFields.back().R.end();
-        // unified start to 0
-        assert(MinStartOff == 0);
-        assert(MaxOff == (UnionEnd - UnionStart));
-        // after determinize, there will not be nested struct. We assume Offset
-        // to struct == Min Start Offset. So set size as MaxOff - MinStartOff.
-        auto OurSize = MaxOff - MinStartOff;
-
-        std::vector<std::vector<FieldEntry>> UnionPanels;
-        for (auto &F : OverlapFields) {
-          bool inserted = false;
-          for (auto &Panel : UnionPanels) {
-            if (Panel.back().R.Start + Panel.back().R.Size <= F.R.Start) {
-              Panel.push_back(F);
-              inserted = true;
-              break;
-            }
-          }
-          if (!inserted) {
-            UnionPanels.push_back({F});
+      // sort the entry by end offset.
+      std::sort(OverlapFields.begin(), OverlapFields.end(),
+                [](const FieldEntry &A, const FieldEntry &B) {
+                  return A.R.end() < B.R.end();
+                });
+      // use std::min to find the min start offset.
+      auto MinStartOff =
+          std::min_element(OverlapFields.begin(), OverlapFields.end(),
+                           [](const FieldEntry &A, const FieldEntry &B) {
+                             return A.R.Start < B.R.Start;
+                           })
+              ->R.Start;
+      auto MaxOff = OverlapFields.back().R.end();
+      // unified start to 0
+      assert(MinStartOff == 0);
+      assert(MaxOff == (UnionEnd - UnionStart));
+      // after determinize, there will not be nested struct. We assume Offset
+      // to struct == Min Start Offset. So set size as MaxOff - MinStartOff.
+      auto OurSize = MaxOff - MinStartOff;
+
+      std::vector<std::vector<FieldEntry>> UnionPanels;
+      for (auto &F : OverlapFields) {
+        bool inserted = false;
+        for (auto &Panel : UnionPanels) {
+          if (Panel.back().R.Start + Panel.back().R.Size <= F.R.Start) {
+            Panel.push_back(F);
+            inserted = true;
+            break;
           }
         }
-        assert(UnionPanels.size() > 1);
-        // if there is only one field and off=0, make N a union node.
-        CGNode *UN = nullptr;
-        const CGEdge *UE = nullptr;
-        if (!mustBeStruct && OtherFields.size() == 0 && UnionStart == 0) {
-          UN = &N;
-        } else {
-          std::string Name = ValueNamer::getName("Un_");
-          UN = &CG.createNodeClonePNI(
-              retypd::NodeKey{TypeVariable::CreateDtv(*CG.Ctx, Name)},
-              N.getPNIVar());
-          // move all related edge under UN
-          for (auto &Panel : UnionPanels) {
-            for (auto &F : Panel) {
-              // subtract by UnionStart
-              auto Off = *retypd::getOffsetLabel(F.Edge->Label);
-              Off.range.offset -= UnionStart;
-              auto *NE =
-                  CG.addEdge(*UN, getTarget(F), {retypd::RecallLabel{Off}});
-              CG.removeEdge(N, getTarget(F), F.Edge->Label);
-              F.Edge = NE;
-            }
-          }
-          UE = CG.addEdge(N, *UN,
-                          {retypd::RecallLabel{
-                              OffsetLabel{OffsetRange{.offset = UnionStart}}}});
+        if (!inserted) {
+          UnionPanels.push_back({F});
         }
-        // create new node for each panel struct.
-        std::vector<const retypd::CGEdge *> Members;
+      }
+      assert(UnionPanels.size() > 1);
+      // if there is only one field and off=0, make N a union node.
+      CGNode *UN = nullptr;
+      const CGEdge *UE = nullptr;
+      if (!mustBeStruct && Cluster.size() == Fields.size() &&
+          UnionStart == 0) {
+        UN = &N;
+      } else {
+        std::string Name = ValueNamer::getName("Un_");
+        UN = &CG.createNodeClonePNI(
+            retypd::NodeKey{TypeVariable::CreateDtv(*CG.Ctx, Name)},
+            N.getPNIVar());
+        // move all related edge under UN
         for (auto &Panel : UnionPanels) {
-          if (Panel.size() == 1) {
-            // we do not need to create a struct
-            Members.push_back(Panel.front().Edge);
-            continue;
-          }
-          // create a struct here
-          std::string Name = ValueNamer::getName("Us_");
-          auto NN = &CG.createNodeClonePNI(
-              retypd::NodeKey{TypeVariable::CreateDtv(*CG.Ctx, Name)},
-              UN->getPNIVar());
-          // move edges under the struct
           for (auto &F : Panel) {
-            auto *NE = CG.addEdge(*NN, getTarget(F), F.Edge->Label);
-            CG.removeEdge(*UN, getTarget(F), F.Edge->Label);
+            // subtract by UnionStart
+            auto Off = *retypd::getOffsetLabel(F.Edge->getLabel());
+            Off.range.offset -= UnionStart;
+            auto *NE =
+                CG.addEdge(*UN, getTarget(F), {retypd::RecallLabel{Off}});
+            CG.removeEdge(N, getTarget(F), F.Edge->getLabel());
             F.Edge = NE;
           }
-          TypeInfos[NN] =
-              TypeInfo{.Size = OurSize, .Info = StructInfo{.Fields = Panel}};
-          auto *E1 = CG.addEdge(*UN, *NN,
-                                {retypd::RecallLabel{OffsetLabel{
-                                    OffsetRange{.offset = MinStartOff}}}});
-          Members.push_back(E1);
         }
-        if (Members.empty()) {
-          llvm::errs() << "Warning: Empty union!\n";
+        UE = CG.addEdge(N, *UN,
+                        {retypd::RecallLabel{
+                            OffsetLabel{OffsetRange{.offset = UnionStart}}}});
+      }
+      // create new node for each panel struct.
+      std::vector<const retypd::CGEdge *> Members;
+      for (auto &Panel : UnionPanels) {
+        if (Panel.size() == 1) {
+          // we do not need to create a struct
+          Members.push_back(Panel.front().Edge);
+          continue;
         }
-        TypeInfos[UN] =
-            TypeInfo{.Size = OurSize, .Info = UnionInfo{.Members = Members}};
-
-        if (UN == &N) {
-          assert(OtherFields.empty());
-          // already set typeinfo for N, so we are done
-          return;
+        // create a struct here
+        std::string Name = ValueNamer::getName("Us_");
+        auto NN = &CG.createNodeClonePNI(
+            retypd::NodeKey{TypeVariable::CreateDtv(*CG.Ctx, Name)},
+            UN->getPNIVar());
+        // move edges under the struct
+        for (auto &F : Panel) {
+          auto *NE = CG.addEdge(*NN, getTarget(F), F.Edge->getLabel());
+          CG.removeEdge(*UN, getTarget(F), F.Edge->getLabel());
+          F.Edge = NE;
         }
-        // push the merged union back to fields, and iterate again
-        OtherFields.push_back(
-            {FieldEntry{.R = SimpleRange{.Start = UnionStart + MinStartOff,
-                                         .Size = OurSize},
-                        .Edge = UE}});
-        assert(NoUpdate == false);
-        // #endregion build members using OverlapFields;
-
-        // reiterate with merged fields.
-        Fields = OtherFields;
-        break;
+        TypeInfos[NN] =
+            TypeInfo{.Size = OurSize, .Info = StructInfo{.Fields = Panel}};
+        auto *E1 = CG.addEdge(*UN, *NN,
+                              {retypd::RecallLabel{OffsetLabel{
+                                  OffsetRange{.offset = MinStartOff}}}});
+        Members.push_back(E1);
       }
-      // no overlap, cannot create unions
-      if (NoUpdate) {
-        break;
+      if (Members.empty()) {
+        llvm::errs() << "Warning: Empty union!\n";
+      }
+      TypeInfos[UN] =
+          TypeInfo{.Size = OurSize, .Info = UnionInfo{.Members = Members}};
+
+      if (UN == &N) {
+        assert(Cluster.size() == Fields.size());
+        // already set typeinfo for N, so we are done
+        return;
       }
-    } // end of while true
+      NewFields.push_back(
+          {FieldEntry{.R = SimpleRange{.Start = UnionStart + MinStartOff,
+                                       .Size = OurSize},
+                      .Edge = UE}});
+      // #endregion build members using OverlapFields;
+    }
+    Fields = std::move(NewFields);
 
     // Now there is no overlap, create struct for Fields.
     // sort the entry by start offset.
@@ -580,10 +523,15 @@ void ConstraintsGenerator::mergeArrayUnions() {
 
   auto doMerge = [&](CGNode &UN, CGNode &Arr, CGNode &Other) -> bool {
     MergeCount += 1;
+    // the element node of the array. Arr may have other out edges, so take
+    // the edge recorded in its type info.
+    auto *AI = TypeInfos.at(&Arr).getAs<ArrayInfo>();
+    assert(AI != nullptr && AI->Edge != nullptr);
+    auto &AE = const_cast<CGNode &>(AI->Edge->getTargetNode());
     // 1. remove all(two) outgoing edges for UN
     std::vector<std::tuple<CGNode *, CGNode *, retypd::EdgeLabel>> ToRemove;
     for (auto &Edge : UN.outEdges) {
-      ToRemove.emplace_back(&Edge.FromNode, &Edge.TargetNode, Edge.Label);
+      ToRemove.emplace_back(&Edge.FromNode, &Edge.TargetNode, Edge.getLabel());
     }
     for (auto &Ent : ToRemove) {
       CG.removeEdge(*std::get<0>(Ent), *std::get<1>(Ent), std::get<2>(Ent));
@@ -609,55 +557,75 @@ void ConstraintsGenerator::mergeArrayUnions() {
     // TypeInfos.erase(&UN);
     // mergeNodeTo(UN, Arr);
     // 3. merge Other node with array element node.
-    auto &AE = (*Arr.outEdges.begin()).getTargetNode();
-    mergeNodeAndType(Other, const_cast<CGNode &>(AE));
+    mergeNodeAndType(Other, AE);
     return true;
   };
 
   // 如果存在union里面一个array和一个大小完全相等的成员，那么就合并这个union。
-  bool Changed = false;
-  do {
-    Changed = false;
-    for (auto &N : CG) {
-      if (TypeInfos.count(&N)) {
-        auto &Info = TypeInfos.at(&N);
-        if (auto UInfo = Info.getAs<UnionInfo>()) {
-          if (UInfo->Members.size() == 2) {
-            auto L0 = UInfo->Members.at(0);
-            auto L1 = UInfo->Members.at(1);
-            auto N0 = const_cast<CGNode *>(&L0->getTargetNode());
-            auto N1 = const_cast<CGNode *>(&L1->getTargetNode());
-            auto N0Info = TypeInfos.at(N0);
-            auto N1Info = TypeInfos.at(N1);
-            if (N0Info.isArray() && N1Info.isArray()) {
-              // TODO: "How to handle two array type?");
-              break;
-            } else if (auto AI = N0Info.getAs<ArrayInfo>()) {
-              auto ElemSize = AI->ElemSize.value();
-              auto OtherSize = N1Info.Size.value();
-              if (ElemSize == OtherSize) {
-                doMerge(N, *N0, *N1);
-                Changed = true;
-                // because we will remove node within the loop, we cannot
-                // continue the loop.
-                break;
-              }
-            } else if (auto AI = N1Info.getAs<ArrayInfo>()) {
-              auto ElemSize = AI->ElemSize.value();
-              auto OtherSize = N0Info.Size.value();
-              if (ElemSize == OtherSize) {
-                doMerge(N, *N1, *N0);
-                Changed = true;
-                // because we will remove node within the loop, we cannot
-                // continue the loop.
-                break;
-              }
-            }
-          }
-        }
+  // Nodes are visited in list order, always taking the first candidate like a
+  // full rescan would. After a merge, only the nodes touched by it are
+  // revisited, so the fixed point stays the same.
+  std::map<CGNode *, std::size_t> Order;
+  std::map<std::size_t, CGNode *> Worklist;
+  for (auto &N : CG) {
+    auto Index = Order.size();
+    Order.emplace(&N, Index);
+    Worklist.emplace(Index, &N);
+  }
+  while (!Worklist.empty()) {
+    auto &N = *Worklist.begin()->second;
+    Worklist.erase(Worklist.begin());
+    if (!TypeInfos.count(&N)) {
+      continue;
+    }
+    auto &Info = TypeInfos.at(&N);
+    auto UInfo = Info.getAs<UnionInfo>();
+    if (!UInfo || UInfo->Members.size() != 2) {
+      continue;
+    }
+    auto L0 = UInfo->Members.at(0);
+    auto L1 = UInfo->Members.at(1);
+    auto N0 = const_cast<CGNode *>(&L0->getTargetNode());
+    auto N1 = const_cast<CGNode *>(&L1->getTargetNode());
+    auto N0Info = TypeInfos.at(N0);
+    auto N1Info = TypeInfos.at(N1);
+    CGNode *Arr = nullptr;
+    CGNode *Other = nullptr;
+    if (N0Info.isArray() && N1Info.isArray()) {
+      // TODO: "How to handle two array type?");
+      // the rescanning loop stopped here, keep the same result.
+      break;
+    } else if (auto AI = N0Info.getAs<ArrayInfo>()) {
+      if (AI->ElemSize.value() == N1Info.Size.value()) {
+        Arr = N0;
+        Other = N1;
       }
+    } else if (auto AI = N1Info.getAs<ArrayInfo>()) {
+      if (AI->ElemSize.value() == N0Info.Size.value()) {
+        Arr = N1;
+        Other = N0;
+      }
+    }
+    if (Arr == nullptr) {
+      continue;
     }
-  } while (Changed);
+
+    MergeTraceTy Trace;
+    Trace.Touched.insert(&N);
+    MergeTrace = &Trace;
+    doMerge(N, *Arr, *Other);
+    MergeTrace = nullptr;
+    for (auto *R : Trace.Removed) {
+      Worklist.erase(Order.at(R));
+      Order.erase(R);
+    }
+    for (auto *T : Trace.Touched) {
+      auto It = Order.find(T);
+      if (It != Order.end()) {
+        Worklist.emplace(It->second, T);
+      }
+    }
+  }
 
   if (MergeCount > 0) {
     llvm::errs() << "SCC " << CG.Name << ": Merged "
@@ -679,6 +647,14 @@ void ConstraintsGenerator::mergeFixTypeInfo(CGNode &From, CGNode &To) {
 
   auto EdgeMap = mergeNodeTo(From, To);
 
+  if (MergeTrace != nullptr) {
+    MergeTrace->Removed.insert(&From);
+    MergeTrace->Touched.insert(&To);
+    for (auto CN : RelatedNodes) {
+      MergeTrace->Touched.insert(const_cast<CGNode *>(CN));
+    }
+  }
+
   for (auto CN : RelatedNodes) {
     auto N = const_cast<CGNode *>(CN);
     if (TypeInfos.count(N)) {
@@ -4,7 +4,9 @@
 #include "notdec-llvm2c/Utils.h"
 #include <cstdint>
 #include <functional>
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/ADT/Optional.h>
+#include <llvm/ADT/SmallVector.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/DataLayout.h>
 #include <llvm/IR/IRBuilder.h>
@@ -13,10 +15,13 @@
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Value.h>
 #include <llvm/Support/Alignment.h>
+#include <llvm/Support/Debug.h>
 #include <llvm/Support/raw_ostream.h>
 #include <string>
 #include <utility>
 
+#define DEBUG_TYPE "memop-matcher"
+
 using namespace llvm;
 
 namespace notdec {
@@ -90,7 +95,66 @@ llvm::Value *addOffset(llvm::IRBuilder<> &Builder, const llvm::DataLayout &DL,
   return Base;
 }
 
+namespace {
+
+/// Per-block cache of address decompositions, so matchOffset runs once for
+/// each pointer. The instructions walked by matchOffset are kept, because the
+/// scans below skip them. The cache is cleared after the block is modified.
+struct OffsetCache {
+  struct Entry {
+    Optional<std::pair<Value *, int64_t>> Result;
+    std::vector<Instruction *> Walked;
+  };
+  DenseMap<Value *, Entry> Cache;
+
+  const Entry &get(Value *Ptr) {
+    auto It = Cache.find(Ptr);
+    if (It != Cache.end()) {
+      return It->second;
+    }
+    std::set<Instruction *> Walked;
+    auto Result = matchOffset(Ptr, Walked);
+    auto &E = Cache[Ptr];
+    E.Result = Result;
+    E.Walked.assign(Walked.begin(), Walked.end());
+    return E;
+  }
+
+  // same as matchOffset(Ptr, Visited).
+  Optional<std::pair<Value *, int64_t>> match(Value *Ptr,
+                                              std::set<Instruction *> &Visited) {
+    auto &E = get(Ptr);
+    Visited.insert(E.Walked.begin(), E.Walked.end());
+    return E.Result;
+  }
+  Optional<std::pair<Value *, int64_t>>
+  match(Value *Ptr, SmallVectorImpl<Instruction *> &Visited) {
+    auto &E = get(Ptr);
+    Visited.append(E.Walked.begin(), E.Walked.end());
+    return E.Result;
+  }
+
+  void clear() { Cache.clear(); }
+};
+
+} // namespace
+
+// Only straight-line code is rewritten, the CFG is kept.
+static PreservedAnalyses getPreservedAnalyses(bool Changed) {
+  if (!Changed) {
+    return PreservedAnalyses::all();
+  }
+  PreservedAnalyses PA;
+  PA.preserveSet<CFGAnalyses>();
+  return PA;
+}
+
+// Each block is scanned backwards once. After a merge, the scan continues
+// before the new intrinsic. Restarting the block would give the same result:
+// the stores after it already failed to form a run, and their runs can only
+// get shorter.
 PreservedAnalyses MemsetMatcher::run(Function &F, FunctionAnalysisManager &) {
+  bool Changed = false;
   auto PointerSizeInBytes = F.getParent()->getDataLayout().getPointerSize();
   auto getTypeSize = [=](llvm::Type *Ty) {
     return llvm2c::getLLVMTypeSize(Ty, PointerSizeInBytes * 8);
@@ -108,7 +172,9 @@ PreservedAnalyses MemsetMatcher::run(Function &F, FunctionAnalysisManager &) {
     return false;
   };
 
+  OffsetCache Offsets;
   for (auto BB = F.begin(), E = F.end(); BB != E; ++BB) {
+    Offsets.clear();
     // reverse iterate over the basic block
     for (auto I = BB->rbegin(), E = BB->rend(); I != E; ++I) {
       if (auto *SI = dyn_cast<StoreInst>(&*I)) {
@@ -128,7 +194,7 @@ PreservedAnalyses MemsetMatcher::run(Function &F, FunctionAnalysisManager &) {
 
         // init with match
         Visited.insert(SI);
-        BeginOffset = matchOffset(SI->getPointerOperand(), Visited);
+        BeginOffset = Offsets.match(SI->getPointerOperand(), Visited);
         if (!BeginOffset) {
           continue;
         }
@@ -159,7 +225,7 @@ PreservedAnalyses MemsetMatcher::run(Function &F, FunctionAnalysisManager &) {
           }
 
           Optional<std::pair<Value *, int64_t>> NextBegin =
-              matchOffset(SI2->getPointerOperand(), Visited);
+              Offsets.match(SI2->getPointerOperand(), Visited);
           // failed to match: stores must be in sequence
           if (!NextBegin) {
             break;
@@ -201,37 +267,43 @@ PreservedAnalyses MemsetMatcher::run(Function &F, FunctionAnalysisManager &) {
           Builder.SetInsertPoint(SI);
           auto *Base = addOffset(Builder, F.getParent()->getDataLayout(),
                                  BeginOffset->first, BeginOffset->second);
-          llvm::errs() << "Merging " << std::to_string(Stores.size())
-                       << " stores in func " << F.getName()
-                       << " into memset at " << *Base << ": " << *SI << "\n";
+          LLVM_DEBUG(llvm::errs()
+                     << "Merging " << std::to_string(Stores.size())
+                     << " stores in func " << F.getName()
+                     << " into memset at " << *Base << ": " << *SI << "\n");
           auto *SetValByte =
               ConstantInt::get(IntegerType::get(F.getContext(), 8),
                                SetVal->getZExtValue() & 0xFF);
 
           assert(Size > 0);
-          Builder.CreateMemSet(Base, SetValByte, Size, MaybeAlign(), true);
+          auto *MS =
+              Builder.CreateMemSet(Base, SetValByte, Size, MaybeAlign(), true);
+          // continue before the memset
+          I = MS->getReverseIterator();
           // remove all visited insts
           for (auto *I1 : Stores) {
             I1->eraseFromParent();
           }
-          // revisit the basic block
-          --BB;
-          break;
+          Offsets.clear();
+          Changed = true;
         }
       }
     }
   }
 
-  return PreservedAnalyses::none();
+  return getPreservedAnalyses(Changed);
 }
 
 PreservedAnalyses MemcpyMatcher::run(Function &F, FunctionAnalysisManager &) {
+  bool Changed = false;
   auto PointerSizeInBytes = F.getParent()->getDataLayout().getPointerSize();
   auto getTypeSize = [=](llvm::Type *Ty) {
     return llvm2c::getLLVMTypeSize(Ty, PointerSizeInBytes * 8);
   };
 
+  OffsetCache Offsets;
   for (auto BB = F.begin(), E = F.end(); BB != E; ++BB) {
+    Offsets.clear();
     // Reverse iteration to find store sequences
     for (auto I = BB->rbegin(), E = BB->rend(); I != E; ++I) {
       if (auto *SI = dyn_cast<StoreInst>(&*I)) {
@@ -245,13 +317,13 @@ PreservedAnalyses MemcpyMatcher::run(Function &F, FunctionAnalysisManager &) {
         Visited.insert(LI);
 
         // Match source address (load operand)
-        auto SrcAddr = matchOffset(LI->getPointerOperand(), Visited);
+        auto SrcAddr = Offsets.match(LI->getPointerOperand(), Visited);
         if (!SrcAddr)
           continue;
         auto [SrcBase, SrcStart] = *SrcAddr;
 
         // Match destination address (store operand)
-        auto DestAddr = matchOffset(SI->getPointerOperand(), Visited);
+        auto DestAddr = Offsets.match(SI->getPointerOperand(), Visited);
         if (!DestAddr)
           continue;
         auto [DestBase, DestStart] = *DestAddr;
@@ -262,10 +334,9 @@ PreservedAnalyses MemcpyMatcher::run(Function &F, FunctionAnalysisManager &) {
         // Collect continuous accesses
         int64_t DestEnd = DestStart + AccessSize;
         int64_t SrcEnd = SrcStart + AccessSize;
-        // int64_t ExpectedNextSrc = SrcAddr->second - AccessSize;
-        // int64_t ExpectedNextDest = DestAddr->second - AccessSize;
         std::vector<StoreInst *> Cluster = {SI};
-        // Value *BasePtr = DestAddr->first;
+        // instructions to add to Visited if the store joins the cluster.
+        SmallVector<Instruction *, 8> NewVisited;
 
         for (auto II = std::next(I); II != E; ++II) {
           if (Visited.count(&*II))
@@ -277,20 +348,21 @@ PreservedAnalyses MemcpyMatcher::run(Function &F, FunctionAnalysisManager &) {
             if (!NextLI)
               break;
 
-            std::set<Instruction *> NewVisited = Visited;
-            NewVisited.insert(NextSI);
-            NewVisited.insert(NextLI);
+            NewVisited.clear();
+            NewVisited.push_back(NextSI);
+            NewVisited.push_back(NextLI);
 
             // 2. 检查是否Load和Store两边的Base相同。
             // Verify source address
-            auto NextSrc = matchOffset(NextLI->getPointerOperand(), NewVisited);
+            auto NextSrc =
+                Offsets.match(NextLI->getPointerOperand(), NewVisited);
             if (!NextSrc || NextSrc->first != SrcBase)
               break;
             auto [NextSrcBase, NextSrcStart] = *NextSrc;
 
             // Verify destination address
             auto NextDest =
-                matchOffset(NextSI->getPointerOperand(), NewVisited);
+                Offsets.match(NextSI->getPointerOperand(), NewVisited);
             if (!NextDest || NextDest->first != DestBase)
               break;
             auto [NextDestBase, NextDestStart] = *NextDest;
@@ -316,7 +388,7 @@ PreservedAnalyses MemcpyMatcher::run(Function &F, FunctionAnalysisManager &) {
             }
 
             Cluster.push_back(NextSI);
-            Visited = NewVisited;
+            Visited.insert(NewVisited.begin(), NewVisited.end());
           } else {
             break;
           }
@@ -338,9 +410,12 @@ PreservedAnalyses MemcpyMatcher::run(Function &F, FunctionAnalysisManager &) {
           // Create memcpy
           auto MS = Builder.CreateMemCpy(DestPtr, MaybeAlign(), SrcPtr,
                                          MaybeAlign(), Size, true);
-          llvm::errs() << "Merging " << std::to_string(Cluster.size())
-                       << " stores in func " << F.getName()
-                       << " into memset: " << *MS << "\n";
+          LLVM_DEBUG(llvm::errs()
+                     << "Merging " << std::to_string(Cluster.size())
+                     << " stores in func " << F.getName()
+                     << " into memcpy: " << *MS << "\n");
+          // continue before the memcpy
+          I = MS->getReverseIterator();
 
           // Remove original instructions
           for (auto *SI : Cluster) {
@@ -350,16 +425,14 @@ PreservedAnalyses MemcpyMatcher::run(Function &F, FunctionAnalysisManager &) {
               LI->eraseFromParent();
             }
           }
-
-          // Restart analysis after modification
-          --BB;
-          break;
+          Offsets.clear();
+          Changed = true;
         }
       }
     }
   }
 
-  return PreservedAnalyses::none();
+  return getPreservedAnalyses(Changed);
 }
 
 } // namespace notdec
@@ -37,6 +37,7 @@
 #include <llvm/Transforms/Utils/SimplifyCFGOptions.h>
 
 #include "Passes/AllocAnnotator.h"
+#include "Passes/DSROA.h"
 #include "Passes/MemOpMatcher.h"
 #include "Passes/PassManager.h"
 #include "Passes/ReorderBasicblock.h"
@@ -46,6 +47,7 @@
 #include "Passes/retdec-stack/retdec-stack.h"
 #include "Passes/retdec-stack/retdec-symbolic-tree.h"
 #include "TypeRecovery/TRContext.h"
+#include "Utils/DebugDump.h"
 #include "Utils/Utils.h"
 #include "notdec-wasm2llvm/utils.h"
 
@@ -341,6 +343,11 @@ void PassEnv::build_passes(int level) {
       // MPM.addPass(createModuleToFunctionPassAdaptor(InstCombinePass()));
       MPM.addPass(createModuleToFunctionPassAdaptor(UndoInstCombine()));
       MPM.addPass(createModuleToFunctionPassAdaptor(BDCEPass()));
+      // split the stack before type recovery, instead of StackBreaker at level
+      // 3, so that stack slots are promoted and the constraint graphs shrink.
+      if (isDSROAEnabled()) {
+        MPM.addPass(createModuleToFunctionPassAdaptor(DSROAPass()));
+      }
       // MPM.addPass(createModuleToFunctionPassAdaptor(
       //     createFunctionToLoopPassAdaptor(LoopRotatePass())));
       // MPM.addPass(createModuleToFunctionPassAdaptor(
@@ -393,6 +400,8 @@ void PassEnv::run_passes() {
   }
 
   MPM.run(Mod, MAM);
+  // write the pending debug dumps before the output is used.
+  DebugDump::get().flush();
 }
 
 // 需要去掉尾递归等优化，因此需要构建自己的Pass。
@@ -8,10 +8,8 @@
 using namespace llvm;
 
 namespace notdec::passes {
-SmallVector<BasicBlock *, 32> ReorderBlocksPass::getDomOrder(Function &F) {
-  DominatorTree DT;
-  DT.recalculate(F);
-
+SmallVector<BasicBlock *, 32>
+ReorderBlocksPass::getDomOrder(Function &F, DominatorTree &DT) {
   SmallVector<BasicBlock *, 32> blocks;
   SmallPtrSet<BasicBlock *, 32> visited;
 
@@ -48,13 +46,19 @@ void ReorderBlocksPass::traverseDomTree(DomTreeNode *node, SmallVectorImpl<Basic
 
 PreservedAnalyses ReorderBlocksPass::run(Function &F, FunctionAnalysisManager &AM) {
   // 获取新的块顺序（入口块保持第一个）
-  SmallVector<BasicBlock *, 32> newOrder = getDomOrder(F);
+  // 支配树只依赖CFG，不依赖块的排列顺序，所以可以复用缓存的结果
+  auto &DT = AM.getResult<DominatorTreeAnalysis>(F);
+  SmallVector<BasicBlock *, 32> newOrder = getDomOrder(F, DT);
 
   // 重新排列基本块顺序
+  bool changed = false;
   BasicBlock *prev = nullptr;
   for (BasicBlock *bb : newOrder) {
     if (prev) {
-      bb->moveAfter(prev);
+      if (prev->getNextNode() != bb) {
+        bb->moveAfter(prev);
+        changed = true;
+      }
     } else {
       // 确保entry保持在第一个位置
       assert(bb == &F.getEntryBlock() && "First block not entry");
@@ -62,6 +66,12 @@ PreservedAnalyses ReorderBlocksPass::run(Function &F, FunctionAnalysisManager &A
     prev = bb;
   }
 
-  return PreservedAnalyses::none();
+  if (!changed) {
+    return PreservedAnalyses::all();
+  }
+  // 只改变了块的排列顺序：没有增删基本块，也没有修改终结指令
+  PreservedAnalyses PA;
+  PA.preserveSet<CFGAnalyses>();
+  return PA;
 }
 }
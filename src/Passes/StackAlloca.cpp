@@ -2,7 +2,9 @@
 #include <cassert>
 #include <cmath>
 #include <cstdint>
+#include <llvm/ADT/DenseSet.h>
 #include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/SmallPtrSet.h>
 #include <llvm/ADT/SmallVector.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/DerivedTypes.h>
@@ -54,25 +56,26 @@ Instruction *createAllocaWithSize(IRBuilder<> &Builder, Value *Size,
   return Builder.CreateAlloca(i8, Size, Name);
 }
 
-void getPhiClosure(std::set<Value *> &Ret, PHINode *P) {
-  if (!Ret.count(P)) {
-    Ret.insert(P);
-    for (auto &U : P->incoming_values()) {
-      if (auto P = dyn_cast<PHINode>(U.get())) {
-        getPhiClosure(Ret, P);
-      } else {
-        Ret.insert(U.get());
+/// Collect phi nodes whose phi closure (transitive incoming values through
+/// phi nodes) contains V, by following phi users forward from V.
+static void getPhiUsersClosure(DenseSet<PHINode *> &Ret, Value *V) {
+  SmallVector<Value *, 8> Worklist = {V};
+  while (!Worklist.empty()) {
+    auto *Cur = Worklist.pop_back_val();
+    for (auto *U : Cur->users()) {
+      if (auto *P = dyn_cast<PHINode>(U)) {
+        if (Ret.insert(P).second) {
+          Worklist.push_back(P);
+        }
       }
     }
   }
 }
 
 // match dynamic stack allocation (optimized)
-void LinearAllocationRecovery::matchDynamicAllocas(Function &F, Value *SP,
-                                                   Instruction *LoadSP,
-                                                   Instruction *add_load_sp,
-                                                   Value *space,
-                                                   bool isGrowNegative) {
+void LinearAllocationRecovery::matchDynamicAllocas(
+    ArrayRef<StoreInst *> SPStores, Value *SP, Instruction *LoadSP,
+    Instruction *add_load_sp, Value *space, bool isGrowNegative) {
   using namespace llvm::PatternMatch;
   Value *StackLoc = nullptr;
   Value *SizeVal = nullptr;
@@ -90,67 +93,82 @@ void LinearAllocationRecovery::matchDynamicAllocas(Function &F, Value *SP,
   auto pat_alloca_add =
       m_Store(m_Add(m_Value(StackLoc), m_Value(SizeVal)), m_Specific(SP));
 
+  // phi nodes that may merge LoadSP or add_load_sp, computed on first use.
+  bool PhiClosureReady = false;
+  DenseSet<PHINode *> PhiOfLoadSP;
+  DenseSet<PHINode *> PhiOfAddLoadSP;
+  auto inPhiClosure = [&](DenseSet<PHINode *> &Closure) {
+    auto Phi = dyn_cast<PHINode>(StackLoc);
+    if (Phi == nullptr) {
+      return false;
+    }
+    if (!PhiClosureReady) {
+      getPhiUsersClosure(PhiOfLoadSP, LoadSP);
+      getPhiUsersClosure(PhiOfAddLoadSP, add_load_sp);
+      PhiClosureReady = true;
+    }
+    return Closure.count(Phi) > 0;
+  };
+
   // replace %sub with alloca i8, %Size
   // remove store
   std::vector<llvm::Instruction *> toRemove;
   std::vector<std::pair<llvm::Instruction *, llvm::Instruction *>> toReplace;
-  for (auto &BB : F) {
-    for (auto &I : BB) {
-      if (PatternMatch::match(&I, pat_alloca_add)) {
-        auto Add = llvm::cast<Instruction>(I.getOperand(0));
-        IRBuilder<> Builder(I.getParent());
-        Builder.SetInsertPoint(&I);
-        auto AllocaSize = SizeVal;
-        std::set<Value *> PhiClosure;
-        if (auto Phi = dyn_cast<PHINode>(StackLoc)) {
-          getPhiClosure(PhiClosure, Phi);
-        }
-        if (StackLoc == LoadSP || PhiClosure.count(LoadSP)) {
-          assert(!PhiClosure.count(add_load_sp));
-          AllocaSize = Builder.CreateSub(AllocaSize, space);
-        } else if (StackLoc == add_load_sp || PhiClosure.count(add_load_sp)) {
-          // relative to the top of the stack
-        } else {
-          llvm::errs() << "Error: unrecognized sp modification: " << I << "\n";
-          continue;
-        }
-        if (isGrowNegative) {
-          AllocaSize = Builder.CreateNeg(AllocaSize);
-        }
-        Instruction *Alloca =
-            createAllocaWithSize(Builder, AllocaSize, "alloc_mem");
-        Alloca = llvm::cast<Instruction>(
-            Builder.CreatePtrToInt(Alloca, Add->getType()));
-        // create a alloca inst with arg Size.
-        toRemove.push_back(&I);
-        toReplace.push_back(std::make_pair(Add, Alloca));
-      } else if (PatternMatch::match(&I, pat_alloca_sub)) {
-        // todo check for
-        auto Sub = llvm::cast<Instruction>(I.getOperand(0));
-        IRBuilder<> Builder(I.getParent());
-        Builder.SetInsertPoint(&I);
-        auto AllocaSize = SizeVal;
-        if (StackLoc == LoadSP) {
-          AllocaSize = Builder.CreateSub(AllocaSize, space);
-        } else if (StackLoc == add_load_sp) {
-          // relative to the top of the stack
-        } else {
-          llvm::errs() << "Error: unrecognized sp modification: " << I << "\n";
-          // continue;
-          // assume as stack top for sub
-        }
-        if (!isGrowNegative) {
-          AllocaSize = Builder.CreateNeg(AllocaSize);
-        }
-        // llvm::errs() << "stack alloca: " << *SizeVal << "\n";
-        Instruction *Alloca =
-            createAllocaWithSize(Builder, AllocaSize, "alloc_mem");
-        Alloca = llvm::cast<Instruction>(
-            Builder.CreatePtrToInt(Alloca, Sub->getType()));
-        // create a alloca inst with arg Size.
-        toRemove.push_back(&I);
-        toReplace.push_back(std::make_pair(Sub, Alloca));
+  for (auto *Store : SPStores) {
+    if (Store == nullptr) {
+      continue;
+    }
+    auto &I = *Store;
+    if (PatternMatch::match(&I, pat_alloca_add)) {
+      auto Add = llvm::cast<Instruction>(I.getOperand(0));
+      IRBuilder<> Builder(I.getParent());
+      Builder.SetInsertPoint(&I);
+      auto AllocaSize = SizeVal;
+      if (StackLoc == LoadSP || inPhiClosure(PhiOfLoadSP)) {
+        assert(!inPhiClosure(PhiOfAddLoadSP));
+        AllocaSize = Builder.CreateSub(AllocaSize, space);
+      } else if (StackLoc == add_load_sp || inPhiClosure(PhiOfAddLoadSP)) {
+        // relative to the top of the stack
+      } else {
+        llvm::errs() << "Error: unrecognized sp modification: " << I << "\n";
+        continue;
       }
+      if (isGrowNegative) {
+        AllocaSize = Builder.CreateNeg(AllocaSize);
+      }
+      Instruction *Alloca =
+          createAllocaWithSize(Builder, AllocaSize, "alloc_mem");
+      Alloca = llvm::cast<Instruction>(
+          Builder.CreatePtrToInt(Alloca, Add->getType()));
+      // create a alloca inst with arg Size.
+      toRemove.push_back(&I);
+      toReplace.push_back(std::make_pair(Add, Alloca));
+    } else if (PatternMatch::match(&I, pat_alloca_sub)) {
+      // todo check for
+      auto Sub = llvm::cast<Instruction>(I.getOperand(0));
+      IRBuilder<> Builder(I.getParent());
+      Builder.SetInsertPoint(&I);
+      auto AllocaSize = SizeVal;
+      if (StackLoc == LoadSP) {
+        AllocaSize = Builder.CreateSub(AllocaSize, space);
+      } else if (StackLoc == add_load_sp) {
+        // relative to the top of the stack
+      } else {
+        llvm::errs() << "Error: unrecognized sp modification: " << I << "\n";
+        // continue;
+        // assume as stack top for sub
+      }
+      if (!isGrowNegative) {
+        AllocaSize = Builder.CreateNeg(AllocaSize);
+      }
+      // llvm::errs() << "stack alloca: " << *SizeVal << "\n";
+      Instruction *Alloca =
+          createAllocaWithSize(Builder, AllocaSize, "alloc_mem");
+      Alloca = llvm::cast<Instruction>(
+          Builder.CreatePtrToInt(Alloca, Sub->getType()));
+      // create a alloca inst with arg Size.
+      toRemove.push_back(&I);
+      toReplace.push_back(std::make_pair(Sub, Alloca));
     }
   }
   for (auto I : toRemove) {
@@ -201,11 +219,11 @@ PreservedAnalyses LinearAllocationRecovery::run(Module &M,
     return PreservedAnalyses::all();
   }
   // iterate each use of sp, collect a list of functions to process.
-  std::set<Function *> worklist;
+  SmallPtrSet<Function *, 16> worklist;
   for (auto U : sp->users()) {
     if (Instruction *I = dyn_cast<Instruction>(U)) {
       auto *F = I->getFunction();
-      worklist.emplace(F);
+      worklist.insert(F);
     }
   }
 
@@ -215,11 +233,26 @@ PreservedAnalyses LinearAllocationRecovery::run(Module &M,
     return PreservedAnalyses::all();
   }
 
+  // replace the stack allocation with alloca.
+  bool grow_negative = sp_result.direction == 0;
+  // visit in module order, so that the output is deterministic.
+  for (auto &F : M) {
+    if (worklist.count(&F)) {
+      recoverFunction(F, sp, grow_negative);
+    }
+  }
+  // perform the transformation:
+
+  return PreservedAnalyses::none();
+}
+
+void LinearAllocationRecovery::recoverFunction(Function &F, GlobalVariable *sp,
+                                               bool grow_negative) {
   using namespace llvm::PatternMatch;
-  Value *sp1;
-  Instruction *LoadSP;
-  Value *space;
-  Instruction *add_load_sp;
+  Value *sp1 = nullptr;
+  Instruction *LoadSP = nullptr;
+  Value *space = nullptr;
+  Instruction *add_load_sp = nullptr;
   ConstantInt *offset;
 
   auto pat_alloc = StackPointerMatcher(sp1, space, LoadSP, add_load_sp, sp);
@@ -227,135 +260,140 @@ PreservedAnalyses LinearAllocationRecovery::run(Module &M,
 
   // ======== 1. Matching patterns. ===========
 
-  IRBuilder Builder(M.getContext());
-  for (auto *F : worklist) {
-    sp1 = nullptr;
-    LoadSP = nullptr;
-    space = nullptr;
-    add_load_sp = nullptr;
-    Instruction *prologue_store = nullptr;
-    // 1. Match for stack allocation level.
-    // level = 2 normal stack allocation.
-    // level = 1 tail function stack allocation.
-    // level = 0 cannot match stack allocation.
-    int match_level = 0;
-    auto *entry = &F->getEntryBlock();
-    // 1.1 Match normal stack allocation in the entry block.
-    for (auto &I : *entry) {
-      if (PatternMatch::match(&I, pat_alloc)) {
-        prologue_store = &I;
-        match_level = 2;
-        // llvm::errs() << "stack alloc: " << *space << "\n";
-        break;
-      }
-    }
-    // 1.2 Try to match tail function stack allocation if not matched.
-    // There should be at least one Add(Load(sp), offset).
-    if (match_level == 0) {
-      bool has_load_sp = false;
-      for (auto &BB : *F) {
-        for (auto &I : BB) {
-          if (PatternMatch::match(&I, pat_alloc_offset)) {
-            LoadSP = cast<Instruction>(I.getOperand(0));
-            match_level = 1;
-            // llvm::errs() << "stack alloc: " << *space << "\n";
-            break;
-          }
-          if (PatternMatch::match(&I, m_Load(m_Specific(sp)))) {
-            has_load_sp = true;
-          }
+  // 1.1 Collect the accesses to the stack pointer in a single walk.
+  // stores to the stack pointer, in program order. Erased ones are set to null.
+  SmallVector<StoreInst *, 8> SPStores;
+  // normal stack allocation: the first match in the entry block.
+  StoreInst *prologue_store = nullptr;
+  size_t prologue_index = 0;
+  // tail function stack allocation: Add(Load(sp), offset). The first match in
+  // the last block that has one.
+  Instruction *TailLoadSP = nullptr;
+  bool has_load_sp = false;
+  auto *entry = &F.getEntryBlock();
+  for (auto &BB : F) {
+    bool tail_matched_in_bb = false;
+    for (auto &I : BB) {
+      if (auto *Store = dyn_cast<StoreInst>(&I)) {
+        if (Store->getPointerOperand() != sp) {
+          continue;
         }
-      }
-      if (match_level == 0 && has_load_sp) {
-        llvm::errs() << "ERROR: No pattern matched but the stack pointer is "
-                        "accessed in func: "
-                     << F->getName() << "!\n";
-      }
-    }
-    // 1.3 Failed to match any stack allocation.
-    if (match_level == 0) {
-      llvm::errs() << "ERROR: cannot find stack allocation in func: "
-                   << F->getName() << "\n";
-      continue;
-    }
-    // For normal stack allocation (level = 2): Remove epilogue that restore the
-    // stack pointer
-    if (match_level == 2) {
-      assert(add_load_sp != nullptr && space != nullptr);
-      assert(add_load_sp->getParent() == LoadSP->getParent());
-      // find epilogue in exit blocks, and remove it.
-      auto pat_restore = m_Store(m_Specific(LoadSP), m_Specific(sp));
-      bool removed = false;
-      for (auto &BB : *F) {
-        if (BB.getTerminator()->getNumSuccessors() == 0) {
-          for (auto &I : make_early_inc_range(BB)) {
-            if (PatternMatch::match(&I, pat_restore)) {
-              // llvm::errs() << "recover sp: " << I << "\n";
-              I.eraseFromParent();
-              removed = true;
-              break;
-            }
-          }
+        if (prologue_store == nullptr && &BB == entry &&
+            PatternMatch::match(&I, pat_alloc)) {
+          prologue_store = Store;
+          prologue_index = SPStores.size();
         }
+        SPStores.push_back(Store);
+      } else if (auto *Load = dyn_cast<LoadInst>(&I)) {
+        if (Load->getPointerOperand() == sp) {
+          has_load_sp = true;
+        }
+      } else if (!tail_matched_in_bb &&
+                 PatternMatch::match(&I, pat_alloc_offset)) {
+        TailLoadSP = cast<Instruction>(I.getOperand(0));
+        tail_matched_in_bb = true;
       }
-      if (!removed) {
-        llvm::errs() << "ERROR: Cannot find sp restore? func: " << F->getName()
-                     << "\n";
+    }
+  }
+
+  // 1.2 Match for stack allocation level.
+  // level = 2 normal stack allocation.
+  // level = 1 tail function stack allocation.
+  // level = 0 cannot match stack allocation.
+  int match_level = 0;
+  if (prologue_store != nullptr) {
+    // llvm::errs() << "stack alloc: " << *space << "\n";
+    match_level = 2;
+  } else if (TailLoadSP != nullptr) {
+    // There should be at least one Add(Load(sp), offset).
+    LoadSP = TailLoadSP;
+    match_level = 1;
+  } else if (has_load_sp) {
+    llvm::errs() << "ERROR: No pattern matched but the stack pointer is "
+                    "accessed in func: "
+                 << F.getName() << "!\n";
+  }
+  // 1.3 Failed to match any stack allocation.
+  if (match_level == 0) {
+    llvm::errs() << "ERROR: cannot find stack allocation in func: "
+                 << F.getName() << "\n";
+    return;
+  }
+  // For normal stack allocation (level = 2): Remove epilogue that restore the
+  // stack pointer
+  if (match_level == 2) {
+    assert(add_load_sp != nullptr && space != nullptr);
+    assert(add_load_sp->getParent() == LoadSP->getParent());
+    // find epilogue in exit blocks, and remove it (at most one per block).
+    auto pat_restore = m_Store(m_Specific(LoadSP), m_Specific(sp));
+    bool removed = false;
+    BasicBlock *last_removed_bb = nullptr;
+    for (auto &Store : SPStores) {
+      auto *BB = Store->getParent();
+      if (BB == last_removed_bb ||
+          BB->getTerminator()->getNumSuccessors() != 0) {
         continue;
       }
+      if (PatternMatch::match(Store, pat_restore)) {
+        // llvm::errs() << "recover sp: " << *Store << "\n";
+        Store->eraseFromParent();
+        Store = nullptr;
+        last_removed_bb = BB;
+        removed = true;
+      }
     }
-
-    // replace the stack allocation with alloca.
-    bool grow_negative = sp_result.direction == 0;
-
-    // remove prologue store in case matched by dynamic alloca matching
-    if (match_level == 2) {
-      prologue_store->eraseFromParent();
+    if (!removed) {
+      llvm::errs() << "ERROR: Cannot find sp restore? func: " << F.getName()
+                   << "\n";
+      return;
     }
+  }
 
-    if (match_level == 2) {
-      matchDynamicAllocas(*F, sp, LoadSP, add_load_sp, space, grow_negative);
-    }
+  // remove prologue store in case matched by dynamic alloca matching
+  if (match_level == 2) {
+    prologue_store->eraseFromParent();
+    SPStores[prologue_index] = nullptr;
+  }
 
-    auto SizeTy = IntegerType::get(M.getContext(),
-                                   M.getDataLayout().getPointerSizeInBits());
-    // TODO handle positive grow direction.
-    assert(grow_negative == true);
-    // When match_level == 1, Only LoadSP is not null.
-    if (match_level == 1) {
-      space = ConstantInt::getNullValue(SizeTy);
-    }
-    //  else if (grow_negative) {
-    //   space = Builder.CreateNeg(space);
-    // }
-    Builder.SetInsertPoint(LoadSP);
-    Value *alloc = createAllocaWithSize(
-        Builder, grow_negative ? Builder.CreateNeg(space) : space, "stack");
-    cast<Instruction>(alloc)->setMetadata(
-        KIND_STACK_DIRECTION,
-        MDNode::get(
-            M.getContext(),
-            MDString::get(M.getContext(), KIND_STACK_DIRECTION_NEGATIVE)));
-    alloc = Builder.CreatePtrToInt(alloc, LoadSP->getType(), "stack_addr");
-    Value *alloc_end = Builder.CreateAdd(alloc, space, "stack_end");
+  if (match_level == 2) {
+    matchDynamicAllocas(SPStores, sp, LoadSP, add_load_sp, space,
+                        grow_negative);
+  }
 
-    // The name is incorrect. high_addr does not mean it will must
-    Instruction *high_addr = add_load_sp;
-    Instruction *low_addr = LoadSP;
-    // if (grow_negative) {
-    //   std::swap(high_addr, low_addr);
-    // }
-    // replace all uses of LoadSP with alloc_end.
-    low_addr->replaceAllUsesWith(alloc);
-    low_addr->eraseFromParent();
-    if (high_addr != nullptr) {
-      assert(match_level == 2);
-      high_addr->replaceAllUsesWith(alloc_end);
-      high_addr->eraseFromParent();
-    }
+  auto &Ctx = F.getContext();
+  auto SizeTy = IntegerType::get(
+      Ctx, F.getParent()->getDataLayout().getPointerSizeInBits());
+  // TODO handle positive grow direction.
+  assert(grow_negative == true);
+  // When match_level == 1, Only LoadSP is not null.
+  if (match_level == 1) {
+    space = ConstantInt::getNullValue(SizeTy);
   }
-  // perform the transformation:
+  //  else if (grow_negative) {
+  //   space = Builder.CreateNeg(space);
+  // }
+  IRBuilder Builder(LoadSP);
+  Value *alloc = createAllocaWithSize(
+      Builder, grow_negative ? Builder.CreateNeg(space) : space, "stack");
+  cast<Instruction>(alloc)->setMetadata(
+      KIND_STACK_DIRECTION,
+      MDNode::get(Ctx, MDString::get(Ctx, KIND_STACK_DIRECTION_NEGATIVE)));
+  alloc = Builder.CreatePtrToInt(alloc, LoadSP->getType(), "stack_addr");
+  Value *alloc_end = Builder.CreateAdd(alloc, space, "stack_end");
 
-  return PreservedAnalyses::none();
+  // The name is incorrect. high_addr does not mean it will must
+  Instruction *high_addr = add_load_sp;
+  Instruction *low_addr = LoadSP;
+  // if (grow_negative) {
+  //   std::swap(high_addr, low_addr);
+  // }
+  // replace all uses of LoadSP with alloc_end.
+  low_addr->replaceAllUsesWith(alloc);
+  low_addr->eraseFromParent();
+  if (high_addr != nullptr) {
+    assert(match_level == 2);
+    high_addr->replaceAllUsesWith(alloc_end);
+    high_addr->eraseFromParent();
+  }
 }
 } // namespace notdec
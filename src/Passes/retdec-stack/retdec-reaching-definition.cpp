@@ -11,7 +11,11 @@
 #include <vector>
 #include <iostream>
 
+#include <llvm/ADT/BitVector.h>
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/ADT/PostOrderIterator.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
 #include <llvm/IR/CFG.h>
 #include <llvm/IR/Instruction.h>
 #include <llvm/IR/Instructions.h>
@@ -72,15 +76,12 @@ bool ReachingDefinitionsAnalysis::runOnFunction(
 void ReachingDefinitionsAnalysis::run()
 {
 	initializeBasicBlocksPrev();
-	initializeKillGenSets();
 	propagate();
-	initializeDefsAndUses();
+	initializeInstructionMaps();
 
 	if (_abi->isDebug()) {
 		std::cerr << *this << "\n";
 	}
-
-	clearInternal();
 }
 
 void ReachingDefinitionsAnalysis::initializeBasicBlocks(llvm::Module& M)
@@ -178,6 +179,8 @@ void ReachingDefinitionsAnalysis::initializeBasicBlocks(llvm::Function& F)
 void ReachingDefinitionsAnalysis::clear()
 {
 	bbMap.clear();
+	_defMap.clear();
+	_useMap.clear();
 	_run = false;
 }
 
@@ -186,22 +189,6 @@ bool ReachingDefinitionsAnalysis::wasRun() const
 	return _run;
 }
 
-/**
- * Clear internal structures used to compute RDA, but not needed to use it once
- * it is computed.
- */
-void ReachingDefinitionsAnalysis::clearInternal()
-{
-	for (auto& pair1 : bbMap)
-	for (auto& pair : pair1.second)
-	{
-		BasicBlockEntry& bb = pair.second;
-		bb.defsOut.clear();
-		bb.genDefs.clear();
-		bb.killDefs.clear();
-	}
-}
-
 void ReachingDefinitionsAnalysis::initializeBasicBlocksPrev()
 {
 	for (auto &pair1 : bbMap)
@@ -222,53 +209,126 @@ void ReachingDefinitionsAnalysis::initializeBasicBlocksPrev()
 	}
 }
 
-void ReachingDefinitionsAnalysis::initializeKillGenSets()
+void ReachingDefinitionsAnalysis::propagate()
 {
 	for (auto &pair1 : bbMap)
-	for (auto& pair : pair1.second)
 	{
-		pair.second.initializeKillDefSets();
+		propagate(pair1.first, pair1.second);
 	}
 }
 
-void ReachingDefinitionsAnalysis::propagate()
-{
-	for (auto &pair1 : bbMap)
+/**
+ * Solve the function over bit vectors of its definitions, then link each use
+ * with the definitions reaching it.
+ *
+ * GEN[B] is the last definition of each source in B, KILL[B] are all the
+ * definitions of the sources defined in B.
+ * REACH_in[B] = Sum (p in pred[B]) (REACH_out[p])
+ * REACH_out[B] = GEN[B] + ( REACH_in[B] - KILL[B] )
+ * Blocks unreachable from the entry have empty REACH_out.
+ */
+void ReachingDefinitionsAnalysis::propagate(
+		const Function* fnc,
+		BBEntryMap& bbs)
+{
+	// Number definitions, and group them by source.
+	std::vector<Definition*> defs;
+	DenseMap<const Value*, unsigned> srcIds;
+	std::vector<SmallVector<unsigned, 4>> defsOfSrc;
+	for (auto& pair : bbs)
+	for (Definition& d : pair.second.defs)
 	{
-		const Function* fnc = pair1.first;
-
-		std::vector<BasicBlockEntry*> workList;
-		workList.reserve(pair1.second.size());
-		ReversePostOrderTraversal<const Function*> RPOT(fnc); // Expensive to create
-		for (auto I = RPOT.begin(); I != RPOT.end(); ++I)
+		auto it = srcIds.try_emplace(d.getSource(), defsOfSrc.size());
+		if (it.second)
 		{
-			const BasicBlock* bb = *I;
-			auto fIt = pair1.second.find(bb);
-			assert(fIt != pair1.second.end());
-			workList.push_back(&(fIt->second));
-
-			fIt->second.changed = true;
+			defsOfSrc.emplace_back();
 		}
+		defsOfSrc[it.first->second].push_back(defs.size());
+		defs.push_back(&d);
+	}
+	if (defs.empty())
+	{
+		return;
+	}
+	std::size_t numDefs = defs.size();
 
-		bool changed = true;
-		while (changed)
+	// Blocks in RPO, with GEN, KILL and predecessors.
+	std::vector<BasicBlockEntry*> blocks;
+	DenseMap<const BasicBlockEntry*, unsigned> blockIds;
+	ReversePostOrderTraversal<const Function*> RPOT(fnc); // Expensive to create
+	for (const BasicBlock* bb : RPOT)
+	{
+		auto fIt = bbs.find(bb);
+		assert(fIt != bbs.end());
+		blockIds[&fIt->second] = blocks.size();
+		blocks.push_back(&fIt->second);
+	}
+	std::vector<SmallVector<unsigned, 8>> gen(blocks.size());
+	std::vector<BitVector> kill(blocks.size(), BitVector(numDefs));
+	std::vector<SmallVector<unsigned, 2>> preds(blocks.size());
+	std::vector<unsigned> defIds;
+	for (unsigned b = 0; b < blocks.size(); ++b)
+	{
+		// definitions of a block are numbered consecutively.
+		auto& bbDefs = blocks[b]->defs;
+		SmallPtrSet<const Value*, 8> seen;
+		for (auto dIt = bbDefs.rbegin(); dIt != bbDefs.rend(); ++dIt)
 		{
-			changed = false;
+			if (!seen.insert(dIt->getSource()).second)
+			{
+				continue;
+			}
+			unsigned src = srcIds.lookup(dIt->getSource());
+			for (unsigned i : defsOfSrc[src])
+			{
+				kill[b].set(i);
+				if (defs[i] == &*dIt)
+				{
+					gen[b].push_back(i);
+				}
+			}
+		}
+		for (auto* p : blocks[b]->prevBBs)
+		{
+			auto pIt = blockIds.find(p);
+			if (pIt != blockIds.end())
+			{
+				preds[b].push_back(pIt->second);
+			}
+		}
+	}
 
-			for (auto* bbe : workList)
+	std::vector<BitVector> out(blocks.size(), BitVector(numDefs));
+	BitVector in(numDefs);
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (unsigned b = 0; b < blocks.size(); ++b)
+		{
+			in.reset();
+			for (unsigned p : preds[b])
+			{
+				in |= out[p];
+			}
+			in.reset(kill[b]);
+			for (unsigned i : gen[b])
 			{
-				changed |= bbe->initDefsOut();
+				in.set(i);
+			}
+			if (in != out[b])
+			{
+				out[b] = in;
+				changed = true;
 			}
 		}
 	}
-}
 
-void ReachingDefinitionsAnalysis::initializeDefsAndUses()
-{
-	for (auto &pair1 : bbMap)
-	for (auto& pair : pair1.second)
+	// Link uses with definitions in the same block, or reaching the block.
+	for (auto& pair : bbs)
 	{
 		BasicBlockEntry &bb = pair.second;
+		bool inReady = false;
 
 		for (Use &u : bb.uses)
 		{
@@ -283,60 +343,123 @@ void ReachingDefinitionsAnalysis::initializeDefsAndUses()
 
 				if (d.dominates(&u))
 				{
-					d.uses.insert(&u);
-					u.defs.insert(&d);
+					d.uses.push_back(&u);
+					u.defs.push_back(&d);
 					break;
 				}
 			}
 
-			if (u.defs.empty())
+			if (!u.defs.empty())
+			{
+				continue;
+			}
+			auto srcIt = srcIds.find(u.src);
+			if (srcIt == srcIds.end())
+			{
+				continue;
+			}
+			if (!inReady)
 			{
-				for (auto p : bb.prevBBs)
-				for (auto d : p->defsOut)
+				in.reset();
+				for (auto* p : bb.prevBBs)
 				{
-					if (d->getSource() == u.src)
+					auto pIt = blockIds.find(p);
+					if (pIt != blockIds.end())
 					{
-						d->uses.insert(&u);
-						u.defs.insert(d);
+						in |= out[pIt->second];
 					}
 				}
+				inReady = true;
+			}
+			for (unsigned i : defsOfSrc[srcIt->second])
+			{
+				if (in.test(i))
+				{
+					defs[i]->uses.push_back(&u);
+					u.defs.push_back(defs[i]);
+				}
 			}
 		}
 	}
 }
 
-const BasicBlockEntry& ReachingDefinitionsAnalysis::getBasicBlockEntry(
-		const Instruction* I) const
+void ReachingDefinitionsAnalysis::initializeInstructionMaps()
 {
-	auto* F = I->getFunction();
-	auto pair1 = bbMap.find(F);
-	assert(pair1 != bbMap.end() && "we do not have this function in bbMap");
-
-	auto* BB = I->getParent();
-	auto pair = pair1->second.find(BB);
-	assert(pair != pair1->second.end() && "we do not have this basic block in bbMap");
-
-	return pair->second;
+	for (auto &pair1 : bbMap)
+	for (auto& pair : pair1.second)
+	{
+		for (Definition& d : pair.second.defs)
+		{
+			_defMap.try_emplace(d.def, &d);
+		}
+		// calls have a use for each argument. An argument passed twice has
+		// the same definitions, keep the first one.
+		for (Use& u : pair.second.uses)
+		{
+			bool inserted = _useMap.try_emplace({u.use, u.src}, &u).second;
+			assert((inserted || isa<CallInst>(u.use))
+					&& "only calls can use a value twice");
+			(void)inserted;
+		}
+	}
 }
 
 const DefSet& ReachingDefinitionsAnalysis::defsFromUse(const Instruction* I) const
 {
-	return getBasicBlockEntry(I).defsFromUse(I);
+	static DefSet emptyDefSet;
+	auto* u = getUse(I);
+	return u ? u->defs : emptyDefSet;
+}
+
+const DefSet& ReachingDefinitionsAnalysis::defsFromUse(
+		const Instruction* I,
+		const Value* src) const
+{
+	static DefSet emptyDefSet;
+	auto* u = getUse(I, src);
+	return u ? u->defs : emptyDefSet;
 }
 
 const UseSet& ReachingDefinitionsAnalysis::usesFromDef(const Instruction* I) const
 {
-	return getBasicBlockEntry(I).usesFromDef(I);
+	static UseSet emptyUseSet;
+	auto* d = getDef(I);
+	return d ? d->uses : emptyUseSet;
 }
 
 const Definition* ReachingDefinitionsAnalysis::getDef(const Instruction* I) const
 {
-	return getBasicBlockEntry(I).getDef(I);
+	return _defMap.lookup(I);
 }
 
 const Use* ReachingDefinitionsAnalysis::getUse(const Instruction* I) const
 {
-	return getBasicBlockEntry(I).getUse(I);
+	const Value* src = nullptr;
+	if (auto* l = dyn_cast<LoadInst>(I))
+	{
+		src = l->getPointerOperand();
+	}
+	else if (auto* p2i = dyn_cast<PtrToIntInst>(I))
+	{
+		src = p2i->getPointerOperand();
+	}
+	else if (auto* gep = dyn_cast<GetElementPtrInst>(I))
+	{
+		src = gep->getPointerOperand();
+	}
+	else
+	{
+		assert(!isa<CallInst>(I) && "calls have a use per argument");
+		return nullptr;
+	}
+	return getUse(I, src);
+}
+
+const Use* ReachingDefinitionsAnalysis::getUse(
+		const Instruction* I,
+		const Value* src) const
+{
+	return _useMap.lookup({I, src});
 }
 
 std::ostream& operator<<(std::ostream& out, const ReachingDefinitionsAnalysis& rda)
@@ -362,54 +485,6 @@ BasicBlockEntry::BasicBlockEntry(const llvm::BasicBlock* b, std::size_t _id) :
 
 }
 
-void BasicBlockEntry::initializeKillDefSets()
-{
-	killDefs.clear();
-	genDefs.clear();
-
-	for (auto dIt = defs.rbegin(); dIt != defs.rend(); ++dIt)
-	{
-		Definition& d = *dIt;
-
-		bool added = (killDefs.insert(d.getSource())).second;
-		if (added)
-		{
-			genDefs.insert(&d);
-		}
-	}
-}
-
-/**
- * REACH_in[B] = Sum (p in pred[B]) (REACH_out[p])
- * REACH_out[B] = GEN[B] + ( REACH_in[B] - KILL[B] )
- */
-Changed BasicBlockEntry::initDefsOut()
-{
-	auto oldSz = defsOut.size();
-
-	if (defsOut.empty() && !genDefs.empty())
-	{
-		defsOut = std::move(genDefs);
-	}
-
-	for (auto* p : prevBBs)
-	{
-		if (p->changed)
-		{
-			for (auto* d : p->defsOut)
-			{
-				if (killDefs.find(d->getSource()) == killDefs.end())
-				{
-					defsOut.insert(d);
-				}
-			}
-		}
-	}
-
-	changed = oldSz != defsOut.size();
-	return changed;
-}
-
 std::string BasicBlockEntry::getName() const
 {
 	std::stringstream out;
@@ -658,8 +733,8 @@ std::set<llvm::Instruction*> ReachingDefinitionsAnalysis::defsFromUse_onDemand(
 		return ret;
 	}
 
-	std::set<llvm::BasicBlock*> searchedBbs;
-	std::vector<llvm::BasicBlock*> worklistBbs;
+	SmallPtrSet<llvm::BasicBlock*, 16> searchedBbs;
+	SmallVector<llvm::BasicBlock*, 16> worklistBbs;
 
 	auto preds = predecessors(l->getParent());
 	std::copy(preds.begin(), preds.end(), std::back_inserter(worklistBbs));
@@ -683,7 +758,7 @@ std::set<llvm::Instruction*> ReachingDefinitionsAnalysis::defsFromUse_onDemand(
 			// No definition found -> add predecessors.
 			for (auto* p : predecessors(bb))
 			{
-				if (searchedBbs.count(p) == 0)
+				if (!searchedBbs.count(p))
 				{
 					worklistBbs.push_back(p);
 				}
@@ -720,8 +795,8 @@ std::set<llvm::Instruction*> ReachingDefinitionsAnalysis::usesFromDef_onDemand(
 		return ret;
 	}
 
-	std::set<llvm::BasicBlock*> searchedBbs;
-	std::vector<llvm::BasicBlock*> worklistBbs;
+	SmallPtrSet<llvm::BasicBlock*, 16> searchedBbs;
+	SmallVector<llvm::BasicBlock*, 16> worklistBbs;
 
 	auto succs = successors(I->getParent());
 	std::copy(succs.begin(), succs.end(), std::back_inserter(worklistBbs));
@@ -744,7 +819,7 @@ std::set<llvm::Instruction*> ReachingDefinitionsAnalysis::usesFromDef_onDemand(
 			// BB does not kill value -> add successors.
 			for (auto* p : successors(bb))
 			{
-				if (searchedBbs.count(p) == 0)
+				if (!searchedBbs.count(p))
 				{
 					worklistBbs.push_back(p);
 				}
@@ -66,6 +66,9 @@ bool StackAnalysis::run()
 		std::map<Value*, Value*> val2val;
 		// 从偏移映射到alloca
 		std::map<int64_t, Value*> off2alloca;
+		// 同一函数内的表达式树共享展开结果
+		_memo.clear();
+		SymbolicTree::setMemo(&_memo);
 		for (inst_iterator I = inst_begin(f), E = inst_end(f); I != E;)
 		{
 			Instruction& i = *I;
@@ -112,7 +115,9 @@ bool StackAnalysis::run()
 						val2val, off2alloca);
 			}
 		}
+		SymbolicTree::setMemo(nullptr);
 	}
+	_memo.clear();
 
 	IrModifier::eraseUnusedInstructionsRecursive(_toRemove);
 
@@ -137,42 +142,29 @@ void StackAnalysis::handleInstruction(
 		std::cerr << __FILE__ << ":" << __LINE__ << ": " << llvmObjToString(inst) << std::endl;
 	}
 
-	auto root = SymbolicTree::PrecomputedRdaWithValueMap(RDA, val, &val2val);
 	if (_abi->isDebug()) {
-		std::cerr << __FILE__ << ":" << __LINE__ << ": " << root << std::endl;
+		std::cerr << __FILE__ << ":" << __LINE__ << ": " << SymbolicTree::PrecomputedRdaWithValueMap(RDA, val, &val2val) << std::endl;
 	}
+	// 直接化简成stack offset，化简结果在memo里按节点缓存
 	// TODO 如果把sp map到0，则相关栈操作数最终可以化简到常量。
 	// 如果已经map了，则一般属于情况2和情况3
 	// 如果没有映射，也没有SP，就直接报错返回。
-	if (!root.isVal2ValMapUsed())
+	auto root = SymbolicTree::PrecomputedRdaWithValueMapSimplified(
+			RDA, val, &val2val);
+	if (!root)
 	{
-		bool stackPtr = false;
-		// 可能是什么表达式树。后序遍历判断是否包含栈寄存器。
-		for (SymbolicTree* n : root.getPostOrder())
-		{
-			if (_abi->isStackPointerRegister(n->value))
-			{
-				stackPtr = true;
-				break;
-			}
-		}
-		if (!stackPtr)
-		{
-			if (_abi->isDebug()) {
-				std::cerr << __FILE__ << ":" << __LINE__ << ": " << "===> no SP" << std::endl;
-			}
-			return;
+		if (_abi->isDebug()) {
+			std::cerr << __FILE__ << ":" << __LINE__ << ": " << "===> no SP" << std::endl;
 		}
+		return;
 	}
 
-	// 直接化简成stack offset
-	root.simplifyNode();
 	if (_abi->isDebug()) {
-		std::cerr << __FILE__ << ":" << __LINE__ << ": " << root << std::endl;
+		std::cerr << __FILE__ << ":" << __LINE__ << ": " << *root << std::endl;
 	}
 
 	// 如果简化失败，就放弃
-	auto* ci = dyn_cast_or_null<ConstantInt>(root.value);
+	auto* ci = dyn_cast_or_null<ConstantInt>(root->value);
 	if (ci == nullptr)
 	{
 		return;
@@ -183,6 +175,7 @@ void StackAnalysis::handleInstruction(
 	{
 		if (s->getValueOperand() == val)
 		{
+			_memo.invalidate(inst);
 			val2val[inst] = ci;
 		}
 	}
@@ -197,7 +190,7 @@ void StackAnalysis::handleInstruction(
 			+ std::to_string(ci->getSExtValue()) + "_";
 
 	// 改为直接创建Alloca指令。
-	assert(inst->getFunction()->getInstructionCount() != 0);
+	assert(!inst->getFunction()->empty());
 
 	AllocaInst* a;
 	auto it = off2alloca.find(ci->getSExtValue());
@@ -239,6 +232,10 @@ void StackAnalysis::handleInstruction(
 	{
 		auto* nl = new LoadInst(a->getType()->getPointerElementType(), a, "", l);
 		auto* conv = IrModifier::convertValueToType(nl, l->getType(), l);
+		for (auto* u : l->users())
+		{
+			_memo.invalidate(u);
+		}
 		l->replaceAllUsesWith(conv);
 		_toRemove.insert(l);
 	}
@@ -247,6 +244,7 @@ void StackAnalysis::handleInstruction(
 	{
 		auto* conv = IrModifier::convertValueToType(a, val->getType(), inst);
 		_toRemove.insert(val);
+		_memo.invalidate(inst);
 		inst->replaceUsesOfWith(val, conv);
 	}
 }
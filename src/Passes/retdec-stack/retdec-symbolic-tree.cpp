@@ -4,6 +4,10 @@
  * @copyright (c) 2017 Avast Software, licensed under the MIT license
  */
 
+#include <atomic>
+#include <cassert>
+#include <optional>
+
 #include <llvm/IR/GlobalVariable.h>
 #include <llvm/IR/Instructions.h>
 #include <llvm/Support/Casting.h>
@@ -96,6 +100,46 @@ SymbolicTree SymbolicTree::Linear(
 	return SymbolicTree(nullptr, v, nullptr, 0, maxNodeLevel, nullptr, true);
 }
 
+std::optional<SymbolicTree> SymbolicTree::PrecomputedRdaWithValueMapSimplified(
+		ReachingDefinitionsAnalysis& rda,
+		llvm::Value* v,
+		std::map<llvm::Value*, llvm::Value*>* val2val,
+		unsigned maxNodeLevel)
+{
+	_val2valUsed = false;
+	auto* memo = _memoTable;
+	if (memo == nullptr
+			|| SymbolicTreeMemo::isLeaf(v)
+			|| !memo->accepts(&rda, val2val, false))
+	{
+		auto root = SymbolicTree(&rda, v, nullptr, 0, maxNodeLevel, val2val,
+				false);
+		if (!_val2valUsed && !root.anyOf([](const SymbolicTree& n) {
+				return _abi->isStackPointerRegister(n.value);
+			}))
+		{
+			return std::nullopt;
+		}
+		root.simplifyNode();
+		return root;
+	}
+
+	SymbolicTree root(nullptr, v, nullptr, 0, 0);
+	root.constructMemoized(memo, &rda, nullptr, maxNodeLevel, val2val);
+	auto* entry = root._memoEntry;
+	if (!_val2valUsed && !entry->stackPointer)
+	{
+		return std::nullopt;
+	}
+	root = SymbolicTree(memo->simplified(entry));
+	if (root.user == entry->user)
+	{
+		root.user = entry->userFromCtor ? nullptr : entry->user;
+	}
+	root.fixLevel();
+	return root;
+}
+
 SymbolicTree::SymbolicTree(
 		ReachingDefinitionsAnalysis* rda,
 		llvm::Value* v,
@@ -109,8 +153,126 @@ SymbolicTree::SymbolicTree(
 		user(u),
 		_level(nodeLevel)
 {
-	ops.reserve(_naryLimit);
+	auto* memo = _memoTable;
+	if (memo == nullptr
+			|| SymbolicTreeMemo::isLeaf(v)
+			|| !memo->accepts(rda, val2val, linear))
+	{
+		construct(rda, val2val, maxNodeLevel, linear);
+		return;
+	}
+
+	// Nested nodes only get their memo entry, the outermost node expands
+	// the whole tree from the memo.
+	bool outermost = memo->_building.empty();
+	constructMemoized(memo, rda, u, maxNodeLevel, val2val);
+	if (outermost)
+	{
+		materialize(_memoEntry, _memoGeneration);
+	}
+}
+
+/**
+ * Find or create the memo entry for this node. Operands are not expanded.
+ */
+void SymbolicTree::constructMemoized(
+		SymbolicTreeMemo* memo,
+		ReachingDefinitionsAnalysis* rda,
+		llvm::Value* u,
+		unsigned maxNodeLevel,
+		std::map<llvm::Value*, llvm::Value*>* val2val)
+{
+	SymbolicTreeMemo::Key key(value, maxNodeLevel - getLevel());
+	_memoGeneration = memo->_generation;
+
+	if (auto* entry = memo->lookup(key))
+	{
+		if (!memo->_building.empty())
+		{
+			entry->parents.push_back(memo->_building.back());
+		}
+		_val2valUsed |= entry->val2valUsed;
+		value = entry->value;
+		user = entry->userFromCtor ? u : entry->user;
+		_memoEntry = entry;
+		return;
+	}
+
+	auto* entry = new (memo->_storage.Allocate()) SymbolicTreeMemo::Entry();
+	entry->key = key;
+
+	bool val2valUsed = _val2valUsed;
+	_val2valUsed = false;
+	memo->_building.push_back(entry);
+	construct(rda, val2val, maxNodeLevel, false);
+	memo->_building.pop_back();
+
+	entry->value = value;
+	entry->user = user;
+	entry->userFromCtor = user == u;
+	entry->val2valUsed = _val2valUsed;
+	entry->stackPointer = _abi && _abi->isStackPointerRegister(value);
+	for (auto& o : ops)
+	{
+		assert((o._memoEntry || o.ops.empty()) && "operand built without memo");
+		entry->ops.push_back({o._memoEntry, o.value, o.user});
+		entry->stackPointer |= o._memoEntry && o._memoEntry->stackPointer;
+	}
+	if (!memo->_building.empty())
+	{
+		entry->parents.push_back(memo->_building.back());
+	}
+	_val2valUsed |= val2valUsed;
+	_memoEntry = entry;
+	memo->insert(entry);
+}
 
+/**
+ * Materialize the memoized node @a entry, or a leaf if @a entry is null.
+ */
+SymbolicTree::SymbolicTree(
+		SymbolicTreeMemo::Entry* entry,
+		llvm::Value* v,
+		llvm::Value* u,
+		unsigned nodeLevel,
+		unsigned generation)
+		:
+		value(v),
+		user(u),
+		_level(nodeLevel)
+{
+	materialize(entry, generation);
+}
+
+void SymbolicTree::materialize(
+		SymbolicTreeMemo::Entry* entry,
+		unsigned generation)
+{
+	_memoEntry = entry;
+	_memoGeneration = generation;
+	ops.clear();
+	if (entry == nullptr || entry->ops.empty())
+	{
+		return;
+	}
+	ops.reserve(entry->ops.size());
+	for (auto& op : entry->ops)
+	{
+		ops.push_back(SymbolicTree(
+				op.entry,
+				op.value,
+				op.user,
+				getLevel() + 1,
+				generation));
+	}
+}
+
+void SymbolicTree::construct(
+		ReachingDefinitionsAnalysis* rda,
+		std::map<llvm::Value*, llvm::Value*>* val2val,
+		unsigned maxNodeLevel,
+		bool linear)
+{
 	if (val2val)
 	{
 		auto fIt = val2val->find(value);
@@ -122,11 +284,12 @@ SymbolicTree::SymbolicTree(
 		}
 	}
 
-	if (getLevel() == maxNodeLevel)
+	if (getLevel() == maxNodeLevel || SymbolicTreeMemo::isLeaf(value))
 	{
 		return;
 	}
 
+	ops.reserve(_naryLimit);
 	expandNode(rda, val2val, maxNodeLevel, linear);
 }
 
@@ -141,9 +304,14 @@ SymbolicTree& SymbolicTree::operator=(SymbolicTree&& other)
 	{
 		value = other.value;
 		user = other.user;
+		_memoEntry = other._memoEntry;
+		_memoGeneration = other._memoGeneration;
 		// Do NOT use `ops = std::move(other.ops);` to allow use like
-		// `*this = ops[0];`. Use std::swap() instead.
-		std::swap(ops, other.ops);
+		// `*this = ops[0];`. Take other's ops first, then release ours, which
+		// may contain other.
+		std::vector<SymbolicTree> tmp;
+		std::swap(tmp, other.ops);
+		std::swap(ops, tmp);
 	}
 	return *this;
 }
@@ -228,7 +396,7 @@ void SymbolicTree::expandNode(
 		// 这里的RDA可能是给load和store的这种变量的。
 		else if (RDA && RDA->wasRun())
 		{
-			auto defs = RDA->defsFromUse(l);
+			const auto& defs = RDA->defsFromUse(l);
 			if (defs.size() > _naryLimit)
 			{
 // TODO!!! replace with invalid tree
@@ -393,12 +561,34 @@ void SymbolicTree::_simplifyNode()
 		return;
 	}
 
+	// memo里的节点直接用DAG上缓存的化简结果
+	if (_memoEntry && _memoTable
+			&& _memoTable->isLive(_memoEntry, _memoGeneration))
+	{
+		auto* u = user;
+		auto* entry = _memoEntry;
+		*this = SymbolicTree(_memoTable->simplified(entry));
+		if (user == entry->user)
+		{
+			user = u;
+		}
+		return;
+	}
+	_memoEntry = nullptr;
+
 	// 先递归调用
 	for (auto &o : ops)
 	{
 		o._simplifyNode();
 	}
+	_simplifyOps();
+}
 
+/**
+ * Simplify the node itself, its operands are already simplified.
+ */
+void SymbolicTree::_simplifyOps()
+{
 	// load指令如果多个相同ptr参数，简化一下
 	if (isa<LoadInst>(value) && ops.size() > 1)
 	{
@@ -723,6 +913,27 @@ void SymbolicTree::fixLevel(unsigned level)
 	}
 }
 
+/**
+ * @return @c True if @a pred holds for any node of the tree. Unlike
+ * @c getPostOrder(), no vector is allocated.
+ */
+bool SymbolicTree::anyOf(
+		llvm::function_ref<bool(const SymbolicTree&)> pred) const
+{
+	if (pred(*this))
+	{
+		return true;
+	}
+	for (auto &o : ops)
+	{
+		if (o.anyOf(pred))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
 bool SymbolicTree::isNullary() const
 {
 	return ops.size() == 0;
@@ -762,10 +973,12 @@ bool SymbolicTree::_trackThroughGeneralRegisterLoads = true;
 bool SymbolicTree::_trackOnlyFlagRegisters = false;
 bool SymbolicTree::_simplifyAtCreation = true;
 unsigned SymbolicTree::_naryLimit = 3;
+SymbolicTreeMemo* SymbolicTree::_memoTable = nullptr;
 
 void SymbolicTree::clear()
 {
 	_abi = nullptr;
+	_memoTable = nullptr;
 	// _config = nullptr;
 	setToDefaultConfiguration();
 }
@@ -820,5 +1033,182 @@ void SymbolicTree::setNaryLimit(unsigned n)
 	_naryLimit = n;
 }
 
+/**
+ * Memoize tree construction in @a memo. Use @c nullptr to stop memoizing.
+ */
+void SymbolicTree::setMemo(SymbolicTreeMemo* memo)
+{
+	_memoTable = memo;
+}
+
+//
+//==============================================================================
+// SymbolicTreeMemo
+//==============================================================================
+//
+
+/**
+ * Values which are never expanded. They are not memoized.
+ */
+bool SymbolicTreeMemo::isLeaf(llvm::Value* v)
+{
+	return isa<ConstantData>(v) || isa<Argument>(v);
+}
+
+bool SymbolicTreeMemo::accepts(
+		ReachingDefinitionsAnalysis* rda,
+		std::map<llvm::Value*, llvm::Value*>* val2val,
+		bool linear)
+{
+	// Linear and on demand expansion walk the current IR, which is not
+	// tracked by invalidate().
+	if (linear || rda == nullptr || !rda->wasRun())
+	{
+		return false;
+	}
+	if (!_bound)
+	{
+		_bound = true;
+		_rda = rda;
+		_val2val = val2val;
+	}
+	return _rda == rda && _val2val == val2val;
+}
+
+// Memos of different threads must not share a generation.
+static std::atomic<unsigned> nextMemoGeneration{0};
+
+SymbolicTreeMemo::SymbolicTreeMemo()
+		:
+		_generation(++nextMemoGeneration)
+{
+}
+
+/**
+ * Whether @a e, which a tree node got in @a generation, is still in the table.
+ * Entries dropped by invalidate() stay allocated until clear(), which starts
+ * a new generation.
+ */
+bool SymbolicTreeMemo::isLive(const Entry* e, unsigned generation) const
+{
+	return e && generation == _generation && lookup(e->key) == e;
+}
+
+/**
+ * Simplified tree of @a e, computed from the simplified trees of its
+ * operands and cached in the entry. Levels are not fixed.
+ */
+const SymbolicTree& SymbolicTreeMemo::simplified(Entry* e)
+{
+	if (e->simplified)
+	{
+		return *e->simplified;
+	}
+
+	SymbolicTree n(nullptr, e->value, e->user, 0, 0);
+	n.ops.reserve(e->ops.size());
+	for (auto& op : e->ops)
+	{
+		if (op.entry == nullptr)
+		{
+			n.ops.push_back(SymbolicTree(nullptr, op.value, op.user, 0, 0));
+			continue;
+		}
+		n.ops.push_back(simplified(op.entry));
+		if (n.ops.back().user == op.entry->user)
+		{
+			n.ops.back().user = op.user;
+		}
+	}
+	if (!n.ops.empty())
+	{
+		n._simplifyOps();
+	}
+	e->simplified = std::make_unique<SymbolicTree>(std::move(n));
+	return *e->simplified;
+}
+
+void SymbolicTreeMemo::invalidate(llvm::Value* v)
+{
+	// Leaves are stored in their users only.
+	if (isLeaf(v))
+	{
+		clear();
+		return;
+	}
+
+	std::vector<Entry*> worklist;
+	auto fIt = _entries.find(v);
+	if (fIt == _entries.end())
+	{
+		return;
+	}
+	for (auto* e : fIt->second)
+	{
+		if (e)
+		{
+			worklist.push_back(e);
+		}
+	}
+	while (!worklist.empty())
+	{
+		auto* entry = worklist.back();
+		worklist.pop_back();
+		// Skip entries already dropped, or replaced by a newer one.
+		if (!erase(entry))
+		{
+			continue;
+		}
+		worklist.insert(
+				worklist.end(),
+				entry->parents.begin(),
+				entry->parents.end());
+	}
+}
+
+SymbolicTreeMemo::Entry* SymbolicTreeMemo::lookup(const Key& key) const
+{
+	auto fIt = _entries.find(key.first);
+	if (fIt == _entries.end() || fIt->second.size() <= key.second)
+	{
+		return nullptr;
+	}
+	return fIt->second[key.second];
+}
+
+void SymbolicTreeMemo::insert(Entry* e)
+{
+	auto& slots = _entries[e->key.first];
+	if (slots.size() <= e->key.second)
+	{
+		slots.resize(e->key.second + 1, nullptr);
+	}
+	slots[e->key.second] = e;
+}
+
+bool SymbolicTreeMemo::erase(Entry* e)
+{
+	auto fIt = _entries.find(e->key.first);
+	if (fIt == _entries.end()
+			|| fIt->second.size() <= e->key.second
+			|| fIt->second[e->key.second] != e)
+	{
+		return false;
+	}
+	fIt->second[e->key.second] = nullptr;
+	return true;
+}
+
+void SymbolicTreeMemo::clear()
+{
+	_entries.clear();
+	_storage.DestroyAll();
+	_building.clear();
+	_generation = ++nextMemoGeneration;
+	_bound = false;
+	_rda = nullptr;
+	_val2val = nullptr;
+}
+
 } // namespace bin2llvmir
 } // namespace retdec
@@ -0,0 +1,160 @@
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FormatVariadic.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "TypeRecovery/BinaryFormat.h"
+#include "TypeRecovery/ConstraintGraph.h"
+#include "TypeRecovery/DotSummaryParser.h"
+#include "TypeRecovery/TRContext.h"
+
+using namespace llvm;
+using namespace notdec;
+
+static cl::OptionCategory SummaryCat("Notdec summary tool options",
+                                     "Convert between summary formats.");
+
+enum ConvertMode { ToBinary, ToJSON, ToDot, FromDot, ToLibrary };
+
+static cl::opt<ConvertMode> Mode(
+    cl::desc("Conversion:"),
+    cl::values(
+        clEnumValN(ToBinary, "to-binary", "JSON summary object to binary"),
+        clEnumValN(ToJSON, "to-json", "binary summary to JSON"),
+        clEnumValN(ToDot, "to-dot", "binary graph snapshot to Graphviz .dot"),
+        clEnumValN(FromDot, "from-dot",
+                   "Graphviz .dot (a single graph) to binary graph snapshot"),
+        clEnumValN(ToLibrary, "to-library",
+                   "JSON map from function names to summaries (like "
+                   "NOTDEC_SUMMARY_OVERRIDE) to a summary library")),
+    cl::Required, cl::cat(SummaryCat));
+static cl::opt<std::string> inputFilename(cl::Positional,
+                                          cl::desc("<input file>"),
+                                          cl::Required, cl::cat(SummaryCat));
+static cl::opt<std::string> outputFilename("o",
+                                           cl::desc("Specify output filename"),
+                                           cl::value_desc("output"),
+                                           cl::Required, cl::cat(SummaryCat));
+static cl::opt<unsigned> PointerSize("pointer-size",
+                                     cl::desc("Pointer size in bits"),
+                                     cl::init(32), cl::cat(SummaryCat));
+
+static void writeFile(const std::string &Path, StringRef Data) {
+  std::error_code EC;
+  raw_fd_ostream OS(Path, EC);
+  if (EC) {
+    std::cerr << "Cannot open output file: " << Path << std::endl;
+    std::cerr << EC.message() << std::endl;
+    std::abort();
+  }
+  OS << Data;
+}
+
+int main(int argc, char *argv[]) {
+  cl::HideUnrelatedOptions(SummaryCat);
+  cl::ParseCommandLineOptions(argc, argv);
+
+  auto BufOrErr = MemoryBuffer::getFile(inputFilename);
+  if (!BufOrErr) {
+    std::cerr << "Cannot open input file: " << inputFilename << std::endl;
+    std::cerr << BufOrErr.getError().message() << std::endl;
+    return 1;
+  }
+  StringRef Buffer = (*BufOrErr)->getBuffer();
+  auto TRCtx = std::make_shared<retypd::TRContext>();
+
+  switch (Mode) {
+  case ToBinary: {
+    auto ValE = json::parse(Buffer);
+    if (!ValE || ValE->getAsObject() == nullptr) {
+      std::cerr << "Error: Input is not a JSON object" << std::endl;
+      return 1;
+    }
+    retypd::ConstraintSummary Summary{{}, PointerSize, {}};
+    Summary.fromJSON(*TRCtx, *ValE->getAsObject());
+    auto Bin = retypd::writeBinarySummary(Summary);
+    if (!Bin) {
+      return 1;
+    }
+    writeFile(outputFilename, *Bin);
+    break;
+  }
+  case ToLibrary: {
+    auto ValE = json::parse(Buffer);
+    if (!ValE || ValE->getAsObject() == nullptr) {
+      std::cerr << "Error: Input is not a JSON object" << std::endl;
+      return 1;
+    }
+    std::map<std::string, std::string> Summaries;
+    for (auto &Ent : *ValE->getAsObject()) {
+      if (Ent.second.getAsObject() == nullptr) {
+        std::cerr << "Error: Summary is not a JSON object: " << Ent.first.str()
+                  << std::endl;
+        return 1;
+      }
+      retypd::ConstraintSummary Summary{{}, PointerSize, {}};
+      Summary.fromJSON(*TRCtx, *Ent.second.getAsObject());
+      auto Bin = retypd::writeBinarySummary(Summary);
+      if (!Bin) {
+        std::cerr << "Error: Cannot convert summary: " << Ent.first.str()
+                  << std::endl;
+        return 1;
+      }
+      Summaries[Ent.first.str()] = std::move(*Bin);
+    }
+    writeFile(outputFilename,
+              retypd::writeBinaryLibrary(Summaries, PointerSize));
+    break;
+  }
+  case ToJSON: {
+    auto Summary = retypd::readBinarySummary(*TRCtx, Buffer);
+    if (!Summary) {
+      return 1;
+    }
+    std::string Out;
+    raw_string_ostream OS(Out);
+    OS << formatv("{0:2}", json::Value(Summary->toJSON()));
+    writeFile(outputFilename, OS.str());
+    break;
+  }
+  case ToDot: {
+    retypd::ConstraintGraph G(TRCtx, PointerSize, "Snapshot");
+    if (!retypd::readBinaryGraph(Buffer, G)) {
+      return 1;
+    }
+    // the requested output, not a debug dump.
+    std::error_code EC;
+    raw_fd_ostream OS(outputFilename, EC);
+    if (EC) {
+      std::cerr << "Cannot open output file: " << outputFilename << std::endl;
+      std::cerr << EC.message() << std::endl;
+      std::abort();
+    }
+    G.printGraph(OS);
+    break;
+  }
+  case FromDot: {
+    auto Graphs = retypd::parseDotSummary(Buffer.str());
+    if (Graphs.size() != 1) {
+      std::cerr << "Error: Expect one graph in the dot file, found "
+                << Graphs.size() << std::endl;
+      return 1;
+    }
+    auto &DG = Graphs.front().second;
+    retypd::ConstraintGraph G(TRCtx, PointerSize,
+                              DG.name.empty() ? "Snapshot" : DG.name);
+    if (!G.fromDotSummary(DG)) {
+      return 1;
+    }
+    writeFile(outputFilename, retypd::writeBinaryGraph(G));
+    break;
+  }
+  }
+  return 0;
+}
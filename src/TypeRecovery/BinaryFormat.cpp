@@ -0,0 +1,828 @@
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include <llvm/Support/raw_ostream.h>
+
+#include "TypeRecovery/BinaryFormat.h"
+
+namespace notdec::retypd {
+
+static const char BinaryMagic[4] = {'N', 'D', 'T', 'R'};
+
+namespace {
+
+enum TVKind : uint32_t { TV_Primitive = 0, TV_Named = 1, TV_IntConstant = 2 };
+
+enum EdgeKind : uint32_t {
+  EK_One = 0,
+  EK_ForgetLabel,
+  EK_ForgetBase,
+  EK_RecallLabel,
+  EK_RecallBase,
+  EK_RecallNode,
+  EK_ForgetNode,
+  EK_RecallString,
+  EK_ForgetString,
+  EK_ForgetSize,
+};
+
+enum SpecialKind : uint32_t {
+  SK_None = 0,
+  SK_Start,
+  SK_End,
+  SK_Memory,
+  SK_MemoryC,
+};
+
+struct ByteWriter {
+  std::string Buf;
+
+  void u32(uint32_t V) {
+    for (int I = 0; I < 4; I++) {
+      Buf.push_back(static_cast<char>((V >> (I * 8)) & 0xff));
+    }
+  }
+  void i64(int64_t V) {
+    uint64_t U = static_cast<uint64_t>(V);
+    u32(static_cast<uint32_t>(U));
+    u32(static_cast<uint32_t>(U >> 32));
+  }
+  void bytes(llvm::StringRef S) {
+    u32(S.size());
+    Buf.append(S.data(), S.size());
+    while (Buf.size() % 4 != 0) {
+      Buf.push_back('\0');
+    }
+  }
+};
+
+struct ByteReader {
+  llvm::StringRef Buf;
+  size_t Pos = 0;
+  bool Failed = false;
+
+  bool has(size_t Size) {
+    if (Failed || Buf.size() - Pos < Size) {
+      Failed = true;
+      return false;
+    }
+    return true;
+  }
+  uint32_t u32() {
+    if (!has(4)) {
+      return 0;
+    }
+    uint32_t V = 0;
+    for (int I = 0; I < 4; I++) {
+      V |= static_cast<uint32_t>(static_cast<uint8_t>(Buf[Pos + I])) << (I * 8);
+    }
+    Pos += 4;
+    return V;
+  }
+  int64_t i64() {
+    uint64_t Lo = u32();
+    uint64_t Hi = u32();
+    return static_cast<int64_t>(Lo | (Hi << 32));
+  }
+  llvm::StringRef bytes() {
+    auto Size = u32();
+    if (!has(Size)) {
+      return "";
+    }
+    auto Ret = Buf.substr(Pos, Size);
+    Pos += (Size + 3) & ~size_t(3);
+    if (Pos > Buf.size()) {
+      Pos = Buf.size();
+    }
+    return Ret;
+  }
+  // element count of a table, each element takes at least MinSize bytes.
+  uint32_t count(size_t MinSize) {
+    auto N = u32();
+    if (!has(N * MinSize)) {
+      return 0;
+    }
+    return N;
+  }
+};
+
+/// Interns strings, field labels and type variables while the body is
+/// encoded. The tables are emitted before the body.
+struct TableWriter {
+  std::map<std::string, uint32_t> StrIds;
+  std::vector<std::string> Strs;
+  std::map<FieldLabel, uint32_t> LabelIds;
+  std::vector<const FieldLabel *> Labels;
+  std::map<TypeVariable, uint32_t> TVIds;
+  std::vector<const TypeVariable *> TVs;
+
+  uint32_t str(const std::string &S) {
+    auto It = StrIds.emplace(S, Strs.size());
+    if (It.second) {
+      Strs.push_back(S);
+    }
+    return It.first->second;
+  }
+  uint32_t label(const FieldLabel &L) {
+    if (auto *In = L.getAs<InLabel>()) {
+      str(In->name);
+    } else if (auto *Out = L.getAs<OutLabel>()) {
+      str(Out->name);
+    }
+    auto It = LabelIds.emplace(L, Labels.size());
+    if (It.second) {
+      Labels.push_back(&It.first->first);
+    }
+    return It.first->second;
+  }
+  uint32_t tv(const TypeVariable &TV) {
+    if (TVIds.count(TV)) {
+      return TVIds.at(TV);
+    }
+    if (TV.isPrimitive()) {
+      str(TV.getPrimitiveName());
+    } else {
+      if (TV.hasBaseName()) {
+        str(TV.getBaseName());
+      }
+      for (auto &L : TV.getLabels()) {
+        label(L);
+      }
+    }
+    auto It = TVIds.emplace(TV, TVs.size());
+    TVs.push_back(&It.first->first);
+    return It.first->second;
+  }
+
+  static void range(ByteWriter &W, const OffsetRange &R) {
+    W.i64(R.offset);
+    W.u32(R.access.size());
+    for (auto &A : R.access) {
+      W.i64(A.Size);
+      W.i64(A.Count);
+    }
+  }
+
+  void write(ByteWriter &W) {
+    W.u32(Strs.size());
+    for (auto &S : Strs) {
+      W.bytes(S);
+    }
+    W.u32(Labels.size());
+    for (auto *L : Labels) {
+      W.u32(L->L.index());
+      if (auto *In = L->getAs<InLabel>()) {
+        W.u32(StrIds.at(In->name));
+      } else if (auto *Out = L->getAs<OutLabel>()) {
+        W.u32(StrIds.at(Out->name));
+      } else if (auto *O = L->getAs<OffsetLabel>()) {
+        range(W, O->range);
+      } else if (auto *Load = L->getAs<LoadLabel>()) {
+        W.u32(Load->Size);
+      } else if (auto *Store = L->getAs<StoreLabel>()) {
+        W.u32(Store->Size);
+      }
+    }
+    W.u32(TVs.size());
+    for (auto *TV : TVs) {
+      if (TV->isPrimitive()) {
+        W.u32(TV_Primitive);
+        W.u32(StrIds.at(TV->getPrimitiveName()));
+        continue;
+      }
+      if (TV->hasBaseName()) {
+        W.u32(TV_Named);
+        W.u32(StrIds.at(TV->getBaseName()));
+      } else {
+        auto BC = std::get<BaseConstant>(TV->getBase());
+        W.u32(TV_IntConstant);
+        range(W, BC.Val);
+        W.i64(BC.OpInd);
+      }
+      W.u32(TV->getLabels().size());
+      for (auto &L : TV->getLabels()) {
+        W.u32(LabelIds.at(L));
+      }
+      W.u32(TV->ContextId.size());
+      for (auto CId : TV->ContextId) {
+        W.i64(static_cast<int64_t>(CId));
+      }
+      W.u32(TV->IsActual);
+    }
+  }
+};
+
+struct TableReader {
+  std::vector<std::string> Strs;
+  std::vector<FieldLabel> Labels;
+  std::vector<TypeVariable> TVs;
+
+  static OffsetRange range(ByteReader &R) {
+    OffsetRange Ret;
+    Ret.offset = R.i64();
+    auto N = R.count(16);
+    for (uint32_t I = 0; I < N; I++) {
+      auto Size = R.i64();
+      auto Count = R.i64();
+      Ret.access.push_back(ArrayOffset{
+          static_cast<decltype(ArrayOffset::Size)>(Size),
+          static_cast<decltype(ArrayOffset::Count)>(Count)});
+    }
+    return Ret;
+  }
+
+  const std::string &str(ByteReader &R) {
+    static const std::string Empty;
+    auto Id = R.u32();
+    if (Id >= Strs.size()) {
+      R.Failed = true;
+      return Empty;
+    }
+    return Strs[Id];
+  }
+
+  bool read(TRContext &Ctx, ByteReader &R) {
+    auto NStr = R.count(4);
+    Strs.reserve(NStr);
+    for (uint32_t I = 0; I < NStr; I++) {
+      Strs.push_back(R.bytes().str());
+    }
+    auto NLabel = R.count(8);
+    Labels.reserve(NLabel);
+    for (uint32_t I = 0; I < NLabel && !R.Failed; I++) {
+      switch (R.u32()) {
+      case 0:
+        Labels.push_back(FieldLabel{InLabel{str(R)}});
+        break;
+      case 1:
+        Labels.push_back(FieldLabel{OutLabel{str(R)}});
+        break;
+      case 2:
+        Labels.push_back(FieldLabel{OffsetLabel{.range = range(R)}});
+        break;
+      case 3:
+        Labels.push_back(FieldLabel{LoadLabel{.Size = R.u32()}});
+        break;
+      case 4:
+        Labels.push_back(FieldLabel{StoreLabel{.Size = R.u32()}});
+        break;
+      default:
+        R.Failed = true;
+      }
+    }
+    auto NTV = R.count(8);
+    TVs.reserve(NTV);
+    for (uint32_t I = 0; I < NTV && !R.Failed; I++) {
+      auto Kind = R.u32();
+      if (Kind == TV_Primitive) {
+        TVs.push_back(TypeVariable::CreatePrimitive(Ctx, str(R)));
+        continue;
+      }
+      DerivedTypeVariable Dtv;
+      if (Kind == TV_Named) {
+        Dtv.Base = str(R);
+      } else if (Kind == TV_IntConstant) {
+        BaseConstant BC;
+        BC.Val = range(R);
+        BC.OpInd = R.i64();
+        Dtv.Base = BC;
+      } else {
+        R.Failed = true;
+        break;
+      }
+      auto NL = R.count(4);
+      for (uint32_t J = 0; J < NL; J++) {
+        auto Id = R.u32();
+        if (Id >= Labels.size()) {
+          R.Failed = true;
+          break;
+        }
+        Dtv.Labels.push_back(Labels[Id]);
+      }
+      auto TV = TypeVariable::CreateDtv(Ctx, Dtv);
+      auto NC = R.count(8);
+      for (uint32_t J = 0; J < NC; J++) {
+        TV.pushContextId(static_cast<TypeVariable::ContextIdTy>(R.i64()));
+      }
+      TV.IsActual = R.u32() != 0;
+      TVs.push_back(TV);
+    }
+    return !R.Failed;
+  }
+
+  const TypeVariable *tv(ByteReader &R) {
+    auto Id = R.u32();
+    if (Id >= TVs.size()) {
+      R.Failed = true;
+      return nullptr;
+    }
+    return &TVs[Id];
+  }
+};
+
+std::string finish(BinaryKind Kind, long PointerSize, TableWriter &Tables,
+                   ByteWriter &Body) {
+  ByteWriter W;
+  W.Buf.append(BinaryMagic, sizeof(BinaryMagic));
+  W.u32(BinaryFormatVersion);
+  W.u32(static_cast<uint32_t>(Kind));
+  W.u32(PointerSize);
+  Tables.write(W);
+  W.Buf += Body.Buf;
+  return std::move(W.Buf);
+}
+
+// Check the header. Return the pointer size.
+std::optional<uint32_t> readHeader(ByteReader &R, BinaryKind Kind) {
+  auto K = getBinaryKind(R.Buf);
+  if (!K || *K != Kind) {
+    llvm::errs() << "Error: Not a NotDec binary file of the expected kind\n";
+    return std::nullopt;
+  }
+  R.Pos = sizeof(BinaryMagic);
+  auto Version = R.u32();
+  if (Version != BinaryFormatVersion) {
+    llvm::errs() << "Error: Unsupported binary format version " << Version
+                 << ", expected " << BinaryFormatVersion << "\n";
+    return std::nullopt;
+  }
+  R.u32();
+  return R.u32();
+}
+
+} // namespace
+
+std::optional<BinaryKind> getBinaryKind(llvm::StringRef Buffer) {
+  if (Buffer.size() < sizeof(BinaryMagic) + 8 ||
+      std::memcmp(Buffer.data(), BinaryMagic, sizeof(BinaryMagic)) != 0) {
+    return std::nullopt;
+  }
+  ByteReader R{Buffer, sizeof(BinaryMagic) + 4};
+  auto Kind = R.u32();
+  if (Kind != static_cast<uint32_t>(BinaryKind::Summary) &&
+      Kind != static_cast<uint32_t>(BinaryKind::Graph) &&
+      Kind != static_cast<uint32_t>(BinaryKind::Library)) {
+    return std::nullopt;
+  }
+  return static_cast<BinaryKind>(Kind);
+}
+
+std::optional<std::string>
+writeBinarySummary(const ConstraintSummary &Summary) {
+  TableWriter Tables;
+  ByteWriter Body;
+  std::vector<const SubTypeConstraint *> Cons;
+  for (auto &C : Summary.Cons) {
+    if (auto *SC = std::get_if<SubTypeConstraint>(&C)) {
+      Cons.push_back(SC);
+    } else {
+      llvm::errs() << "Error: Binary summary only supports subtype "
+                      "constraints: "
+                   << toString(C) << "\n";
+      return std::nullopt;
+    }
+  }
+  Body.u32(Cons.size());
+  for (auto *SC : Cons) {
+    Body.u32(Tables.tv(SC->sub));
+    Body.u32(Tables.tv(SC->sup));
+  }
+  Body.u32(Summary.PNIMap.size());
+  for (auto &Ent : Summary.PNIMap) {
+    Body.u32(Tables.tv(Ent.first));
+    Body.u32(Tables.str(Ent.second));
+  }
+  return finish(BinaryKind::Summary, Summary.PointerSize, Tables, Body);
+}
+
+std::optional<ConstraintSummary> readBinarySummary(TRContext &Ctx,
+                                                   llvm::StringRef Buffer) {
+  ByteReader R{Buffer};
+  auto PointerSize = readHeader(R, BinaryKind::Summary);
+  if (!PointerSize) {
+    return std::nullopt;
+  }
+  TableReader T;
+  if (!T.read(Ctx, R)) {
+    llvm::errs() << "Error: Broken tables in binary summary\n";
+    return std::nullopt;
+  }
+  ConstraintSummary Ret;
+  Ret.PointerSize = *PointerSize;
+  auto NCons = R.count(8);
+  Ret.Cons.reserve(NCons);
+  for (uint32_t I = 0; I < NCons && !R.Failed; I++) {
+    auto *Sub = T.tv(R);
+    auto *Sup = T.tv(R);
+    if (Sub && Sup) {
+      Ret.Cons.push_back(SubTypeConstraint{*Sub, *Sup});
+    }
+  }
+  auto NPNI = R.count(8);
+  for (uint32_t I = 0; I < NPNI && !R.Failed; I++) {
+    auto *TV = T.tv(R);
+    auto &S = T.str(R);
+    if (TV) {
+      Ret.PNIMap[*TV] = S;
+    }
+  }
+  if (R.Failed) {
+    llvm::errs() << "Error: Truncated binary summary\n";
+    return std::nullopt;
+  }
+  return Ret;
+}
+
+std::string writeBinaryGraph(const ConstraintGraph &G) {
+  TableWriter Tables;
+  ByteWriter Body;
+
+  std::map<const CGNode *, uint32_t> NodeIds;
+  std::map<const PNINode *, uint32_t> PNIIds;
+  std::vector<const PNINode *> PNIs;
+  for (auto &N : G.Nodes) {
+    NodeIds.emplace(&N, NodeIds.size());
+    if (G.PG && N.getPNIVar() != nullptr &&
+        PNIIds.emplace(N.getPNIVar(), PNIs.size()).second) {
+      PNIs.push_back(N.getPNIVar());
+    }
+  }
+
+  Body.u32(G.isNotSymmetry);
+  Body.u32(G.isSketchSplit);
+  Body.u32(G.PG != nullptr);
+  Body.u32(PNIs.size());
+  for (auto *PN : PNIs) {
+    Body.u32(Tables.str(PN->getLowTy()));
+  }
+
+  Body.u32(G.Nodes.size());
+  for (auto &N : G.Nodes) {
+    uint32_t Special = SK_None;
+    if (&N == G.Start) {
+      Special = SK_Start;
+    } else if (&N == G.End) {
+      Special = SK_End;
+    } else if (&N == G.Memory) {
+      Special = SK_Memory;
+    } else if (&N == G.MemoryC) {
+      Special = SK_MemoryC;
+    }
+    Body.u32(Special);
+    Body.u32(Tables.tv(N.key.Base));
+    Body.u32(N.key.SuffixVariance);
+    Body.u32(N.key.IsNewLayer);
+    Body.u32(N.Size);
+    Body.u32(PNIIds.count(N.getPNIVar()) ? PNIIds.at(N.getPNIVar()) + 1 : 0);
+  }
+
+  std::vector<const CGEdge *> Edges;
+  for (auto &N : G.Nodes) {
+    for (auto &E : N.outEdges) {
+      Edges.push_back(&E);
+    }
+  }
+  Body.u32(Edges.size());
+  for (auto *E : Edges) {
+    Body.u32(NodeIds.at(&E->getSourceNode()));
+    Body.u32(NodeIds.at(&E->getTargetNode()));
+    auto &L = E->getLabel();
+    Body.u32(L.L.index());
+    if (auto *FL = L.getAs<ForgetLabel>()) {
+      Body.u32(Tables.label(FL->label));
+    } else if (auto *RL = L.getAs<RecallLabel>()) {
+      Body.u32(Tables.label(RL->label));
+    } else if (auto *FB = L.getAs<ForgetBase>()) {
+      Body.u32(Tables.tv(FB->Base));
+      Body.u32(FB->V);
+    } else if (auto *RB = L.getAs<RecallBase>()) {
+      Body.u32(Tables.tv(RB->Base));
+      Body.u32(RB->V);
+    } else if (auto *RN = L.getAs<RecallNode>()) {
+      Body.u32(NodeIds.at(RN->Base));
+    } else if (auto *FN = L.getAs<ForgetNode>()) {
+      Body.u32(NodeIds.at(FN->Base));
+    } else if (auto *RS = L.getAs<RecallString>()) {
+      Body.u32(Tables.str(RS->Base));
+    } else if (auto *FS = L.getAs<ForgetString>()) {
+      Body.u32(Tables.str(FS->Base));
+    } else if (auto *Size = L.getAs<ForgetSize>()) {
+      Body.i64(Size->Base);
+    }
+  }
+
+  auto writeNodeSet = [&](const std::set<CGNode *> &Set) {
+    Body.u32(Set.size());
+    for (auto *N : Set) {
+      Body.u32(NodeIds.at(N));
+    }
+  };
+  writeNodeSet(G.StartNodes);
+  writeNodeSet(G.EndNodes);
+  Body.u32(G.RevVariance.size());
+  for (auto &Ent : G.RevVariance) {
+    Body.u32(NodeIds.at(Ent.first));
+    Body.u32(NodeIds.at(Ent.second));
+  }
+  return finish(BinaryKind::Graph, G.PointerSize, Tables, Body);
+}
+
+bool readBinaryGraph(llvm::StringRef Buffer, ConstraintGraph &G) {
+  assert(G.Nodes.empty() && "readBinaryGraph: graph is not empty");
+  ByteReader R{Buffer};
+  auto PointerSize = readHeader(R, BinaryKind::Graph);
+  if (!PointerSize) {
+    return false;
+  }
+  if (*PointerSize != G.PointerSize) {
+    llvm::errs() << "Error: Pointer size mismatch in binary graph: "
+                 << *PointerSize << " vs " << G.PointerSize << "\n";
+    return false;
+  }
+  TableReader T;
+  if (!T.read(*G.Ctx, R)) {
+    llvm::errs() << "Error: Broken tables in binary graph\n";
+    return false;
+  }
+  G.isNotSymmetry = R.u32() != 0;
+  G.isSketchSplit = R.u32() != 0;
+  bool HasPNI = R.u32() != 0 && G.PG != nullptr;
+
+  auto NPNI = R.count(4);
+  std::vector<std::string> PNITys;
+  for (uint32_t I = 0; I < NPNI; I++) {
+    PNITys.push_back(T.str(R));
+  }
+  std::vector<PNINode *> PNIs(NPNI, nullptr);
+
+  auto NNodes = R.count(24);
+  std::vector<CGNode *> Nodes;
+  Nodes.reserve(NNodes);
+  for (uint32_t I = 0; I < NNodes && !R.Failed; I++) {
+    auto Special = R.u32();
+    auto *TV = T.tv(R);
+    Variance V = R.u32() != 0;
+    bool IsNewLayer = R.u32() != 0;
+    auto Size = R.u32();
+    auto PNIRef = R.u32();
+    if (TV == nullptr || PNIRef > NPNI) {
+      R.Failed = true;
+      break;
+    }
+    CGNode *N = nullptr;
+    if (Special == SK_Start) {
+      N = G.getStartNode();
+    } else if (Special == SK_End) {
+      N = G.getEndNode();
+    } else if (Special == SK_Memory || Special == SK_MemoryC) {
+      N = G.getMemoryNode(Special == SK_Memory ? Covariant : Contravariant);
+      // keep the PNI of the memory node, merge other users into it.
+      if (HasPNI && PNIRef != 0) {
+        auto *&PN = PNIs[PNIRef - 1];
+        if (PN == nullptr) {
+          PN = N->getPNIVar();
+        } else {
+          PN = G.PG->mergePNINodes(N->getPNIVar(), PN);
+        }
+      }
+    } else {
+      NodeKey Key(*TV, V);
+      Key.IsNewLayer = IsNewLayer;
+      if (HasPNI && PNIRef != 0) {
+        auto *&PN = PNIs[PNIRef - 1];
+        if (PN == nullptr) {
+          PN = G.PG->createPNINode(PNITys[PNIRef - 1]);
+        }
+        N = &G.createNodeWithPNI(Key, PN);
+      } else {
+        N = &G.createNodeNoPNI(Key, Size);
+      }
+    }
+    Nodes.push_back(N);
+  }
+
+  auto node = [&]() -> CGNode * {
+    auto Id = R.u32();
+    if (Id >= Nodes.size()) {
+      R.Failed = true;
+      return nullptr;
+    }
+    return Nodes[Id];
+  };
+
+  auto NEdges = R.count(12);
+  for (uint32_t I = 0; I < NEdges && !R.Failed; I++) {
+    auto *From = node();
+    auto *To = node();
+    auto Kind = R.u32();
+    std::optional<EdgeLabel> L;
+    switch (Kind) {
+    case EK_One:
+      L = EdgeLabel{One{}};
+      break;
+    case EK_ForgetLabel:
+    case EK_RecallLabel: {
+      auto Id = R.u32();
+      if (Id >= T.Labels.size()) {
+        R.Failed = true;
+        break;
+      }
+      if (Kind == EK_ForgetLabel) {
+        L = EdgeLabel{ForgetLabel{T.Labels[Id]}};
+      } else {
+        L = EdgeLabel{RecallLabel{T.Labels[Id]}};
+      }
+      break;
+    }
+    case EK_ForgetBase:
+    case EK_RecallBase: {
+      auto *TV = T.tv(R);
+      Variance V = R.u32() != 0;
+      if (TV == nullptr) {
+        break;
+      }
+      if (Kind == EK_ForgetBase) {
+        L = EdgeLabel{ForgetBase{.Base = *TV, .V = V}};
+      } else {
+        L = EdgeLabel{RecallBase{.Base = *TV, .V = V}};
+      }
+      break;
+    }
+    case EK_RecallNode:
+      L = EdgeLabel{RecallNode{node()}};
+      break;
+    case EK_ForgetNode:
+      L = EdgeLabel{ForgetNode{node()}};
+      break;
+    case EK_RecallString:
+      L = EdgeLabel{RecallString{T.str(R)}};
+      break;
+    case EK_ForgetString:
+      L = EdgeLabel{ForgetString{T.str(R)}};
+      break;
+    case EK_ForgetSize:
+      L = EdgeLabel{ForgetSize{R.i64()}};
+      break;
+    default:
+      R.Failed = true;
+    }
+    if (R.Failed || !L) {
+      R.Failed = true;
+      break;
+    }
+    G.onlyAddEdge(*From, *To, *L);
+  }
+
+  auto readNodeSet = [&](std::set<CGNode *> &Set) {
+    auto N = R.count(4);
+    for (uint32_t I = 0; I < N && !R.Failed; I++) {
+      if (auto *Node = node()) {
+        Set.insert(Node);
+      }
+    }
+  };
+  readNodeSet(G.StartNodes);
+  readNodeSet(G.EndNodes);
+  auto NRev = R.count(8);
+  for (uint32_t I = 0; I < NRev && !R.Failed; I++) {
+    auto *N1 = node();
+    auto *N2 = node();
+    if (N1 && N2) {
+      G.RevVariance.insert({N1, N2});
+    }
+  }
+  if (R.Failed) {
+    llvm::errs() << "Error: Truncated binary graph\n";
+    return false;
+  }
+  return true;
+}
+
+std::string
+writeBinaryLibrary(const std::map<std::string, std::string> &Summaries,
+                   long PointerSize) {
+  // single function entries first, each part sorted by name.
+  std::vector<const std::pair<const std::string, std::string> *> Sorted;
+  for (auto &Ent : Summaries) {
+    Sorted.push_back(&Ent);
+  }
+  std::stable_partition(Sorted.begin(), Sorted.end(), [](auto *Ent) {
+    return Ent->first.find(',') == std::string::npos;
+  });
+  uint32_t NumSingle = 0;
+  for (auto *Ent : Sorted) {
+    if (Ent->first.find(',') == std::string::npos) {
+      NumSingle++;
+    }
+  }
+
+  ByteWriter W;
+  W.Buf.append(BinaryMagic, sizeof(BinaryMagic));
+  W.u32(BinaryFormatVersion);
+  W.u32(static_cast<uint32_t>(BinaryKind::Library));
+  W.u32(PointerSize);
+  W.u32(Sorted.size());
+  W.u32(NumSingle);
+  auto Align = [](size_t Off) { return (Off + 3) & ~size_t(3); };
+  // names and summaries are laid out after the index.
+  size_t Off = W.Buf.size() + Sorted.size() * 16;
+  for (auto *Ent : Sorted) {
+    W.u32(Off);
+    W.u32(Ent->first.size());
+    Off = Align(Off + Ent->first.size());
+    W.u32(Off);
+    W.u32(Ent->second.size());
+    Off = Align(Off + Ent->second.size());
+  }
+  for (auto *Ent : Sorted) {
+    for (auto *S : {&Ent->first, &Ent->second}) {
+      W.Buf += *S;
+      W.Buf.resize(Align(W.Buf.size()), '\0');
+    }
+  }
+  assert(W.Buf.size() == Off);
+  return std::move(W.Buf);
+}
+
+std::unique_ptr<SummaryLibrary>
+SummaryLibrary::open(const std::string &Path) {
+  // large files are mmapped by MemoryBuffer.
+  auto BufOrErr = llvm::MemoryBuffer::getFile(Path, /*IsText=*/false,
+                                              /*RequiresNullTerminator=*/false);
+  if (!BufOrErr) {
+    llvm::errs() << "Error: Cannot open summary library " << Path << ": "
+                 << BufOrErr.getError().message() << "\n";
+    return nullptr;
+  }
+  return create(std::move(*BufOrErr));
+}
+
+std::unique_ptr<SummaryLibrary>
+SummaryLibrary::create(std::unique_ptr<llvm::MemoryBuffer> Buffer) {
+  ByteReader R{Buffer->getBuffer()};
+  auto PointerSize = readHeader(R, BinaryKind::Library);
+  if (!PointerSize) {
+    return nullptr;
+  }
+  std::unique_ptr<SummaryLibrary> Lib(new SummaryLibrary());
+  Lib->PointerSize = *PointerSize;
+  auto N = R.count(16);
+  Lib->NumSingle = R.u32();
+  if (!R.has(N * 16) || Lib->NumSingle > N) {
+    llvm::errs() << "Error: Broken summary library index\n";
+    return nullptr;
+  }
+  auto Slice = [&](uint32_t Off, uint32_t Size) -> std::optional<llvm::StringRef> {
+    if (Off > R.Buf.size() || R.Buf.size() - Off < Size) {
+      return std::nullopt;
+    }
+    return R.Buf.substr(Off, Size);
+  };
+  Lib->Entries.reserve(N);
+  for (uint32_t I = 0; I < N; I++) {
+    auto NameOff = R.u32();
+    auto NameSize = R.u32();
+    auto SumOff = R.u32();
+    auto SumSize = R.u32();
+    auto Name = Slice(NameOff, NameSize);
+    auto Sum = Slice(SumOff, SumSize);
+    if (!Name || !Sum) {
+      llvm::errs() << "Error: Broken summary library entry " << I << "\n";
+      return nullptr;
+    }
+    Lib->Entries.push_back({*Name, *Sum});
+  }
+  auto Less = [](const Entry &A, const Entry &B) { return A.Name < B.Name; };
+  if (!std::is_sorted(Lib->Entries.begin(),
+                      Lib->Entries.begin() + Lib->NumSingle, Less)) {
+    llvm::errs() << "Error: Summary library index is not sorted\n";
+    return nullptr;
+  }
+  Lib->Buffer = std::move(Buffer);
+  return Lib;
+}
+
+std::optional<llvm::StringRef>
+SummaryLibrary::lookup(llvm::StringRef FuncName) const {
+  auto End = Entries.begin() + NumSingle;
+  auto It = std::lower_bound(
+      Entries.begin(), End, FuncName,
+      [](const Entry &E, llvm::StringRef Name) { return E.Name < Name; });
+  if (It == End || It->Name != FuncName) {
+    return std::nullopt;
+  }
+  return It->Summary;
+}
+
+std::vector<std::pair<llvm::StringRef, llvm::StringRef>>
+SummaryLibrary::multiFunctionEntries() const {
+  std::vector<std::pair<llvm::StringRef, llvm::StringRef>> Ret;
+  for (auto It = Entries.begin() + NumSingle; It != Entries.end(); ++It) {
+    Ret.emplace_back(It->Name, It->Summary);
+  }
+  return Ret;
+}
+
+} // namespace notdec::retypd
@@ -6,6 +6,7 @@
 #include <ctime>
 #include <deque>
 #include <iostream>
+#include <llvm/ADT/Hashing.h>
 #include <llvm/ADT/Optional.h>
 #include <llvm/ADT/STLExtras.h>
 #include <llvm/ADT/iterator_range.h>
@@ -26,7 +27,9 @@
 #include <llvm/Support/raw_ostream.h>
 
 #include "Passes/ConstraintGenerator.h"
+#include "TypeRecovery/BinaryFormat.h"
 #include "TypeRecovery/ConstraintGraph.h"
+#include "TypeRecovery/DotSummaryParser.h"
 #include "TypeRecovery/LowTy.h"
 #include "TypeRecovery/NFAMinimize.h"
 #include "TypeRecovery/Parser.h"
@@ -34,7 +37,10 @@
 #include "TypeRecovery/RExp.h"
 #include "TypeRecovery/retypd/Schema.h"
 #include "TypeRecovery/TRContext.h"
+#include "Utils/DebugDump.h"
+#include "Utils/MemoryReport.h"
 #include "Utils/Utils.h"
+#include "Utils/ValueNamerLock.h"
 #include "notdec-llvm2c/Interface/Range.h"
 #include "notdec-llvm2c/Interface/ValueNamer.h"
 
@@ -162,6 +168,19 @@ void ConstraintSummary::fromJSON(TRContext &Ctx,
   }
 }
 
+llvm::json::Object ConstraintSummary::toJSON() const {
+  json::Array Constraints;
+  for (auto &C : Cons) {
+    Constraints.push_back(json::Value(toString(C)));
+  }
+  json::Object PNI;
+  for (auto &Ent : PNIMap) {
+    PNI.insert({toString(Ent.first), Ent.second});
+  }
+  return json::Object(
+      {{"constraints", std::move(Constraints)}, {"pni_map", std::move(PNI)}});
+}
+
 llvm::Optional<std::pair<bool, OffsetRange>>
 EdgeLabel2Offset(const EdgeLabel &E) {
   if (auto OL = E.getAs<ForgetLabel>()) {
@@ -202,20 +221,110 @@ void CGNode::removeOutEdges() {
   }
 }
 
+// Only recall offset edges are indexed, the ones that describe the layout.
+static const OffsetLabel *getRecallOffset(const EdgeLabel &L) {
+  if (auto *RL = L.getAs<RecallLabel>()) {
+    return RL->label.getAs<OffsetLabel>();
+  }
+  return nullptr;
+}
+
+void CGNode::indexOffsetEdge(const CGEdge &E) {
+  if (auto *OL = getRecallOffset(E.getLabel())) {
+    OffsetEdges.emplace(OL->range.offset, &E);
+  }
+}
+
+void CGNode::unindexOffsetEdge(const CGEdge &E) {
+  auto *OL = getRecallOffset(E.getLabel());
+  if (OL == nullptr) {
+    return;
+  }
+  auto [Begin, End] = OffsetEdges.equal_range(OL->range.offset);
+  for (auto It = Begin; It != End; ++It) {
+    if (It->second == &E) {
+      OffsetEdges.erase(It);
+      return;
+    }
+  }
+  assert(false && "unindexOffsetEdge: edge is not indexed");
+}
+
 void CGNode::removeAllEdges() {
   removeOutEdges();
   removeInEdges();
 }
 
+CGEdge::CGEdge(CGNode &From, CGNode &Target, const EdgeLabel &L)
+    : FromNode(From), TargetNode(Target) {
+  setLabel(L);
+}
+
+void CGEdge::setLabel(const EdgeLabel &L) {
+  auto &Pool = FromNode.Parent.Labels;
+  LabelId = Pool.intern(L);
+  Label = &Pool.get(LabelId);
+}
+
+static llvm::hash_code hashFieldLabel(const FieldLabel &F) {
+  llvm::hash_code H = llvm::hash_value(F.L.index());
+  if (auto *In = F.getAs<InLabel>()) {
+    return llvm::hash_combine(H, In->name);
+  } else if (auto *Out = F.getAs<OutLabel>()) {
+    return llvm::hash_combine(H, Out->name);
+  } else if (auto *Off = F.getAs<OffsetLabel>()) {
+    return llvm::hash_combine(H, Off->range.offset);
+  } else if (auto *Load = F.getAs<LoadLabel>()) {
+    return llvm::hash_combine(H, Load->Size);
+  } else if (auto *Store = F.getAs<StoreLabel>()) {
+    return llvm::hash_combine(H, Store->Size);
+  }
+  return H;
+}
+
+static llvm::hash_code hashTypeVar(const TypeVariable &TV) {
+  return llvm::hash_combine(
+      TV.Var, llvm::hash_combine_range(TV.ContextId.begin(), TV.ContextId.end()),
+      TV.IsActual);
+}
+
+std::size_t EdgeLabelHash::operator()(const EdgeLabel &L) const {
+  llvm::hash_code H = llvm::hash_value(L.L.index());
+  if (auto *FL = L.getAs<ForgetLabel>()) {
+    return llvm::hash_combine(H, hashFieldLabel(FL->label));
+  } else if (auto *RL = L.getAs<RecallLabel>()) {
+    return llvm::hash_combine(H, hashFieldLabel(RL->label));
+  } else if (auto *FB = L.getAs<ForgetBase>()) {
+    return llvm::hash_combine(H, hashTypeVar(FB->Base), FB->V);
+  } else if (auto *RB = L.getAs<RecallBase>()) {
+    return llvm::hash_combine(H, hashTypeVar(RB->Base), RB->V);
+  } else if (auto *RN = L.getAs<RecallNode>()) {
+    return llvm::hash_combine(H, RN->Base);
+  } else if (auto *FN = L.getAs<ForgetNode>()) {
+    return llvm::hash_combine(H, FN->Base);
+  } else if (auto *RS = L.getAs<RecallString>()) {
+    return llvm::hash_combine(H, RS->Base);
+  } else if (auto *FS = L.getAs<ForgetString>()) {
+    return llvm::hash_combine(H, FS->Base);
+  } else if (auto *Size = L.getAs<ForgetSize>()) {
+    return llvm::hash_combine(H, Size->Base);
+  }
+  return H;
+}
+
 void CGNode::remapLabel(std::map<EdgeLabel, EdgeLabel> &Map) {
   std::vector<CGEdge> Edges;
   for (auto It = outEdges.begin(); It != outEdges.end();) {
-    auto Label = It->Label;
+    auto Label = It->getLabel();
     if (Map.count(Label)) {
+      unindexOffsetEdge(*It);
       auto Ent = outEdges.extract(It++);
       assert(!Ent.empty());
-      Ent.value().Label = Map.at(Label);
-      outEdges.insert(std::move(Ent));
+      Ent.value().setLabel(Map.at(Label));
+      auto Ret = outEdges.insert(std::move(Ent));
+      if (Ret.inserted) {
+        indexOffsetEdge(*Ret.position);
+      }
     } else {
       It++;
     }
@@ -236,18 +345,18 @@ ConstraintGraph::mergeNodeTo(CGNode &From, CGNode &To, bool NoSelfLoop) {
     // for self loop
     if (Target == &To || Target == &From) {
       // only keep non-one edge
-      if (!Edge.Label.isOne()) {
+      if (!Edge.getLabel().isOne()) {
         assert(!NoSelfLoop);
-        auto NE = onlyAddEdge(To, To, Edge.Label);
+        auto NE = onlyAddEdge(To, To, Edge.getLabel());
         EdgeMap.emplace(&Edge, NE);
       }
       // removeEdge(From, *Target, Edge.Label);
-      toRemove.push_back({&From, Target, Edge.Label});
+      toRemove.push_back({&From, Target, Edge.getLabel()});
     } else {
-      auto NE = onlyAddEdge(To, Edge.TargetNode, Edge.Label);
+      auto NE = onlyAddEdge(To, Edge.TargetNode, Edge.getLabel());
       EdgeMap.emplace(&Edge, NE);
       // removeEdge(From, Edge.TargetNode, Edge.Label);
-      toRemove.push_back({&From, &Edge.TargetNode, Edge.Label});
+      toRemove.push_back({&From, &Edge.TargetNode, Edge.getLabel()});
     }
   }
   // Move all in edges
@@ -255,18 +364,18 @@ ConstraintGraph::mergeNodeTo(CGNode &From, CGNode &To, bool NoSelfLoop) {
     auto *Source = &Edge->getSourceNode();
     if (Source == &From || Source == &To) {
       // only keep non-one edge
-      if (!Edge->Label.isOne()) {
+      if (!Edge->getLabel().isOne()) {
         assert(!NoSelfLoop);
-        auto NE = onlyAddEdge(To, To, Edge->Label);
+        auto NE = onlyAddEdge(To, To, Edge->getLabel());
         EdgeMap.emplace(Edge, NE);
       }
       // removeEdge(To, From, Edge->getLabel());
-      toRemove.push_back({Source, &From, Edge->Label});
+      toRemove.push_back({Source, &From, Edge->getLabel()});
     } else {
       auto NE = onlyAddEdge(Edge->getSourceNode(), To, Edge->getLabel());
       EdgeMap.emplace(Edge, NE);
       // removeEdge(Edge->getSourceNode(), From, Edge->getLabel());
-      toRemove.push_back({&Edge->getSourceNode(), &From, Edge->Label});
+      toRemove.push_back({&Edge->getSourceNode(), &From, Edge->getLabel()});
     }
   }
   for (auto &[From, Target, Label] : toRemove) {
@@ -500,7 +609,7 @@ std::vector<SubTypeConstraint> ConstraintGraph::toConstraints() {
   for (auto &Source : Nodes) {
     for (auto &Edge : Source.outEdges) {
       auto &Target = const_cast<CGNode &>(Edge.getTargetNode());
-      if (Edge.Label.isOne()) {
+      if (Edge.getLabel().isOne()) {
         ret.push_back(
             SubTypeConstraint{.sub = Source.key.Base, .sup = Target.key.Base});
       }
@@ -796,18 +905,18 @@ void ConstraintGraph::contraVariantSplit() {
     bool HasRecall = false;
     bool HasForget = false;
     for (auto &Edge : Source.outEdges) {
-      if (isRecall(Edge.Label)) {
+      if (isRecall(Edge.getLabel())) {
         HasRecall = true;
       }
-      if (isForget(Edge.Label)) {
+      if (isForget(Edge.getLabel())) {
         HasForget = true;
       }
     }
     for (auto Edge : Source.inEdges) {
-      if (isRecall(Edge->Label)) {
+      if (isRecall(Edge->getLabel())) {
         HasRecall = true;
       }
-      if (isForget(Edge->Label)) {
+      if (isForget(Edge->getLabel())) {
         HasForget = true;
       }
     }
@@ -824,19 +933,19 @@ void ConstraintGraph::contraVariantSplit() {
     // Move all incoming recall edge to the new node.
     std::set<std::tuple<CGNode *, CGNode *, EdgeLabel>> toRemove;
     for (auto InEdge2 : N->inEdges) {
-      if (isRecall(InEdge2->Label)) {
-        addEdge(InEdge2->getSourceNode(), NewNode, InEdge2->Label);
+      if (isRecall(InEdge2->getLabel())) {
+        addEdge(InEdge2->getSourceNode(), NewNode, InEdge2->getLabel());
         // removeEdge(InEdge2->getSourceNode(), *N, InEdge2->Label);
-        toRemove.insert({&InEdge2->getSourceNode(), N, InEdge2->Label});
+        toRemove.insert({&InEdge2->getSourceNode(), N, InEdge2->getLabel()});
       }
     }
     // Move all outgoing recall edge to the new node.
     for (auto &Edge : N->outEdges) {
-      if (isRecall(Edge.Label)) {
+      if (isRecall(Edge.getLabel())) {
         auto &Target2 = const_cast<CGNode &>(Edge.getTargetNode());
-        addEdge(NewNode, Target2, Edge.Label);
+        addEdge(NewNode, Target2, Edge.getLabel());
         // removeEdge(*N, Target2, Edge.Label);
-        toRemove.insert({N, &Target2, Edge.Label});
+        toRemove.insert({N, &Target2, Edge.getLabel()});
       }
     }
     for (auto &[From, To, Label] : toRemove) {
@@ -952,9 +1061,9 @@ void ConstraintGraph::pushSplit() {
         auto InComingRecall = InEdge->getLabel();
         // find the forget edge
         for (auto OutEdge : Current->outEdges) {
-          if (isForget(OutEdge.Label) &&
+          if (isForget(OutEdge.getLabel()) &&
               hasSameBaseOrLabel(InEdge->getLabel(), OutEdge.getLabel())) {
-            auto OutGoingForget = OutEdge.Label;
+            auto OutGoingForget = OutEdge.getLabel();
             auto &Target = OutEdge.getTargetNode();
             if (false) {
               std::cerr << "Removing a path from " << toString(Source.key)
@@ -991,7 +1100,7 @@ void ConstraintGraph::pushSplit() {
     // copy all out edges except the forget edge.
     for (auto &Edge : Current->outEdges) {
       auto &Target2 = const_cast<CGNode &>(Edge.getTargetNode());
-      if (Edge.Label != Forget) {
+      if (Edge.getLabel() != Forget) {
         addEdge(NewNode, Target2, Edge.getLabel());
       }
     }
@@ -1153,7 +1262,7 @@ std::set<OffsetRange> calcOffset(rexp::PRExp E) {
 unsigned countLoadOrStoreEdge(CGNode &N) {
   unsigned Count = 0;
   for (auto &Edge : N.outEdges) {
-    if (retypd::isLoadOrStore(Edge.Label)) {
+    if (retypd::isLoadOrStore(Edge.getLabel())) {
       Count += 1;
     }
   }
@@ -1163,7 +1272,7 @@ unsigned countLoadOrStoreEdge(CGNode &N) {
 const CGEdge *getOnlyLoadOrStoreEdge(CGNode &N) {
   const retypd::CGEdge *LoadEdge = nullptr;
   for (auto &Edge : N.outEdges) {
-    if (retypd::isLoadOrStore(Edge.Label)) {
+    if (retypd::isLoadOrStore(Edge.getLabel())) {
       assert(LoadEdge == nullptr);
       LoadEdge = &Edge;
     }
@@ -1177,12 +1286,12 @@ bool hasOffsetEdge(CGNode &Start) {
   bool HasOffset = false;
   // Outgoing
   for (auto &Edge : Start.outEdges) {
-    if (auto EL1 = Edge.Label.getAs<RecallLabel>()) {
+    if (auto EL1 = Edge.getLabel().getAs<RecallLabel>()) {
       if (EL1->label.isOffset()) {
         HasOffset = true;
         break;
       }
-    } else if (auto EL2 = Edge.Label.getAs<ForgetLabel>()) {
+    } else if (auto EL2 = Edge.getLabel().getAs<ForgetLabel>()) {
       if (EL2->label.isOffset()) {
         HasOffset = true;
         break;
@@ -1312,7 +1421,7 @@ void ConstraintGraph::buildPathSequence() {
       // auto Or = std::make_shared<rexp::RExp>(rexp::Or{});
       for (auto &Edge : N->outEdges) {
         if (&Edge.getTargetNode() == N) {
-          OrInner.insert(rexp::create(Edge.Label));
+          OrInner.insert(rexp::create(Edge.getLabel()));
         }
       }
       if (OrInner.size() > 0) {
@@ -1327,7 +1436,7 @@ void ConstraintGraph::buildPathSequence() {
         auto &Target = const_cast<CGNode &>(E.getTargetNode());
         // Add the edge to the path sequence.
         if (SCC.count(&Target) == 0) {
-          PathSeq.emplace_back(N, &Target, rexp::create(E.Label));
+          PathSeq.emplace_back(N, &Target, rexp::create(E.getLabel()));
         }
       }
     }
@@ -1373,15 +1482,15 @@ void ConstraintGraph::layerSplit() {
       }
       auto &NewSrcNode = *Old2New.at(&Source);
       auto &NewDstNode = *Old2New.at(&Target);
-      if (isRecall(Edge.Label)) {
+      if (isRecall(Edge.getLabel())) {
         continue;
       }
       // Copy the non-Recall edge to the new layer.
-      addEdge(NewSrcNode, NewDstNode, Edge.Label);
+      addEdge(NewSrcNode, NewDstNode, Edge.getLabel());
       // Update the Forget edge to target the new layer.
-      if (isForget(Edge.Label)) {
+      if (isForget(Edge.getLabel())) {
         // Edge reference will be invalidated. Edge changes is deferred.
-        toChange.emplace_back(&Source, &Target, &NewDstNode, Edge.Label);
+        toChange.emplace_back(&Source, &Target, &NewDstNode, Edge.getLabel());
       }
     }
   }
@@ -1470,7 +1579,7 @@ void ConstraintGraph::ensureNoForgetLabel() {
       continue;
     }
     for (auto &Edge : Source.outEdges) {
-      if (Edge.Label.isForgetLabel()) {
+      if (Edge.getLabel().isForgetLabel()) {
         std::cerr << "Error: ensureNoForgetLabel: forget label found: "
                   << toString(Source.key) << " -> "
                   << toString(Edge.getTargetNode().key) << "\n";
@@ -1489,15 +1598,15 @@ void ConstraintGraph::sketchSplit() {
     // 1.1 remove all forgetLabel and RecallBase edge
     for (auto &Edge : Source.outEdges) {
       // auto &Target = const_cast<CGNode &>(Edge.getTargetNode());
-      if (Edge.Label.isForgetLabel()) {
+      if (Edge.getLabel().isForgetLabel()) {
         toRemove.push_back(&Edge);
         // removeEdge(Source, Target, Edge.Label);
         // continue;
-      } else if (Edge.Label.isRecallBase()) {
+      } else if (Edge.getLabel().isRecallBase()) {
         toRemove.push_back(&Edge);
         // removeEdge(Source, Target, Edge.Label);
         // continue;
-      } else if (Edge.Label.isOne() && Node.key.Base.isPrimitive() &&
+      } else if (Edge.getLabel().isOne() && Node.key.Base.isPrimitive() &&
                  Edge.getTargetNode().key.Base.isPrimitive()) {
         // one edge between primitive is invalid.
         toRemove.push_back(&Edge);
@@ -1534,7 +1643,7 @@ std::set<CGNode *> getOneReachable(CGNode &N) {
     }
     Visited.insert(Current);
     for (auto &Edge : Current->outEdges) {
-      if (Edge.Label.isOne()) {
+      if (Edge.getLabel().isOne()) {
         Q.push(const_cast<CGNode *>(&Edge.getTargetNode()));
       }
     }
@@ -1560,7 +1669,7 @@ bool canReach(CGNode &From, CGNode &To) {
       return true;
     }
     for (auto &Edge : Current->outEdges) {
-      if (Edge.Label.isOne()) {
+      if (Edge.getLabel().isOne()) {
         Q.push(const_cast<CGNode *>(&Edge.getTargetNode()));
       }
     }
@@ -1642,7 +1751,7 @@ void ConstraintGraph::saturate() {
       auto N = PopWorklist();
       // 传递ReachingSet
       for (auto &Edge : N->outEdges) {
-        if (Edge.Label.isOne()) {
+        if (Edge.getLabel().isOne()) {
           auto &Target = const_cast<CGNode &>(Edge.getTargetNode());
           // For each One edge.
           if (ReachingSet.count(N)) {
@@ -1676,7 +1785,7 @@ void ConstraintGraph::saturate() {
   for (auto &Source : Nodes) {
     for (auto &Edge : Source.outEdges) {
       // For each edge, check if is forget edge.
-      if (auto Capa = Edge.Label.getAs<ForgetLabel>()) {
+      if (auto Capa = Edge.getLabel().getAs<ForgetLabel>()) {
         auto &Target = const_cast<CGNode &>(Edge.getTargetNode());
         if (DenseSubtype) {
           if (!Capa->label.isOffset()) {
@@ -1703,7 +1812,7 @@ void ConstraintGraph::saturate() {
     // begin: For each recall edge,
     for (auto &Source : Nodes) {
       for (auto &Edge : Source.outEdges) {
-        if (auto Capa = Edge.Label.getAs<RecallLabel>()) {
+        if (auto Capa = Edge.getLabel().getAs<RecallLabel>()) {
           auto &Target = const_cast<CGNode &>(Edge.getTargetNode());
           // end: for each recall edge.
           if (ReachingSet.count(&Source)) {
@@ -2019,6 +2128,38 @@ CGNode &ConstraintGraph::cloneNode(const CGNode &Other) {
   return N;
 }
 
+std::size_t ConstraintGraph::getNumEdges() const {
+  std::size_t Edges = 0;
+  for (auto &N : Nodes) {
+    Edges += N.outEdges.size();
+  }
+  return Edges;
+}
+
+std::size_t ConstraintGraph::estimateBytes() const {
+  std::size_t Bytes = estimateListBytes<CGNode>(Nodes.size());
+  for (auto &N : Nodes) {
+    Bytes += estimateTreeBytes<CGEdge>(N.outEdges.size()) +
+             estimateTreeBytes<CGEdge *>(N.inEdges.size()) +
+             estimateTreeBytes<std::pair<const OffsetTy, const CGEdge *>>(
+                 N.OffsetEdges.size());
+  }
+  Bytes += estimateTreeBytes<std::pair<CGNode *const, CGNode *>>(
+      RevVariance.size());
+  Bytes += estimateTreeBytes<CGNode *>(StartNodes.size() + EndNodes.size());
+  Bytes += PathSeq.capacity() * sizeof(decltype(PathSeq)::value_type);
+  Bytes += Labels.estimateBytes();
+  for (auto &Ent : ReachingSet) {
+    Bytes += estimateTreeBytes<decltype(ReachingSet)::value_type>(1) +
+             estimateTreeBytes<std::pair<FieldLabel, CGNode *>>(
+                 Ent.second.size());
+  }
+  if (PG) {
+    Bytes += PG->estimateBytes();
+  }
+  return Bytes;
+}
+
 void ConstraintGraph::removeNode(CGNode &Node) {
   assert(&Node.Parent == this && "removeNode: node not found");
   assert(!Node.isSpecial());
@@ -2042,16 +2183,174 @@ void ConstraintGraph::removeNode(CGNode &Node) {
 }
 
 void ConstraintGraph::printGraph(const char *DotFile) const {
-  std::error_code EC;
-  llvm::raw_fd_ostream OutStream(DotFile, EC);
-  if (EC) {
-    llvm::errs() << "ConstraintGraph::printGraph: Error printing to " << DotFile
-                 << ", " << EC.message() << "\n";
+  auto &Dump = DebugDump::get();
+  if (Dump.dumpsBinaryGraphs()) {
+    if (!Dump.admit()) {
+      return;
+    }
+    llvm::StringRef Path(DotFile);
+    Path.consume_back(".dot");
+    Dump.write((Path + ".bin").str(), writeBinaryGraph(*this));
     return;
   }
-  llvm::WriteGraph(OutStream, const_cast<ConstraintGraph *>(this), false);
-  OutStream.flush();
-  OutStream.close();
+  Dump.render(DotFile, [&](llvm::raw_ostream &OS) { printGraph(OS); });
+}
+
+void ConstraintGraph::printGraph(llvm::raw_ostream &OS) const {
+  llvm::WriteGraph(OS, const_cast<ConstraintGraph *>(this), false);
+}
+
+// Parse the whole string as a type variable.
+static std::optional<TypeVariable>
+parseWholeTypeVariable(TRContext &Ctx, llvm::StringRef Str, long PointerSize) {
+  auto [Rest, R] = parseTypeVariable(Ctx, Str, PointerSize);
+  if (!R.isOk() || !skipWhitespace(Rest).empty()) {
+    return std::nullopt;
+  }
+  return R.get();
+}
+
+// Split the variance suffix of NodeKey::str and ForgetBase/RecallBase labels.
+static std::optional<Variance> consumeVariance(llvm::StringRef &Str) {
+  if (Str.consume_back(toString(Covariant))) {
+    return Covariant;
+  }
+  if (Str.consume_back(toString(Contravariant))) {
+    return Contravariant;
+  }
+  return std::nullopt;
+}
+
+// Inverse of toString(EdgeLabel), except for node and string labels.
+static std::optional<EdgeLabel> parseDotEdgeLabel(TRContext &Ctx,
+                                                  llvm::StringRef Str,
+                                                  long PointerSize) {
+  if (Str == "_1_") {
+    return EdgeLabel{One{}};
+  }
+  bool IsForget = Str.consume_front("forget ");
+  if (!IsForget && !Str.consume_front("recall ")) {
+    return std::nullopt;
+  }
+  if (IsForget && Str.consume_front("size ")) {
+    int64_t Size;
+    if (Str.getAsInteger(10, Size)) {
+      return std::nullopt;
+    }
+    return EdgeLabel{ForgetSize{Size}};
+  }
+  if (auto V = consumeVariance(Str)) {
+    auto TV = parseWholeTypeVariable(Ctx, Str, PointerSize);
+    if (!TV) {
+      return std::nullopt;
+    }
+    if (IsForget) {
+      return EdgeLabel{ForgetBase{.Base = *TV, .V = *V}};
+    }
+    return EdgeLabel{RecallBase{.Base = *TV, .V = *V}};
+  }
+  auto [Rest, RField] = parseFieldLabel(Str, PointerSize);
+  if (!RField.isOk() || !skipWhitespace(Rest).empty()) {
+    return std::nullopt;
+  }
+  if (IsForget) {
+    return EdgeLabel{ForgetLabel{RField.get()}};
+  }
+  return EdgeLabel{RecallLabel{RField.get()}};
+}
+
+bool ConstraintGraph::fromDotSummary(const DotGraph &G) {
+  assert(Nodes.empty() && "fromDotSummary: graph is not empty");
+  std::map<std::string, CGNode *> DotIds;
+  // PNI nodes by the id in the label.
+  std::map<std::string, PNINode *> PNIs;
+  for (auto &DN : G.nodes) {
+    // "<key> #<id>", then "<low type> #<pni id>" if the node has a PNI node.
+    llvm::StringRef Label = DN.nodeLabel;
+    auto [KeyLine, PNILine] = Label.split('\n');
+    KeyLine = KeyLine.substr(0, KeyLine.rfind(" #"));
+    NodeKey Key(TypeVariable::CreatePrimitive(*Ctx, "#Start"));
+    Key.IsNewLayer = KeyLine.consume_front("F: ");
+    auto V = consumeVariance(KeyLine);
+    auto TV = parseWholeTypeVariable(*Ctx, KeyLine, PointerSize);
+    if (!V || !TV) {
+      llvm::errs() << "Error: Cannot parse node label in dot graph: "
+                   << DN.nodeLabel << "\n";
+      return false;
+    }
+    Key.Base = *TV;
+    Key.SuffixVariance = *V;
+
+    bool HasPNI = PG && !PNILine.empty();
+    auto PNIPos = PNILine.rfind(" #");
+    auto PNITy = PNILine.substr(0, PNIPos);
+    auto PNIId = PNILine.substr(PNIPos).str();
+
+    CGNode *N = nullptr;
+    if (TV->isPrimitive() && TV->getPrimitiveName() == "#Start") {
+      N = getStartNode();
+    } else if (TV->isPrimitive() && TV->getPrimitiveName() == "#End") {
+      N = getEndNode();
+    } else if (TV->isMemory() && !Key.IsNewLayer) {
+      N = getMemoryNode(Key.SuffixVariance);
+      // keep the PNI of the memory node, merge other users into it.
+      if (HasPNI) {
+        auto *&PN = PNIs[PNIId];
+        if (PN == nullptr) {
+          PN = N->getPNIVar();
+        } else {
+          PN = PG->mergePNINodes(N->getPNIVar(), PN);
+        }
+      }
+    } else if (HasPNI) {
+      auto *&PN = PNIs[PNIId];
+      if (PN == nullptr) {
+        PN = PG->createPNINode(PNITy.str());
+      }
+      N = &createNodeWithPNI(Key, PN);
+    } else {
+      N = &createNodeNoPNI(Key, 0);
+    }
+    DotIds[DN.id] = N;
+  }
+
+  for (auto &DE : G.edges) {
+    auto From = DotIds.find(DE.from);
+    auto To = DotIds.find(DE.to);
+    auto LabelIt = DE.attrs.find("label");
+    if (From == DotIds.end() || To == DotIds.end() ||
+        LabelIt == DE.attrs.end()) {
+      llvm::errs() << "Error: Broken edge in dot graph: " << DE.from << " -> "
+                   << DE.to << "\n";
+      return false;
+    }
+    auto L = parseDotEdgeLabel(*Ctx, LabelIt->second, PointerSize);
+    if (!L) {
+      llvm::errs() << "Error: Cannot parse edge label in dot graph: "
+                   << LabelIt->second << "\n";
+      return false;
+    }
+    onlyAddEdge(*From->second, *To->second, *L);
+  }
+
+  // pair the nodes of both variances, like createNodePairWithPNI.
+  std::map<NodeKey, CGNode *> Keys;
+  for (auto &N : Nodes) {
+    Keys.emplace(N.key, &N);
+  }
+  for (auto &N : Nodes) {
+    if (N.isStartOrEnd() || N.key.SuffixVariance != Covariant) {
+      continue;
+    }
+    auto KC = N.key;
+    KC.SuffixVariance = Contravariant;
+    auto It = Keys.find(KC);
+    if (It != Keys.end() && !RevVariance.count(&N)) {
+      RevVariance.insert({&N, It->second});
+      RevVariance.insert({It->second, &N});
+    }
+  }
+  return true;
 }
 
 void ConstraintGraph::printEpsilonLoop(const char *DotPrefix,
@@ -2122,7 +2421,7 @@ ConstraintGraph::getSubGraph(const std::set<const CGNode *> &Roots,
       for (auto &Edge : Node.outEdges) {
         if (ReachableNodes.count(&Edge.getTargetNode()) != 0) {
           auto *Target = Old2New.at(&Edge.getTargetNode());
-          Temp.onlyAddEdge(*NewNode, *Target, Edge.Label);
+          Temp.onlyAddEdge(*NewNode, *Target, Edge.getLabel());
         } else {
           if (AllReachable) {
             // not possible
@@ -2637,7 +2936,7 @@ void ConstraintGraph::clone(
     for (auto &Edge : Node.outEdges) {
       auto &Target = Edge.getTargetNode();
       auto NewTarget = Old2New.at(&Target);
-      To.onlyAddEdge(*NewNode, *NewTarget, Edge.Label);
+      To.onlyAddEdge(*NewNode, *NewTarget, Edge.getLabel());
     }
   }
 
@@ -2675,10 +2974,10 @@ ConstraintGraph::clone(std::map<const CGNode *, CGNode *> &Old2New) const {
 }
 
 CGNode::CGNode(ConstraintGraph &Parent, NodeKey key, unsigned Size)
-    : Parent(Parent), Id(ValueNamer::getId()), key(key), Size(Size) {}
+    : Parent(Parent), Id(getLockedId()), key(key), Size(Size) {}
 
 CGNode::CGNode(ConstraintGraph &Parent, NodeKey key, llvm::Type *LowTy)
-    : Parent(Parent), Id(ValueNamer::getId()), key(key),
+    : Parent(Parent), Id(getLockedId()), key(key),
       Size(Parent.PG ? ::notdec::retypd::getSize(LowTy, Parent.PointerSize)
                      : 0) {
   if (Parent.PG) {
@@ -2688,7 +2987,7 @@ CGNode::CGNode(ConstraintGraph &Parent, NodeKey key, llvm::Type *LowTy)
 }
 
 CGNode::CGNode(ConstraintGraph &Parent, NodeKey key, PNINode *N)
-    : Parent(Parent), Id(ValueNamer::getId()), key(key),
+    : Parent(Parent), Id(getLockedId()), key(key),
       Size(Parent.PG ? N->getSize() : 0), PNIVar(nullptr) {
   if (N != nullptr) {
     assert(Parent.PG != nullptr);
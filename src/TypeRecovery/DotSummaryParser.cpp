@@ -1,5 +1,8 @@
 #include "TypeRecovery/DotSummaryParser.h"
 
+#include <cstdlib>
+#include <iostream>
+
 namespace notdec::retypd {
 
 std::vector<std::pair<std::string, DotGraph>>
@@ -138,7 +141,9 @@ void DotParser::eat(Lexer::TokenType expected) {
   if (currentToken.type == expected) {
     currentToken = lexer.getNextToken();
   } else {
-    assert(false && "Syntax error");
+    std::cerr << "Error: Syntax error in dot file, unexpected token: "
+              << currentToken.lexeme << "\n";
+    std::abort();
   }
 }
 
@@ -172,8 +177,7 @@ void DotParser::parseAList(std::map<std::string, std::string> &attrs) {
   }
 }
 
-DotNode DotParser::parseNodeStmt() {
-  std::string nodeId = parseNodeId();
+DotNode DotParser::parseNodeStmt(std::string nodeId) {
   std::map<std::string, std::string> attrs;
   if (currentToken.type == Lexer::TOK_LBRACKET) {
     parseAttrList(attrs);
@@ -204,8 +208,7 @@ DotNode DotParser::parseNodeStmt() {
   return node;
 }
 
-DotEdge DotParser::parseEdgeStmt() {
-  std::string from = parseNodeId();
+DotEdge DotParser::parseEdgeStmt(std::string from) {
   eat(Lexer::TOK_ARROW);
   std::string to = parseNodeId();
   std::map<std::string, std::string> attrs;
@@ -224,19 +227,23 @@ DotGraph DotParser::parseGraph() {
   eat(Lexer::TOK_DIGRAPH);
   if (currentToken.type == Lexer::TOK_ID) {
     graph.name = currentToken.lexeme;
+    eat(Lexer::TOK_ID);
   }
   eat(Lexer::TOK_LBRACE);
   while (currentToken.type != Lexer::TOK_RBRACE) {
     if (currentToken.type == Lexer::TOK_ID) {
-      std::string nodeId = currentToken.lexeme;
-      Lexer::Token next = lexer.getNextToken();
-      if (next.type == Lexer::TOK_ARROW) {
-        currentToken = Lexer::Token(next.type, next.lexeme);
-        graph.edges.push_back(parseEdgeStmt());
+      std::string nodeId = parseNodeId();
+      if (currentToken.type == Lexer::TOK_ARROW) {
+        graph.edges.push_back(parseEdgeStmt(nodeId));
+      } else if (currentToken.type == Lexer::TOK_EQUAL) {
+        // graph attribute, e.g., the label written by llvm::WriteGraph.
+        eat(Lexer::TOK_EQUAL);
+        eat(Lexer::TOK_ID);
       } else {
-        currentToken = Lexer::Token(Lexer::TOK_ID, nodeId);
-        graph.nodes.push_back(parseNodeStmt());
+        graph.nodes.push_back(parseNodeStmt(nodeId));
       }
+    } else if (currentToken.type != Lexer::TOK_SEMICOLON) {
+      eat(Lexer::TOK_ID);
     }
     if (currentToken.type == Lexer::TOK_SEMICOLON) {
       eat(Lexer::TOK_SEMICOLON);
@@ -247,13 +254,13 @@ DotGraph DotParser::parseGraph() {
 }
 
 std::string DotParser::parseComment() {
+  // optional, e.g., in a graph printed by llvm::WriteGraph.
   if (currentToken.type == Lexer::TOK_COMMENT) {
     std::string comment = currentToken.lexeme;
     currentToken = lexer.getNextToken();
     return comment;
-  } else {
-    assert(false && "Syntax error, expect comment.");
   }
+  return "";
 }
 
 void DotParser::parse() {
@@ -15,20 +15,42 @@
 
 namespace notdec::retypd {
 
-HType *LatticeTy::buildType(HTypeContext &ctx) const {
-  switch (kind) {
+// Sign tables. SI_UNKNOW is the top, SI_CONFLICT is the bottom.
+static const Signedness SignJoin[4][4] = {
+    /* SI_UNKNOW */ {SI_UNKNOW, SI_UNKNOW, SI_UNKNOW, SI_UNKNOW},
+    /* SI_SIGNED */ {SI_UNKNOW, SI_SIGNED, SI_UNKNOW, SI_SIGNED},
+    /* SI_UNSIGNED */ {SI_UNKNOW, SI_UNKNOW, SI_UNSIGNED, SI_UNSIGNED},
+    /* SI_CONFLICT */ {SI_UNKNOW, SI_SIGNED, SI_UNSIGNED, SI_CONFLICT},
+};
+static const Signedness SignMeet[4][4] = {
+    /* SI_UNKNOW */ {SI_UNKNOW, SI_SIGNED, SI_UNSIGNED, SI_CONFLICT},
+    /* SI_SIGNED */ {SI_SIGNED, SI_SIGNED, SI_CONFLICT, SI_CONFLICT},
+    /* SI_UNSIGNED */ {SI_UNSIGNED, SI_CONFLICT, SI_UNSIGNED, SI_CONFLICT},
+    /* SI_CONFLICT */ {SI_CONFLICT, SI_CONFLICT, SI_CONFLICT, SI_CONFLICT},
+};
+
+HType *LatticeTy::buildType(HTypeContext &Ctx) const {
+  switch (getKind()) {
   case LK_Int:
-    return llvm::cast<IntLattice>(this)->buildType(ctx);
+    assert(getSize() != 0);
+    if (getSize() == 8) {
+      return Ctx.getChar();
+    }
+    if (getSign() == SI_UNSIGNED) {
+      return Ctx.getIntegerType(false, getSize(), true);
+    }
+    // Default to signed? TODO
+    return Ctx.getIntegerType(false, getSize(), false);
   case LK_Float:
-    return llvm::cast<FloatLattice>(this)->buildType(ctx);
+    return Ctx.getFloatType(false, getSize());
   case LK_Pointer:
-    return llvm::cast<PointerLattice>(this)->buildType(ctx);
+    break;
   }
   assert(false && "LatticeTy::buildType: Unhandled kind");
+  return nullptr;
 }
 
-bool join(std::optional<std::shared_ptr<LatticeTy>> &L1,
-          const std::optional<std::shared_ptr<LatticeTy>> &L2) {
+bool join(std::optional<LatticeTy> &L1, const std::optional<LatticeTy> &L2) {
   if (!L1.has_value()) {
     L1 = L2;
     return L2.has_value();
@@ -36,11 +58,10 @@ bool join(std::optional<std::shared_ptr<LatticeTy>> &L1,
   if (!L2.has_value()) {
     return false;
   }
-  return (*L1)->join(**L2);
+  return L1->join(*L2);
 }
 
-bool meet(std::optional<std::shared_ptr<LatticeTy>> &L1,
-          const std::optional<std::shared_ptr<LatticeTy>> &L2) {
+bool meet(std::optional<LatticeTy> &L1, const std::optional<LatticeTy> &L2) {
   if (!L1.has_value()) {
     L1 = L2;
     return L2.has_value();
@@ -48,64 +69,70 @@ bool meet(std::optional<std::shared_ptr<LatticeTy>> &L1,
   if (!L2.has_value()) {
     return true;
   }
-  return (*L1)->meet(**L2);
+  return L1->meet(*L2);
 }
 
-std::optional<std::shared_ptr<LatticeTy>> createLatticeTy(PNTy LTy, Variance V,
-                                                          std::string Name) {
+std::optional<LatticeTy> createLatticeTy(PNTy LTy, Variance V,
+                                         std::optional<Signedness> NameSign) {
   if (LTy.isUnknown() || LTy.isNull()) {
     return std::nullopt;
   }
   // TODO implement other types
   if (LTy.isNumber()) {
-    return LatticeTy::create(LTy, V, Name);
+    return LatticeTy::create(LTy, V, NameSign);
   }
   return std::nullopt;
 }
 
-std::shared_ptr<LatticeTy> LatticeTy::create(PNTy LTy, Variance V,
-                                             std::string Name) {
+std::optional<LatticeTy> createLatticeTy(PNTy LTy, Variance V,
+                                         llvm::StringRef Name) {
+  if (!LTy.isNumber()) {
+    return createLatticeTy(LTy, V, std::optional<Signedness>());
+  }
+  return createLatticeTy(LTy, V, Name.empty() ? std::nullopt
+                                              : getPrimitiveSign(Name));
+}
+
+LatticeTy LatticeTy::create(PNTy LTy, Variance V,
+                            std::optional<Signedness> NameSign) {
+  assert(LTy.isNumber());
+  Signedness Sign = V == Covariant ? SI_UNKNOW : SI_CONFLICT;
+  if (NameSign && *NameSign != SI_UNKNOW) {
+    Sign = *NameSign;
+  }
+  return LatticeTy(LK_Int, LTy.getSize(), Sign);
+}
+
+LatticeTy LatticeTy::create(PNTy LTy, Variance V, llvm::StringRef Name) {
   assert(!LTy.isUnknown());
   if (LTy.isNumber()) {
-    return IntLattice::create(LTy, V, Name);
+    std::optional<Signedness> NameSign;
+    if (!Name.empty()) {
+      NameSign = getPrimitiveSign(Name);
+      assert(NameSign && "LatticeTy::create: Unhandled type");
+    }
+    return create(LTy, V, NameSign);
   } else if (LTy.isPointer()) {
-    return PointerLattice::create(LTy, V, Name);
+    return LatticeTy(LK_Pointer, LTy.getSize());
   } else if (LTy.isNotPN()) {
-    if (Name == "float") {
-      return FloatLattice::create(LTy, V, Name);
-    } else if (Name == "double") {
-      return FloatLattice::create(LTy, V, Name);
+    if (Name == "float" || Name == "double") {
+      return LatticeTy(LK_Float, LTy.getSize());
     }
   }
   assert(false && "LatticeTy::create: Unhandled LowTy");
+  return LatticeTy(LK_Int, LTy.getSize());
 }
 
 bool LatticeTy::join(const LatticeTy &other) {
-  assert(kind == other.kind);
-  if (kind == LK_Int) {
-    return llvm::cast<IntLattice>(this)->join(llvm::cast<IntLattice>(other));
-  } else if (kind == LK_Float) {
-    return llvm::cast<FloatLattice>(this)->join(
-        llvm::cast<FloatLattice>(other));
-  } else if (kind == LK_Pointer) {
-    return llvm::cast<PointerLattice>(this)->join(
-        llvm::cast<PointerLattice>(other));
-  }
-  assert(false && "LatticeTy::join: Unhandled kind");
+  assert(getKind() == other.getKind());
+  // least upper bound
+  return setSign(SignJoin[getSign()][other.getSign()]);
 }
 
 bool LatticeTy::meet(const LatticeTy &other) {
-  assert(kind == other.kind);
-  if (kind == LK_Int) {
-    return llvm::cast<IntLattice>(this)->meet(llvm::cast<IntLattice>(other));
-  } else if (kind == LK_Float) {
-    return llvm::cast<FloatLattice>(this)->meet(
-        llvm::cast<FloatLattice>(other));
-  } else if (kind == LK_Pointer) {
-    return llvm::cast<PointerLattice>(this)->meet(
-        llvm::cast<PointerLattice>(other));
-  }
-  assert(false && "LatticeTy::meet: Unhandled kind");
+  assert(getKind() == other.getKind());
+  // greatest lower bound
+  return setSign(SignMeet[getSign()][other.getSign()]);
 }
 
 std::optional<unsigned> strToUl(std::string s) {
@@ -131,75 +158,27 @@ std::optional<unsigned> decodeUi(std::string s) {
   return std::nullopt;
 }
 
-std::shared_ptr<IntLattice> IntLattice::create(PNTy LTy, Variance V,
-                                               std::string TyName) {
-  assert(LTy.isNumber());
-  std::shared_ptr<IntLattice> IL =
-      std::make_shared<IntLattice>(LTy.getSize(), V);
-  if (TyName == "") {
-    return IL;
-
-  } else if (startswith(TyName, "char")) {
-    IL->Sign = SI_SIGNED;
-  } else if (startswith(TyName, "sint") || decodeSi(TyName) || startswith(TyName, "slonglong")) {
-    IL->Sign = SI_SIGNED;
-  } else if (startswith(TyName, "uint") || decodeUi(TyName) || startswith(TyName, "ulonglong")) {
-    IL->Sign = SI_UNSIGNED;
-  } else if (startswith(TyName, "int") || startswith(TyName, "longlong") || startswith(TyName, "long")) {
-    // do nothing
-  } else {
-    assert(false && "IntLattice::create: Unhandled type");
-  }
-  return IL;
-}
-
-bool IntLattice::join(const IntLattice &Other) {
-  // least upper bound
-  if (Sign == SI_UNKNOW || Other.Sign == SI_UNKNOW) {
-    return setSign(SI_UNKNOW);
-  } else if (Other.Sign == SI_CONFLICT) {
-    // do nothing
-  } else if (Sign == SI_CONFLICT) {
-    return setSign(Other.Sign);
-  }
-  assert(Sign != SI_CONFLICT && Sign != SI_UNKNOW);
-  assert(Other.Sign != SI_CONFLICT && Other.Sign != SI_UNKNOW);
-  if (Sign != Other.Sign) {
-    return setSign(SI_UNKNOW);
-  }
-  return false;
+static bool isDecimal(llvm::StringRef S) {
+  unsigned Num;
+  return !S.getAsInteger(10, Num);
 }
 
-bool IntLattice::meet(const IntLattice &Other) {
-  // greatest lower bound
-  if (Sign == SI_CONFLICT || Other.Sign == SI_CONFLICT) {
-    return setSign(SI_CONFLICT);
-  } else if (Other.Sign == SI_UNKNOW) {
-    // do nothing
-    return false;
-  } else if (Sign == SI_UNKNOW) {
-    return setSign(Other.Sign);
+std::optional<Signedness> getPrimitiveSign(llvm::StringRef Name) {
+  if (Name.startswith("char")) {
+    return SI_SIGNED;
+  } else if (Name.startswith("sint") ||
+             (Name.startswith("i") && isDecimal(Name.drop_front())) ||
+             Name.startswith("slonglong")) {
+    return SI_SIGNED;
+  } else if (Name.startswith("uint") ||
+             (Name.startswith("u") && isDecimal(Name.drop_front())) ||
+             Name.startswith("ulonglong")) {
+    return SI_UNSIGNED;
+  } else if (Name.startswith("int") || Name.startswith("longlong") ||
+             Name.startswith("long")) {
+    return SI_UNKNOW;
   }
-  assert(Sign != SI_CONFLICT && Sign != SI_UNKNOW);
-  assert(Other.Sign != SI_CONFLICT && Other.Sign != SI_UNKNOW);
-  if (Sign != Other.Sign) {
-    return setSign(SI_CONFLICT);
-  }
-  return false;
-}
-
-HType *IntLattice::buildType(HTypeContext &Ctx) const {
-  assert(getSize() != 0);
-  if (getSize() == 8) {
-    return Ctx.getChar();
-  }
-  if (Sign == SI_SIGNED) {
-    return Ctx.getIntegerType(false, getSize(), false);
-  } else if (Sign == SI_UNSIGNED) {
-    return Ctx.getIntegerType(false, getSize(), true);
-  }
-  // Default to signed? TODO
-  return Ctx.getIntegerType(false, getSize(), false);
+  return std::nullopt;
 }
 
 std::string getNameForInt(std::string Name, llvm::Type *Ty) {
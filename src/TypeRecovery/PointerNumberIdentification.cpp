@@ -1,6 +1,8 @@
 #include "TypeRecovery/PointerNumberIdentification.h"
 #include "Passes/ConstraintGenerator.h"
 #include "TypeRecovery/ConstraintGraph.h"
+#include "Utils/MemoryReport.h"
+#include "Utils/ValueNamerLock.h"
 #include "notdec-llvm2c/Interface/Range.h"
 #include "notdec-llvm2c/Interface/ValueNamer.h"
 #include <cassert>
@@ -520,17 +522,17 @@ bool PNINode::setPtrOrNum(PtrOrNum NewTy) {
 
 // When LowTy is pointer-sized int, we initialize Ty as Unknown.
 PNINode::PNINode(PNIGraph &SSG, llvm::Type *LowTy)
-    : Parent(SSG), Id(ValueNamer::getId()), Ty(LowTy, SSG.PointerSize) {
+    : Parent(SSG), Id(getLockedId()), Ty(LowTy, SSG.PointerSize) {
   if (TraceIds.count(Id)) {
     std::cerr << "PNINode::PNINode(" << Id << "): " << str() << "\n";
   }
 }
 
 PNINode::PNINode(PNIGraph &SSG, const PNINode &OtherGraphNode)
-    : Parent(SSG), Id(ValueNamer::getId()), Ty(OtherGraphNode.Ty) {}
+    : Parent(SSG), Id(getLockedId()), Ty(OtherGraphNode.Ty) {}
 
 PNINode::PNINode(PNIGraph &SSG, std::string SerializedTy)
-    : Parent(SSG), Id(ValueNamer::getId()),
+    : Parent(SSG), Id(getLockedId()),
       Ty(SerializedTy.substr(0, SerializedTy.find(" ")), ({
            auto Pos = SerializedTy.find(" ");
            unsigned long Size;
@@ -542,6 +544,21 @@ PNINode::PNINode(PNIGraph &SSG, std::string SerializedTy)
            Size;
          })) {}
 
+std::size_t PNIGraph::estimateBytes() const {
+  std::size_t Bytes = estimateListBytes<ConsNode>(Constraints.size()) +
+                      estimateListBytes<PNINode>(PNINodes.size()) +
+                      estimateTreeBytes<ConsNode *>(Worklist.size());
+  for (auto &Ent : NodeToCons) {
+    Bytes += estimateTreeBytes<decltype(NodeToCons)::value_type>(1) +
+             estimateTreeBytes<ConsNode *>(Ent.second.size());
+  }
+  for (auto &Ent : PNIToNode) {
+    Bytes += estimateTreeBytes<decltype(PNIToNode)::value_type>(1) +
+             estimateTreeBytes<CGNode *>(Ent.second.size());
+  }
+  return Bytes;
+}
+
 void PNIGraph::cloneFrom(const PNIGraph &G,
                          std::map<const CGNode *, CGNode *> Old2New) {
   // assert(PNINodes.size() == 0);
@@ -1,6 +1,7 @@
 
 #include "clang/AST/Attr.h"
 #include "clang/AST/Comment.h"
+#include <algorithm>
 #include <cassert>
 #include <clang/AST/ASTFwd.h>
 #include <clang/AST/Expr.h>
@@ -39,7 +40,8 @@ using notdec::ast::HType;
 using notdec::ast::RecordDecl;
 using notdec::ast::UnionDecl;
 
-HType *TypeBuilder::fromLatticeTy(PNTy Low, LatticeTy *LTy, unsigned BitSize) {
+HType *TypeBuilder::fromLatticeTy(PNTy Low, const LatticeTy *LTy,
+                                  unsigned BitSize) {
   if (!LTy) {
     return fromLowTy(Low, BitSize);
   }
@@ -123,7 +125,7 @@ HType *TypeBuilder::buildType(const CGNode &Node, Variance V,
   }
   if (Visited.count(&Node)) {
     if (NodeTypeMap.count(&Node)) {
-      return NodeTypeMap.at(&Node);
+      return NodeTypeMap.lookup(&Node);
     } else {
       // Visited, but have not set a type (in DFS progress, i.e. visiting
       // dependency nodes).
@@ -136,14 +138,14 @@ HType *TypeBuilder::buildType(const CGNode &Node, Variance V,
             Ctx, ValueNamer::getName(prefix != nullptr ? prefix : "union_"));
         HType *Ret = Ctx.getPointerType(false, Parent.PointerSize,
                                         Ctx.getUnionType(false, Decl));
-        NodeTypeMap.emplace(&Node, Ret);
+        NodeTypeMap.try_emplace(&Node, Ret);
         return Ret;
       } else {
         RecordDecl *Decl = RecordDecl::Create(
             Ctx, ValueNamer::getName(prefix != nullptr ? prefix : "struct_"));
         HType *Ret = Ctx.getPointerType(false, Parent.PointerSize,
                                         Ctx.getRecordType(false, Decl));
-        NodeTypeMap.emplace(&Node, Ret);
+        NodeTypeMap.try_emplace(&Node, Ret);
         return Ret;
       }
     }
@@ -174,11 +176,14 @@ HType *TypeBuilder::buildType(const CGNode &Node, Variance V,
   if (!Node.isPNIPointer()) {
     if (!PointeeSize) {
       // No out edges.
-      std::optional<std::shared_ptr<LatticeTy>> LT = std::nullopt;
+      std::optional<LatticeTy> LT = std::nullopt;
       for (auto &Edge : Node.outEdges) {
         if (const auto *FB = Edge.getLabel().getAs<ForgetBase>()) {
           if (FB->Base.isPrimitive()) {
-            auto L1 = createLatticeTy(ETy, V, FB->Base.getPrimitiveName());
+            auto NameSign = Parent.getPrimitiveSign(FB->Base);
+            assert((!ETy.isNumber() || NameSign) &&
+                   "TypeBuilder::buildType: Unhandled type");
+            auto L1 = createLatticeTy(ETy, V, NameSign);
             if (V == Covariant) {
               meet(LT, L1);
             } else {
@@ -188,11 +193,11 @@ HType *TypeBuilder::buildType(const CGNode &Node, Variance V,
         }
       }
       if (!LT) {
-        LT = createLatticeTy(ETy, V, "");
+        LT = createLatticeTy(ETy, V, std::optional<Signedness>());
       }
 
       if (LT) {
-        Ret = fromLatticeTy(ETy, &**LT, BitSize);
+        Ret = fromLatticeTy(ETy, &*LT, BitSize);
       } else {
         Ret = fromLowTy(Node.getPNIVar()->getLatticeTy(), BitSize);
       }
@@ -240,7 +245,7 @@ HType *TypeBuilder::buildType(const CGNode &Node, Variance V,
           //               .Name = FieldName,
           //               .Comment = "padding"};
           // Decl->addField(CurrentDecl);
-          // NodeTypeMap.emplace(&Node, Ret);
+          // NodeTypeMap.try_emplace(&Node, Ret);
           // hasSetNodeMap = true;
           goto epilogue;
         } else {
@@ -320,7 +325,7 @@ HType *TypeBuilder::buildType(const CGNode &Node, Variance V,
               .Name = FieldName,
               .Comment = "at offset: " + std::to_string(ValidRange->Start)};
           Decl->addField(CurrentDecl);
-          NodeTypeMap.emplace(&Node, Ret);
+          NodeTypeMap.try_emplace(&Node, Ret);
           hasSetNodeMap = true;
           goto epilogue;
         }
@@ -329,13 +334,13 @@ HType *TypeBuilder::buildType(const CGNode &Node, Variance V,
       // forward declare struct type, by inserting into the map.
       RecordDecl *Decl;
       if (NodeTypeMap.count(&Node)) {
-        Ret = NodeTypeMap.at(&Node);
+        Ret = NodeTypeMap.lookup(&Node);
         Decl = Ret->getPointeeType()->getAsRecordDecl();
       } else {
         auto Name = ValueNamer::getName(prefix != nullptr ? prefix : "struct_");
         Decl = RecordDecl::Create(Ctx, Name);
         Ret = getPtrTy(Ctx.getRecordType(false, Decl));
-        NodeTypeMap.emplace(&Node, Ret);
+        NodeTypeMap.try_emplace(&Node, Ret);
       }
       hasSetNodeMap = true;
 
@@ -344,7 +349,21 @@ HType *TypeBuilder::buildType(const CGNode &Node, Variance V,
       if (ValidRange) {
         Current = ValidRange->Start;
       }
-      for (size_t i = 0; i < Info.Fields.size(); i++) {
+      // Fields are sorted by start offset and do not overlap, so only visit
+      // the ones intersecting ValidRange, found by binary search.
+      size_t Begin = 0;
+      size_t End = Info.Fields.size();
+      if (ValidRange) {
+        auto First = std::partition_point(
+            Info.Fields.begin(), Info.Fields.end(),
+            [&](const FieldEntry &F) { return F.R.end() <= ValidRange->Start; });
+        auto Last = std::partition_point(
+            First, Info.Fields.end(),
+            [&](const FieldEntry &F) { return F.R.Start < ValidRange->end(); });
+        Begin = First - Info.Fields.begin();
+        End = Last - Info.Fields.begin();
+      }
+      for (size_t i = Begin; i < End; i++) {
         // copy the entry
         auto Ent = Info.Fields[i];
         if (ValidRange) {
@@ -549,13 +568,13 @@ HType *TypeBuilder::buildType(const CGNode &Node, Variance V,
       if (Decl->getFields().size() == 0) {
         Ret = getPtrTy(nullptr);
         if (hasSetNodeMap) {
-          NodeTypeMap.insert_or_assign(&Node, Ret);
+          NodeTypeMap[&Node] = Ret;
         }
       } else if (Decl->getFields().size() == 1 &&
                  Decl->getFields().front().R.Start == 0) {
         Ret = getPtrTy(Decl->getFields().front().Type);
         if (hasSetNodeMap) {
-          NodeTypeMap.insert_or_assign(&Node, Ret);
+          NodeTypeMap[&Node] = Ret;
         }
       }
     } else if (std::holds_alternative<UnionInfo>(TI.Info)) {
@@ -565,13 +584,13 @@ HType *TypeBuilder::buildType(const CGNode &Node, Variance V,
       // cyclic dependency
       UnionDecl *Decl;
       if (NodeTypeMap.count(&Node)) {
-        Ret = NodeTypeMap.at(&Node);
+        Ret = NodeTypeMap.lookup(&Node);
         Decl = Ret->getPointeeType()->getAsUnionDecl();
       } else {
         auto Name = ValueNamer::getName(prefix != nullptr ? prefix : "union_");
         Decl = UnionDecl::Create(Ctx, Name);
         Ret = getPtrTy(Ctx.getUnionType(false, Decl));
-        auto It = NodeTypeMap.emplace(&Node, Ret);
+        auto It = NodeTypeMap.try_emplace(&Node, Ret);
         assert(It.second);
       }
       hasSetNodeMap = true;
@@ -636,7 +655,7 @@ epilogue:
     }
     if (NodeTypeMap.count(&Node)) {
       // if forced to be a struct
-      auto StructPtrTy = NodeTypeMap.at(&Node);
+      auto StructPtrTy = NodeTypeMap.lookup(&Node);
       RecordDecl *Decl = StructPtrTy->getPointeeType()->getAsRecordDecl();
       assert(BitSize % 8 == 0);
       Decl->addField(FieldDecl{
@@ -646,7 +665,7 @@ epilogue:
           .Comment = "at offset: 0",
       });
     } else {
-      auto It = NodeTypeMap.emplace(&Node, Ret);
+      auto It = NodeTypeMap.try_emplace(&Node, Ret);
       assert(It.second);
     }
   }
@@ -1,8 +1,10 @@
 #include "notdec-llvm2c/Interface/Range.h"
+#include <mutex>
 #include <string>
 #include <variant>
 
 #include "TypeRecovery/TRContext.h"
+#include "Utils/ValueNamerLock.h"
 #include "notdec-llvm2c/Interface/Utils.h"
 
 #include "TypeRecovery/retypd/Schema.h"
@@ -18,6 +20,7 @@ const char *TypeVariable::Memory = "MEMORY";
 
 const PooledTypeVariable *
 PooledTypeVariable::intern(TRContext &Ctx, const PooledTypeVariable &TV) {
+  auto Lock = lockIfConcurrent(Ctx.Mutex);
   auto IT = Ctx.TypeVars.find(const_cast<PooledTypeVariable *>(&TV));
   if (IT != Ctx.TypeVars.end()) {
     return *IT;
@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/Compression.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "Utils/DebugDump.h"
+
+namespace notdec {
+
+// block the producer when this many bytes are waiting for the writer.
+static const std::size_t MaxPendingBytes = 256 * 1024 * 1024;
+
+static std::size_t getSizeEnv(const char *Name) {
+  auto S = std::getenv(Name);
+  if (S == nullptr) {
+    return 0;
+  }
+  char *End = nullptr;
+  auto V = std::strtoull(S, &End, 10);
+  if (End == S || *End != '\0') {
+    std::cerr << "Error: Unrecognized value in " << Name << ": " << S << "\n";
+    return 0;
+  }
+  return V;
+}
+
+static bool getBoolEnv(const char *Name) {
+  auto S = std::getenv(Name);
+  return S != nullptr && std::strcmp(S, "1") == 0;
+}
+
+namespace {
+// Forward at most Cap bytes (0: no cap) to the underlying stream and count
+// the rest, so rendering an oversized dump does not grow the buffer.
+class CappedStream : public llvm::raw_ostream {
+  llvm::raw_ostream &OS;
+  std::size_t Cap;
+  std::uint64_t Count = 0;
+
+  void write_impl(const char *Ptr, size_t Size) override {
+    Count += Size;
+    if (!exceeded()) {
+      OS.write(Ptr, Size);
+    }
+  }
+  uint64_t current_pos() const override { return Count; }
+
+public:
+  CappedStream(llvm::raw_ostream &OS, std::size_t Cap) : OS(OS), Cap(Cap) {}
+  ~CappedStream() override { flush(); }
+  bool exceeded() const { return Cap != 0 && Count > Cap; }
+  std::uint64_t count() const { return Count; }
+};
+} // namespace
+
+DebugDump::DebugDump()
+    : FileLimit(getSizeEnv("NOTDEC_DEBUG_DUMP_FILE_LIMIT")),
+      TotalLimit(getSizeEnv("NOTDEC_DEBUG_DUMP_TOTAL_LIMIT")),
+      Async(getBoolEnv("NOTDEC_DEBUG_DUMP_ASYNC")),
+      Compress(getBoolEnv("NOTDEC_DEBUG_DUMP_COMPRESS")),
+      BinaryGraphs(getBoolEnv("NOTDEC_DEBUG_DUMP_BINARY")) {
+  if (auto S = std::getenv("NOTDEC_DEBUG_DUMP_FILTER")) {
+    llvm::SmallVector<llvm::StringRef, 8> Names;
+    llvm::StringRef(S).split(Names, ',', -1, false);
+    for (auto Name : Names) {
+      Filter.insert(Name.trim().str());
+    }
+  }
+  if (Compress && !llvm::zlib::isAvailable()) {
+    std::cerr << "Warning: zlib is not available, debug dumps are not "
+                 "compressed.\n";
+    Compress = false;
+  }
+  if (Async) {
+    Writer = std::thread(&DebugDump::writerLoop, this);
+  }
+}
+
+DebugDump::~DebugDump() {
+  if (Writer.joinable()) {
+    {
+      std::lock_guard<std::mutex> Lock(Mutex);
+      Stopping = true;
+    }
+    QueueChanged.notify_all();
+    Writer.join();
+  }
+}
+
+DebugDump &DebugDump::get() {
+  static DebugDump Instance;
+  return Instance;
+}
+
+bool DebugDump::shouldDumpSCC(std::size_t SCCIndex,
+                              const std::string &SCCName) const {
+  if (Filter.empty() || Filter.count("SCC" + std::to_string(SCCIndex))) {
+    return true;
+  }
+  llvm::SmallVector<llvm::StringRef, 4> Names;
+  llvm::StringRef(SCCName).split(Names, ',');
+  for (auto Name : Names) {
+    if (Filter.count(Name.str())) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool DebugDump::shouldDumpFunction(llvm::StringRef Name) const {
+  return Filter.empty() || Filter.count(Name.str());
+}
+
+void DebugDump::printModule(const llvm::Module &M, llvm::raw_ostream &OS,
+                            llvm::AssemblyAnnotationWriter *AAW) const {
+  if (Filter.empty()) {
+    M.print(OS, AAW);
+    return;
+  }
+  OS << "; ModuleID = '" << M.getModuleIdentifier() << "'\n"
+     << "; functions in NOTDEC_DEBUG_DUMP_FILTER only\n";
+  for (auto &F : M) {
+    if (!F.isDeclaration() && shouldDumpFunction(F.getName())) {
+      OS << "\n";
+      F.print(OS, AAW);
+    }
+  }
+}
+
+std::string DebugDump::reservePath(const std::string &BasePath,
+                                   const char *Suffix) {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  for (unsigned Index = 0;; ++Index) {
+    auto Candidate = BasePath + "." + std::to_string(Index) + Suffix;
+    if (IssuedPaths.count(Candidate) || llvm::sys::fs::exists(Candidate) ||
+        llvm::sys::fs::exists(Candidate + ".zlib")) {
+      continue;
+    }
+    IssuedPaths.insert(Candidate);
+    return Candidate;
+  }
+}
+
+bool DebugDump::write(std::string Path, std::string Content) {
+  if (FileLimit != 0 && Content.size() > FileLimit) {
+    std::cerr << "Warning: Debug dump skipped (" << Content.size()
+              << " bytes): " << Path << "\n";
+    return true;
+  }
+  std::unique_lock<std::mutex> Lock(Mutex);
+  if (TotalLimit != 0 && TotalBytes + Content.size() > TotalLimit) {
+    totalLimitReached();
+    return true;
+  }
+  TotalBytes += Content.size();
+  if (!Async) {
+    Lock.unlock();
+    return writeNow(Path, Content);
+  }
+  QueueChanged.wait(Lock, [&] { return PendingBytes < MaxPendingBytes; });
+  PendingBytes += Content.size();
+  Queue.emplace_back(std::move(Path), std::move(Content));
+  Lock.unlock();
+  QueueChanged.notify_all();
+  return true;
+}
+
+void DebugDump::totalLimitReached() {
+  if (!TotalLimitWarned) {
+    std::cerr << "Warning: Debug dump total limit reached, skipping "
+                 "remaining dumps.\n";
+    TotalLimitWarned = true;
+  }
+}
+
+bool DebugDump::admit() {
+  if (TotalLimit == 0) {
+    return true;
+  }
+  std::lock_guard<std::mutex> Lock(Mutex);
+  if (TotalBytes < TotalLimit) {
+    return true;
+  }
+  totalLimitReached();
+  return false;
+}
+
+bool DebugDump::render(std::string Path,
+                       llvm::function_ref<void(llvm::raw_ostream &)> Print) {
+  if (!admit()) {
+    return true;
+  }
+  // stop collecting at the file limit or the rest of the total budget.
+  std::size_t Cap = FileLimit;
+  if (TotalLimit != 0) {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    auto Rest = TotalLimit - TotalBytes;
+    Cap = Cap == 0 ? Rest : std::min(Cap, Rest);
+  }
+  auto Skipped = [&]() {
+    std::cerr << "Warning: Debug dump skipped (over " << Cap
+              << " bytes): " << Path << "\n";
+    return true;
+  };
+  if (Async || Compress) {
+    std::string Out;
+    bool Exceeded;
+    {
+      llvm::raw_string_ostream Buffer(Out);
+      CappedStream OS(Buffer, Cap);
+      Print(OS);
+      OS.flush();
+      Exceeded = OS.exceeded();
+    }
+    if (Exceeded) {
+      return Skipped();
+    }
+    return write(std::move(Path), std::move(Out));
+  }
+
+  std::error_code EC;
+  std::uint64_t Size;
+  bool Exceeded;
+  {
+    llvm::raw_fd_ostream File(Path, EC);
+    if (EC) {
+      std::cerr << "DebugDump: Error printing to " << Path << ", "
+                << EC.message() << "\n";
+      return false;
+    }
+    CappedStream OS(File, Cap);
+    Print(OS);
+    OS.flush();
+    Size = OS.count();
+    Exceeded = OS.exceeded();
+  }
+  if (Exceeded) {
+    llvm::sys::fs::remove(Path);
+    return Skipped();
+  }
+  std::lock_guard<std::mutex> Lock(Mutex);
+  // another thread may have used the budget while rendering.
+  if (TotalLimit != 0 && TotalBytes + Size > TotalLimit) {
+    llvm::sys::fs::remove(Path);
+    totalLimitReached();
+    return true;
+  }
+  TotalBytes += Size;
+  return true;
+}
+
+void DebugDump::flush() {
+  if (!Async) {
+    return;
+  }
+  std::unique_lock<std::mutex> Lock(Mutex);
+  // PendingBytes is decreased after the file is written.
+  QueueChanged.wait(Lock, [&] { return Queue.empty() && PendingBytes == 0; });
+}
+
+void DebugDump::writerLoop() {
+  std::unique_lock<std::mutex> Lock(Mutex);
+  while (true) {
+    QueueChanged.wait(Lock, [&] { return !Queue.empty() || Stopping; });
+    if (Queue.empty()) {
+      break;
+    }
+    auto Job = std::move(Queue.front());
+    Queue.pop_front();
+    Lock.unlock();
+    writeNow(Job.first, Job.second);
+    Lock.lock();
+    PendingBytes -= Job.second.size();
+    QueueChanged.notify_all();
+  }
+}
+
+bool DebugDump::writeNow(const std::string &Path, const std::string &Content) {
+  llvm::StringRef Data = Content;
+  std::string OutPath = Path;
+  llvm::SmallVector<char, 0> Compressed;
+  if (Compress) {
+    if (auto E = llvm::zlib::compress(Content, Compressed)) {
+      llvm::consumeError(std::move(E));
+    } else {
+      Data = llvm::StringRef(Compressed.data(), Compressed.size());
+      OutPath += ".zlib";
+    }
+  }
+  std::error_code EC;
+  llvm::raw_fd_ostream OS(OutPath, EC);
+  if (EC) {
+    std::cerr << "DebugDump: Error printing to " << OutPath << ", "
+              << EC.message() << "\n";
+    return false;
+  }
+  OS << Data;
+  return true;
+}
+
+} // namespace notdec
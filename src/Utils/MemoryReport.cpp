@@ -0,0 +1,81 @@
+#include <cstdlib>
+#include <iostream>
+
+#include <llvm/Support/JSON.h>
+
+#include "Utils/MemoryReport.h"
+#include "Utils/Utils.h"
+
+namespace notdec {
+
+MemoryReport::MemoryReport() {
+  auto Path = std::getenv("NOTDEC_MEMORY_REPORT");
+  if (Path == nullptr) {
+    return;
+  }
+  std::error_code EC;
+  OS = std::make_unique<llvm::raw_fd_ostream>(Path, EC);
+  if (EC) {
+    std::cerr << "Error: Cannot open memory report " << Path << ": "
+              << EC.message() << "\n";
+    OS.reset();
+  }
+}
+
+MemoryReport &MemoryReport::get() {
+  static MemoryReport Instance;
+  return Instance;
+}
+
+void MemoryReport::record(std::size_t SCCIndex, const std::string &SCCName,
+                          const char *Phase, std::size_t Bytes,
+                          std::size_t Nodes, std::size_t Edges,
+                          std::size_t ContextBytes) {
+  if (!isEnabled()) {
+    return;
+  }
+  llvm::json::Object Obj{
+      {"scc", static_cast<int64_t>(SCCIndex)},
+      {"name", SCCName},
+      {"phase", Phase},
+      {"bytes", static_cast<int64_t>(Bytes)},
+      {"nodes", static_cast<int64_t>(Nodes)},
+      {"edges", static_cast<int64_t>(Edges)},
+      {"context_bytes", static_cast<int64_t>(ContextBytes)},
+      {"peak_rss", static_cast<int64_t>(getPeakRSS())},
+  };
+  std::lock_guard<std::mutex> Lock(Mutex);
+  *OS << llvm::json::Value(std::move(Obj)) << "\n";
+  OS->flush();
+}
+
+void MemoryReport::recordTotal(const char *Phase, std::size_t Nodes,
+                               std::size_t Edges) {
+  if (!isEnabled()) {
+    return;
+  }
+  llvm::json::Object Obj{
+      {"phase", Phase},
+      {"nodes", static_cast<int64_t>(Nodes)},
+      {"edges", static_cast<int64_t>(Edges)},
+      {"peak_rss", static_cast<int64_t>(getPeakRSS())},
+  };
+  std::lock_guard<std::mutex> Lock(Mutex);
+  *OS << llvm::json::Value(std::move(Obj)) << "\n";
+  OS->flush();
+}
+
+void MemoryReport::recordPeakRSS(const char *Phase) {
+  if (!isEnabled()) {
+    return;
+  }
+  llvm::json::Object Obj{
+      {"phase", Phase},
+      {"peak_rss", static_cast<int64_t>(getPeakRSS())},
+  };
+  std::lock_guard<std::mutex> Lock(Mutex);
+  *OS << llvm::json::Value(std::move(Obj)) << "\n";
+  OS->flush();
+}
+
+} // namespace notdec
@@ -5,8 +5,12 @@
 #include <iostream>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/IR/Module.h>
+#include <llvm/Support/raw_ostream.h>
 #include <sstream>
 #include <string>
+#include <sys/resource.h>
+
+#include "Utils/DebugDump.h"
 
 std::string getSuffix(std::string fname) {
   std::size_t ind = fname.find_last_of('.');
@@ -41,20 +45,28 @@ std::string join(std::string path, std::string elem) {
   return path.back() == '/' ? path + elem : path + "/" + elem;
 }
 
+std::size_t getPeakRSS() {
+  struct rusage Usage;
+  if (getrusage(RUSAGE_SELF, &Usage) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return Usage.ru_maxrss;
+#else
+  // kilobytes on Linux
+  return static_cast<std::size_t>(Usage.ru_maxrss) * 1024;
+#endif
+}
+
 [[nodiscard]] bool equal(llvm::StringRef S1, const char* S2) {
   return S1 == S2;
 }
 
 [[nodiscard]] bool printModule(llvm::Module &M, const char *path) {
-  std::error_code EC;
-  llvm::raw_fd_ostream os(path, EC);
-  if (EC) {
-    std::cerr << "Cannot open output file: " << path << std::endl;
-    std::cerr << EC.message() << std::endl;
-    std::abort();
-  }
-  M.print(os, nullptr);
-  return true;
+  auto &Dump = DebugDump::get();
+  return Dump.render(path, [&](llvm::raw_ostream &os) {
+    Dump.printModule(M, os);
+  });
 }
 
 [[nodiscard]] std::string toString(const clang::QualType &QT) {
@@ -0,0 +1,38 @@
+#!/usr/bin/python3
+import unittest
+import os,sys,subprocess
+
+from t_utils import *
+
+# Type recovery must produce the same C output in every run, also when the
+# constraints are generated in parallel (NOTDEC_TYPE_RECOVERY_THREADS), for
+# any number of threads.
+class DeterminismTestCase(unittest.TestCase):
+    def decompile(self, src, out, threads):
+        env = dict(os.environ)
+        env['NOTDEC_TYPE_RECOVERY_THREADS'] = str(threads)
+        command = get_decompile_commands(src, out)
+        print(' '.join(command))
+        self.assertEqual(subprocess.call(command, env=env), 0, "decompilation error")
+        with open(out, 'rb') as f:
+            return f.read()
+
+    def test_repeat(self):
+        cwd = os.path.dirname(os.path.realpath(__file__))
+        outdir = os.path.join(cwd, "out_determinism")
+        if not os.path.exists(outdir):
+            os.makedirs(outdir)
+        for file in sorted(os.listdir(cwd)):
+            if not (file.endswith(".wat") or file.endswith(".wasm")):
+                continue
+            src = os.path.join(cwd, file)
+            out = os.path.join(outdir, f'{file}.c')
+            print(RED+f'=========== decompiling {file} =========='+NC)
+            first = self.decompile(src, out, 1)
+            self.assertEqual(first, self.decompile(src, out, 1), f"{file}: output differs between runs")
+            for threads in (2, 4):
+                self.assertEqual(first, self.decompile(src, out, threads), f"{file}: output differs with {threads} threads")
+
+if __name__ == '__main__':
+    import unittest
+    unittest.main()
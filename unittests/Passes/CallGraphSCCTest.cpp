@@ -0,0 +1,149 @@
+#include "Passes/CallGraphSCC.h"
+#include <gtest/gtest.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+#include <memory>
+
+using namespace llvm;
+
+// main -> a <-> b -> leaf, main -> leaf
+static const char *CallChain = R"(
+define void @leaf() {
+  ret void
+}
+define void @a(i1 %c) {
+  br i1 %c, label %l1, label %l2
+l1:
+  call void @b(i1 %c)
+  ret void
+l2:
+  ret void
+}
+define void @b(i1 %c) {
+  call void @a(i1 %c)
+  call void @leaf()
+  ret void
+}
+define void @main() {
+  call void @a(i1 true)
+  call void @leaf()
+  ret void
+}
+)";
+
+static std::unique_ptr<Module> parse(LLVMContext &C, const char *IR) {
+  SMDiagnostic Err;
+  auto M = parseAssemblyString(IR, Err, C);
+  if (!M) {
+    Err.print("CallGraphSCCTest", errs());
+  }
+  return M;
+}
+
+static std::size_t getSCC(notdec::CallGraphSCCInfo &Info, Module &M,
+                          StringRef Name) {
+  return Info.Node2SCC.lookup(Info.CG[M.getFunction(Name)]);
+}
+
+TEST(CallGraphSCC, DAGAndLevels) {
+  LLVMContext C;
+  auto M = parse(C, CallChain);
+  ASSERT_TRUE(M);
+  notdec::CallGraphSCCInfo Info(*M);
+
+  auto Leaf = getSCC(Info, *M, "leaf");
+  auto A = getSCC(Info, *M, "a");
+  auto Main = getSCC(Info, *M, "main");
+  EXPECT_EQ(A, getSCC(Info, *M, "b"));
+  EXPECT_LT(Leaf, A);
+  EXPECT_LT(A, Main);
+
+  EXPECT_EQ(Info.SCCLevels[Leaf], 0u);
+  EXPECT_EQ(Info.SCCLevels[A], 1u);
+  EXPECT_EQ(Info.SCCLevels[Main], 2u);
+  EXPECT_EQ(Info.SCCCallees[Main], (std::vector<std::size_t>{Leaf, A}));
+
+  auto &Callers = Info.FuncCallers.at(Info.CG[M->getFunction("leaf")]);
+  EXPECT_EQ(Callers.size(), 2u);
+}
+
+TEST(CallGraphSCC, UpdateFunction) {
+  LLVMContext C;
+  auto M = parse(C, CallChain);
+  ASSERT_TRUE(M);
+  notdec::CallGraphSCCInfo Info(*M);
+
+  // break the cycle by removing the call from b to a.
+  auto *B = M->getFunction("b");
+  cast<CallInst>(&B->getEntryBlock().front())->eraseFromParent();
+  Info.updateFunction(*B);
+
+  auto A = getSCC(Info, *M, "a");
+  auto BIndex = getSCC(Info, *M, "b");
+  EXPECT_NE(A, BIndex);
+  EXPECT_LT(BIndex, A);
+  EXPECT_EQ(Info.SCCLevels[BIndex], 1u);
+  EXPECT_EQ(Info.SCCLevels[A], 2u);
+  EXPECT_EQ(Info.SCCLevels[getSCC(Info, *M, "main")], 3u);
+}
+
+TEST(CallGraphSCC, UpdateFunctions) {
+  LLVMContext C;
+  auto M = parse(C, CallChain);
+  ASSERT_TRUE(M);
+  notdec::CallGraphSCCInfo Info(*M);
+
+  // remove the calls to a from b and main, then rescan both at once.
+  auto *B = M->getFunction("b");
+  auto *Main = M->getFunction("main");
+  cast<CallInst>(&B->getEntryBlock().front())->eraseFromParent();
+  cast<CallInst>(&Main->getEntryBlock().front())->eraseFromParent();
+  Info.updateFunctions({B, Main});
+
+  EXPECT_EQ(Info.SCCLevels[getSCC(Info, *M, "b")], 1u);
+  EXPECT_EQ(Info.SCCLevels[getSCC(Info, *M, "a")], 2u);
+  EXPECT_EQ(Info.SCCLevels[getSCC(Info, *M, "main")], 1u);
+  EXPECT_EQ(Info.FuncCallers.count(Info.CG[M->getFunction("a")]), 0u);
+}
+
+// a -> b (twice), b -> c (twice), c -> a (once)
+static const char *WeightedCycle = R"(
+define void @a() {
+  call void @b()
+  call void @b()
+  ret void
+}
+define void @b() {
+  call void @c()
+  call void @c()
+  ret void
+}
+define void @c() {
+  call void @a()
+  ret void
+}
+)";
+
+TEST(CallGraphSCC, SplitSCC) {
+  LLVMContext C;
+  auto M = parse(C, WeightedCycle);
+  ASSERT_TRUE(M);
+  notdec::CallGraphSCCInfo Info(*M);
+
+  auto &SCC = Info.SCCs[getSCC(Info, *M, "a")];
+  ASSERT_EQ(SCC.size(), 3u);
+  EXPECT_EQ(notdec::splitSCC(SCC, 3).size(), 1u);
+
+  // the single call from c to a is cut.
+  auto Pieces = notdec::splitSCC(SCC, 2);
+  ASSERT_EQ(Pieces.size(), 2u);
+  ASSERT_EQ(Pieces[0].size(), 2u);
+  EXPECT_EQ(Pieces[0][0]->getFunction()->getName(), "c");
+  EXPECT_EQ(Pieces[0][1]->getFunction()->getName(), "b");
+  ASSERT_EQ(Pieces[1].size(), 1u);
+  EXPECT_EQ(Pieces[1][0]->getFunction()->getName(), "a");
+}
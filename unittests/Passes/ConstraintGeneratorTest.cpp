@@ -0,0 +1,64 @@
+#include "Passes/ConstraintGenerator.h"
+#include "TypeRecovery/TRContext.h"
+#include <gtest/gtest.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+#include <memory>
+#include <string>
+
+using namespace llvm;
+
+// call_indirect through a constant table slot, as lifted from wasm.
+static const char *TableCall = R"(
+target datalayout = "e-m:e-p:32:32-i64:64-n32:64-S128"
+@table_0 = global [2 x i32 (i32)*] zeroinitializer
+define i32 @f(i32 %a) {
+  %fp = load i32 (i32)*, i32 (i32)** getelementptr inbounds ([2 x i32 (i32)*], [2 x i32 (i32)*]* @table_0, i32 0, i32 1)
+  %fi = ptrtoint i32 (i32)* %fp to i32
+  %r = call i32 %fp(i32 %a)
+  %p = inttoptr i32 %r to i32*
+  ret i32 %a
+}
+)";
+
+static Instruction *findInst(Function &F, StringRef Name) {
+  for (auto &I : instructions(F)) {
+    if (I.getName() == Name) {
+      return &I;
+    }
+  }
+  return nullptr;
+}
+
+// Table loads and indirect calls get no node from the visitors, so the casts
+// of their results must not get an unconstrained one either.
+TEST(ConstraintsGenerator, TableLoadAndIndirectCallHaveNoNode) {
+  LLVMContext C;
+  SMDiagnostic Err;
+  auto M = parseAssemblyString(TableCall, Err, C);
+  if (!M) {
+    Err.print("ConstraintGeneratorTest", errs());
+  }
+  ASSERT_TRUE(M != nullptr);
+  auto &F = *M->getFunction("f");
+
+  notdec::TypeRecovery TR(std::make_shared<notdec::retypd::TRContext>(),
+                          nullptr, *M);
+  TR.pointer_size = 32;
+  notdec::ConstraintsGenerator G(TR, "f", {&F});
+  G.run();
+
+  for (const char *Name : {"fp", "fi", "r", "p"}) {
+    auto *I = findInst(F, Name);
+    ASSERT_TRUE(I != nullptr) << Name;
+    EXPECT_EQ(G.lookupNode(I, notdec::retypd::Covariant), nullptr) << Name;
+    EXPECT_EQ(G.lookupNode(I, notdec::retypd::Contravariant), nullptr)
+        << Name;
+  }
+  // the argument is still typed as usual.
+  EXPECT_NE(G.lookupNode(F.getArg(0), notdec::retypd::Covariant), nullptr);
+}
@@ -0,0 +1,139 @@
+#include "Passes/DSROA.h"
+#include <gtest/gtest.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+#include <memory>
+
+using namespace llvm;
+
+// The stack as produced by LinearAllocationRecovery: a 16 byte frame growing
+// negative, addressed by integer arithmetic from its end.
+static const char *StackPrologue = R"(
+  %stack = alloca [16 x i8], align 4, !notdec.stack_direction !0
+  %stack_addr = ptrtoint [16 x i8]* %stack to i32
+  %stack_end = add i32 %stack_addr, -16
+)";
+
+static std::unique_ptr<Module> runDSROA(LLVMContext &C, std::string Body) {
+  std::string IR = "target datalayout = \"e-m:e-p:32:32-i64:64-n32:64-S128\"\n"
+                   "declare void @use(i32)\n" +
+                   Body + "\n!0 = !{!\"negative\"}\n";
+  SMDiagnostic Err;
+  auto M = parseAssemblyString(IR, Err, C);
+  if (!M) {
+    Err.print("DSROATest", errs());
+    return nullptr;
+  }
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+  PassBuilder PB;
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+  ModulePassManager MPM;
+  MPM.addPass(createModuleToFunctionPassAdaptor(notdec::DSROAPass()));
+  MPM.run(*M, MAM);
+  EXPECT_FALSE(verifyModule(*M, &errs()));
+  return M;
+}
+
+static unsigned countAllocas(Function &F) {
+  unsigned Count = 0;
+  for (auto &I : instructions(F)) {
+    Count += isa<AllocaInst>(I);
+  }
+  return Count;
+}
+
+TEST(DSROA, PromoteRecoveredStack) {
+  LLVMContext C;
+  auto M = runDSROA(C, std::string("define i32 @f(i32 %a, i1 %c) {\nentry:") +
+                           StackPrologue + R"(
+  %p0 = add i32 %stack_end, 12
+  %q0 = inttoptr i32 %p0 to i32*
+  store i32 %a, i32* %q0
+  %p1 = add i32 %stack_end, 8
+  %q1 = inttoptr i32 %p1 to i32*
+  store i32 7, i32* %q1
+  br i1 %c, label %t, label %e
+t:
+  store i32 9, i32* %q1
+  br label %e
+e:
+  %v0 = load i32, i32* %q0
+  %v1 = load i32, i32* %q1
+  %r = add i32 %v0, %v1
+  ret i32 %r
+})");
+  ASSERT_TRUE(M != nullptr);
+  auto &F = *M->getFunction("f");
+  EXPECT_EQ(countAllocas(F), 0u);
+  // both stack slots become SSA values.
+  for (auto &I : instructions(F)) {
+    EXPECT_FALSE(isa<LoadInst>(I) || isa<StoreInst>(I));
+  }
+}
+
+TEST(DSROA, KeepEscapedStack) {
+  LLVMContext C;
+  auto M = runDSROA(C, std::string("define i32 @g(i32 %a) {\nentry:") +
+                           StackPrologue + R"(
+  %p0 = add i32 %stack_end, 12
+  %q0 = inttoptr i32 %p0 to i32*
+  store i32 %a, i32* %q0
+  call void @use(i32 %stack_end)
+  %v0 = load i32, i32* %q0
+  ret i32 %v0
+})");
+  ASSERT_TRUE(M != nullptr);
+  auto &F = *M->getFunction("g");
+  EXPECT_EQ(countAllocas(F), 1u);
+  EXPECT_EQ(F.getEntryBlock().front().getName(), "stack");
+}
+
+TEST(DSROA, KeepAccessOutsideFrame) {
+  LLVMContext C;
+  auto M = runDSROA(C, std::string("define i32 @h() {\nentry:") +
+                           StackPrologue + R"(
+  %p0 = add i32 %stack_end, 20
+  %q0 = inttoptr i32 %p0 to i32*
+  %v0 = load i32, i32* %q0
+  ret i32 %v0
+})");
+  ASSERT_TRUE(M != nullptr);
+  auto &F = *M->getFunction("h");
+  EXPECT_EQ(countAllocas(F), 1u);
+  // the load is not dropped as out of bounds.
+  EXPECT_TRUE(isa<LoadInst>(F.getEntryBlock().getTerminator()->getOperand(0)));
+}
+
+// Only the recovered stack is followed through integer arithmetic. Any other
+// alloca escapes through ptrtoint and is left alone.
+TEST(DSROA, KeepEscapedNonStackAlloca) {
+  LLVMContext C;
+  auto M = runDSROA(C, R"(define i32 @k(i32 %a) {
+entry:
+  %buf = alloca [16 x i8], align 4
+  %buf_addr = ptrtoint [16 x i8]* %buf to i32
+  %p0 = add i32 %buf_addr, 4
+  %q0 = inttoptr i32 %p0 to i32*
+  store i32 %a, i32* %q0
+  %v0 = load i32, i32* %q0
+  ret i32 %v0
+})");
+  ASSERT_TRUE(M != nullptr);
+  auto &F = *M->getFunction("k");
+  EXPECT_EQ(countAllocas(F), 1u);
+  EXPECT_EQ(F.getEntryBlock().front().getName(), "buf");
+  EXPECT_TRUE(isa<LoadInst>(F.getEntryBlock().getTerminator()->getOperand(0)));
+}
@@ -0,0 +1,216 @@
+#include "Passes/retdec-stack/retdec-abi.h"
+#include "Passes/retdec-stack/retdec-reaching-definition.h"
+#include "Passes/retdec-stack/retdec-symbolic-tree.h"
+#include <gtest/gtest.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+#include <map>
+#include <memory>
+#include <optional>
+
+using namespace llvm;
+using retdec::bin2llvmir::Abi;
+using retdec::bin2llvmir::ReachingDefinitionsAnalysis;
+using retdec::bin2llvmir::SymbolicTree;
+using retdec::bin2llvmir::SymbolicTreeMemo;
+
+// Two stack slots addressed from the same frame base.
+static const char *Frame = R"(
+@__stack_pointer = global i32 0
+define i32 @f() {
+  %sp = load i32, i32* @__stack_pointer
+  %base = add i32 %sp, -16
+  %a = add i32 %base, 4
+  %b = add i32 %base, 8
+  ret i32 %b
+}
+)";
+
+class SymbolicTreeMemoTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    SMDiagnostic Err;
+    M = parseAssemblyString(Frame, Err, C);
+    if (!M) {
+      Err.print("SymbolicTreeTest", errs());
+      return;
+    }
+    TheAbi = std::make_unique<Abi>(M.get());
+    TheAbi->setStackPointer(M->getGlobalVariable("__stack_pointer"));
+    SymbolicTree::setToDefaultConfiguration();
+    SymbolicTree::setAbi(TheAbi.get());
+    RDA.runOnModule(*M, TheAbi.get());
+  }
+  void TearDown() override {
+    SymbolicTree::setMemo(nullptr);
+    SymbolicTree::clear();
+  }
+
+  Value *get(StringRef Name) {
+    for (auto &I : instructions(*M->getFunction("f"))) {
+      if (I.getName() == Name) {
+        return &I;
+      }
+    }
+    return nullptr;
+  }
+  // simplified tree, computed with the memo that is set, if any.
+  std::optional<SymbolicTree> simplified(StringRef Name) {
+    return SymbolicTree::PrecomputedRdaWithValueMapSimplified(RDA, get(Name),
+                                                              &Val2Val);
+  }
+  // simplified tree, computed without memo.
+  std::optional<SymbolicTree> expected(StringRef Name) {
+    SymbolicTree::setMemo(nullptr);
+    auto Ret = simplified(Name);
+    SymbolicTree::setMemo(&Memo);
+    return Ret;
+  }
+  void setBaseOffset(int64_t Off) {
+    cast<Instruction>(get("base"))
+        ->setOperand(1, ConstantInt::getSigned(Type::getInt32Ty(C), Off));
+  }
+
+  LLVMContext C;
+  std::unique_ptr<Module> M;
+  std::unique_ptr<Abi> TheAbi;
+  ReachingDefinitionsAnalysis RDA;
+  std::map<Value *, Value *> Val2Val;
+  SymbolicTreeMemo Memo;
+};
+
+TEST_F(SymbolicTreeMemoTest, SameResultAsWithoutMemo) {
+  ASSERT_TRUE(M != nullptr);
+  auto A = expected("a");
+  auto B = expected("b");
+  ASSERT_TRUE(A.has_value() && B.has_value());
+  EXPECT_NE(*A, *B);
+
+  SymbolicTree::setMemo(&Memo);
+  for (int Round = 0; Round < 2; Round++) {
+    auto MA = simplified("a");
+    auto MB = simplified("b");
+    ASSERT_TRUE(MA.has_value() && MB.has_value());
+    EXPECT_EQ(*MA, *A);
+    EXPECT_EQ(*MB, *B);
+  }
+  // a full tree of a memoized value simplifies the same way.
+  auto Tree = SymbolicTree::PrecomputedRdaWithValueMap(RDA, get("a"), &Val2Val);
+  Tree.simplifyNode();
+  EXPECT_EQ(Tree, *A);
+}
+
+TEST_F(SymbolicTreeMemoTest, ReusesCachedResultUntilInvalidated) {
+  ASSERT_TRUE(M != nullptr);
+  SymbolicTree::setMemo(&Memo);
+  auto Before = simplified("a");
+  ASSERT_TRUE(Before.has_value());
+
+  setBaseOffset(-32);
+  auto Changed = expected("a");
+  ASSERT_TRUE(Changed.has_value());
+  ASSERT_NE(*Changed, *Before);
+
+  // the IR changed behind the memo, so the cached result is returned.
+  auto Cached = simplified("a");
+  ASSERT_TRUE(Cached.has_value());
+  EXPECT_EQ(*Cached, *Before);
+
+  // invalidating the frame base drops it and the slots built on it.
+  Memo.invalidate(get("base"));
+  auto A = simplified("a");
+  auto B = simplified("b");
+  ASSERT_TRUE(A.has_value() && B.has_value());
+  EXPECT_EQ(*A, *Changed);
+  EXPECT_EQ(*B, *expected("b"));
+}
+
+TEST_F(SymbolicTreeMemoTest, TreeHeldAcrossInvalidate) {
+  ASSERT_TRUE(M != nullptr);
+  SymbolicTree::setMemo(&Memo);
+  auto Held = SymbolicTree::PrecomputedRdaWithValueMap(RDA, get("a"), &Val2Val);
+  auto Old = expected("a");
+  ASSERT_TRUE(Old.has_value());
+
+  setBaseOffset(-32);
+  Memo.invalidate(get("base"));
+  // a new entry for the same key, with the new offset.
+  auto New = simplified("a");
+  ASSERT_TRUE(New.has_value());
+  EXPECT_EQ(*New, *expected("a"));
+
+  // the held tree keeps the old structure and does not take the result of
+  // the new entry.
+  Held.simplifyNode();
+  EXPECT_EQ(Held, *Old);
+  EXPECT_NE(Held, *New);
+}
+
+TEST_F(SymbolicTreeMemoTest, ClearStartsOver) {
+  ASSERT_TRUE(M != nullptr);
+  SymbolicTree::setMemo(&Memo);
+  auto Held = SymbolicTree::PrecomputedRdaWithValueMap(RDA, get("b"), &Val2Val);
+  ASSERT_TRUE(simplified("b").has_value());
+  auto Old = expected("b");
+
+  setBaseOffset(-32);
+  Memo.clear();
+  auto B = simplified("b");
+  ASSERT_TRUE(B.has_value());
+  EXPECT_EQ(*B, *expected("b"));
+  EXPECT_NE(*B, *Old);
+  Held.simplifyNode();
+  EXPECT_EQ(Held, *Old);
+}
+
+// A call has a use for each argument, each with its own definitions.
+TEST(ReachingDefinitions, CallArgumentUses) {
+  LLVMContext C;
+  SMDiagnostic Err;
+  auto M = parseAssemblyString(R"(
+declare void @g(i32*, i32*)
+define i32 @f() {
+  %x = alloca i32
+  %y = alloca i32
+  store i32 1, i32* %x
+  store i32 2, i32* %y
+  call void @g(i32* %x, i32* %y)
+  %v = load i32, i32* %y
+  ret i32 %v
+}
+)",
+                               Err, C);
+  ASSERT_TRUE(M != nullptr);
+  Abi TheAbi(M.get());
+  ReachingDefinitionsAnalysis RDA;
+  RDA.runOnModule(*M, &TheAbi);
+
+  std::map<StringRef, Instruction *> Insts;
+  Instruction *Call = nullptr;
+  std::vector<Instruction *> Stores;
+  for (auto &I : instructions(*M->getFunction("f"))) {
+    Insts[I.getName()] = &I;
+    if (isa<CallInst>(I)) {
+      Call = &I;
+    } else if (isa<StoreInst>(I)) {
+      Stores.push_back(&I);
+    }
+  }
+  ASSERT_TRUE(Call != nullptr);
+  ASSERT_EQ(Stores.size(), 2u);
+  auto DefsX = RDA.defsFromUse(Call, Insts["x"]);
+  ASSERT_EQ(DefsX.size(), 1u);
+  EXPECT_EQ(DefsX[0]->def, Stores[0]);
+  auto DefsY = RDA.defsFromUse(Call, Insts["y"]);
+  ASSERT_EQ(DefsY.size(), 1u);
+  EXPECT_EQ(DefsY[0]->def, Stores[1]);
+  // single use instructions are found by the pointer operand.
+  auto DefsV = RDA.defsFromUse(Insts["v"]);
+  ASSERT_EQ(DefsV.size(), 1u);
+  EXPECT_EQ(DefsV[0]->def, Stores[1]);
+}
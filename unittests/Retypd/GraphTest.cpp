@@ -1,13 +1,17 @@
+#include "TypeRecovery/BinaryFormat.h"
 #include "TypeRecovery/ConstraintGraph.h"
+#include "TypeRecovery/DotSummaryParser.h"
 #include "TypeRecovery/Parser.h"
 #include "TypeRecovery/RExp.h"
 #include "TypeRecovery/retypd/Schema.h"
 #include "TypeRecovery/TRContext.h"
+#include <algorithm>
 #include <cstddef>
 #include <gtest/gtest.h>
 #include <llvm/ADT/SmallPtrSet.h>
 #include <llvm/Support/Debug.h>
 #include <memory>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -215,3 +219,160 @@ TEST(Retypd, EdgeLabel1) {
   EXPECT_TRUE(EL1 != EL2);
   EXPECT_FALSE(EL1 == EL2);
 }
+
+// The per-node offset index follows the recall offset edges.
+static void checkOffsetIndex(ConstraintGraph &CG) {
+  for (auto &N : CG) {
+    std::multiset<notdec::OffsetTy> Offsets;
+    for (auto &E : N.outEdges) {
+      if (auto *RL = E.getLabel().getAs<notdec::retypd::RecallLabel>()) {
+        if (auto *OL = RL->label.getAs<notdec::retypd::OffsetLabel>()) {
+          Offsets.insert(OL->range.offset);
+        }
+      }
+    }
+    std::multiset<notdec::OffsetTy> Indexed;
+    for (auto &Ent : N.OffsetEdges) {
+      EXPECT_EQ(&Ent.second->getSourceNode(), &N);
+      Indexed.insert(Ent.first);
+    }
+    EXPECT_EQ(Indexed, Offsets);
+  }
+}
+
+TEST(Retypd, OffsetIndex) {
+  std::shared_ptr<TRContext> Ctx = std::make_shared<TRContext>();
+  std::vector<notdec::retypd::Constraint> cons = parse_constraints(
+      *Ctx, {"x.@8 <= A", "x.@0 <= B", "x.@4 <= C"}, 32);
+  std::map<TypeVariable, std::string> PNIMap = {
+      {parseTV(*Ctx, "x"), "ptr 32 #1"}, {parseTV(*Ctx, "A"), "ptr 32 #1"},
+      {parseTV(*Ctx, "B"), "ptr 32 #1"}, {parseTV(*Ctx, "C"), "ptr 32 #1"},
+  };
+  ConstraintSummary Sum{.Cons = cons, .PointerSize = 32, .PNIMap = PNIMap};
+  ConstraintGraph CG = ConstraintGraph::fromConstraints(Ctx, "Offsets", Sum);
+  checkOffsetIndex(CG);
+
+  // the index is ordered by offset, whatever the order of the edges.
+  bool Found = false;
+  for (auto &N : CG) {
+    if (N.OffsetEdges.size() < 3) {
+      continue;
+    }
+    Found = true;
+    std::vector<notdec::OffsetTy> Keys;
+    for (auto &Ent : N.OffsetEdges) {
+      Keys.push_back(Ent.first);
+    }
+    EXPECT_TRUE(std::is_sorted(Keys.begin(), Keys.end()));
+
+    // removing an edge drops it from the index.
+    auto *E = N.OffsetEdges.begin()->second;
+    CG.removeEdge(N, const_cast<notdec::retypd::CGNode &>(E->getTargetNode()),
+                  E->getLabel());
+    EXPECT_EQ(N.OffsetEdges.size(), Keys.size() - 1);
+  }
+  EXPECT_TRUE(Found);
+  checkOffsetIndex(CG);
+}
+
+// Binary summary and graph snapshot round trip.
+TEST(Retypd, BinaryFormatRoundTrip) {
+  std::shared_ptr<TRContext> Ctx = std::make_shared<TRContext>();
+  std::vector<notdec::retypd::Constraint> cons = parse_constraints(
+      *Ctx, {"x.@2 <= C", "C.@4+8 <= D", "A <= x.load4", "D.store4 <= #int"},
+      32);
+  std::map<TypeVariable, std::string> PNIMap = {
+      {parseTV(*Ctx, "x"), "ptr 32 #1"},  {parseTV(*Ctx, "C"), "ptr 32 #1"},
+      {parseTV(*Ctx, "D"), "ptr 32 #1"},  {parseTV(*Ctx, "A"), "int 4 #2"},
+      {parseTV(*Ctx, "#int"), "int 4 #2"},
+  };
+  ConstraintSummary Sum{.Cons = cons, .PointerSize = 32, .PNIMap = PNIMap};
+
+  auto BinOrNone = notdec::retypd::writeBinarySummary(Sum);
+  ASSERT_TRUE(BinOrNone.has_value());
+  std::string Bin = *BinOrNone;
+  EXPECT_EQ(notdec::retypd::getBinaryKind(Bin),
+            notdec::retypd::BinaryKind::Summary);
+  auto Sum2 = notdec::retypd::readBinarySummary(*Ctx, Bin);
+  ASSERT_TRUE(Sum2.has_value());
+  ASSERT_EQ(Sum2->Cons.size(), Sum.Cons.size());
+  for (size_t I = 0; I < Sum.Cons.size(); I++) {
+    EXPECT_EQ(notdec::retypd::toString(Sum2->Cons[I]),
+              notdec::retypd::toString(Sum.Cons[I]));
+  }
+  EXPECT_EQ(Sum2->PNIMap, Sum.PNIMap);
+  // truncated file is rejected.
+  EXPECT_FALSE(notdec::retypd::readBinarySummary(
+                   *Ctx, llvm::StringRef(Bin).drop_back(4))
+                   .has_value());
+
+  ConstraintGraph CG = ConstraintGraph::fromConstraints(Ctx, "Binary", Sum);
+  std::string GBin = notdec::retypd::writeBinaryGraph(CG);
+  ConstraintGraph CG2(Ctx, 32, "Binary");
+  ASSERT_TRUE(notdec::retypd::readBinaryGraph(GBin, CG2));
+  EXPECT_EQ(CG2.Nodes.size(), CG.Nodes.size());
+  size_t Edges = 0, Edges2 = 0;
+  for (auto &N : CG) {
+    Edges += N.outEdges.size();
+  }
+  for (auto &N : CG2) {
+    Edges2 += N.outEdges.size();
+  }
+  EXPECT_EQ(Edges2, Edges);
+
+  // summary library lookup.
+  std::string Lib = notdec::retypd::writeBinaryLibrary(
+      {{"puts", Bin}, {"f,g", Bin}, {"abort", ""}}, 32);
+  auto L = notdec::retypd::SummaryLibrary::create(
+      llvm::MemoryBuffer::getMemBuffer(Lib, "Lib", false));
+  ASSERT_NE(L, nullptr);
+  EXPECT_EQ(L->size(), 3u);
+  EXPECT_EQ(L->lookup("puts"), llvm::StringRef(Bin));
+  EXPECT_EQ(L->lookup("abort"), llvm::StringRef(""));
+  EXPECT_FALSE(L->lookup("f").has_value());
+  ASSERT_EQ(L->multiFunctionEntries().size(), 1u);
+  EXPECT_EQ(L->multiFunctionEntries()[0].first, "f,g");
+}
+
+// printGraph output read back by parseDotSummary and fromDotSummary.
+TEST(Retypd, DotRoundTrip) {
+  std::shared_ptr<TRContext> Ctx = std::make_shared<TRContext>();
+  std::vector<notdec::retypd::Constraint> cons = parse_constraints(
+      *Ctx, {"x.@2 <= C", "C.@4+8 <= D", "A <= x.load4", "D.store4 <= #int"},
+      32);
+  std::map<TypeVariable, std::string> PNIMap = {
+      {parseTV(*Ctx, "x"), "ptr 32 #1"},  {parseTV(*Ctx, "C"), "ptr 32 #1"},
+      {parseTV(*Ctx, "D"), "ptr 32 #1"},  {parseTV(*Ctx, "A"), "int 4 #2"},
+      {parseTV(*Ctx, "#int"), "int 4 #2"},
+  };
+  ConstraintSummary Sum{.Cons = cons, .PointerSize = 32, .PNIMap = PNIMap};
+  ConstraintGraph CG = ConstraintGraph::fromConstraints(Ctx, "Dot", Sum);
+
+  std::string Dot;
+  llvm::raw_string_ostream OS(Dot);
+  OS << "// f\n";
+  CG.printGraph(OS);
+  OS.flush();
+  auto Graphs = notdec::retypd::parseDotSummary(Dot);
+  ASSERT_EQ(Graphs.size(), 1u);
+  EXPECT_EQ(llvm::StringRef(Graphs[0].first).trim(), "f");
+
+  ConstraintGraph CG2(Ctx, 32, "Dot");
+  ASSERT_TRUE(CG2.fromDotSummary(Graphs[0].second));
+  std::set<std::string> Edges, Edges2;
+  for (auto &N : CG) {
+    for (auto &E : N.outEdges) {
+      Edges.insert(N.key.str() + " " + notdec::retypd::toString(E.getLabel()) +
+                   " " + E.getTargetNode().key.str());
+    }
+  }
+  for (auto &N : CG2) {
+    for (auto &E : N.outEdges) {
+      Edges2.insert(N.key.str() + " " +
+                    notdec::retypd::toString(E.getLabel()) + " " +
+                    E.getTargetNode().key.str());
+    }
+  }
+  EXPECT_EQ(CG2.Nodes.size(), CG.Nodes.size());
+  EXPECT_EQ(Edges2, Edges);
+}
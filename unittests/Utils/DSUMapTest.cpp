@@ -0,0 +1,115 @@
+#include "Utils/DSUMap.h"
+#include "Utils/ExtValuePtrInfo.h"
+#include <gtest/gtest.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Type.h>
+#include <string>
+#include <vector>
+
+using notdec::DSUMap;
+
+TEST(DSUMap, MergeMovesAllKeys) {
+  DSUMap<std::string, int> M;
+  M.insert("a", 1);
+  M.insert("b", 1);
+  M.insert("c", 2);
+  EXPECT_FALSE(M.insert("a", 3).second);
+
+  // the smaller set is linked to the larger, but keys follow the new value.
+  M.merge(1, 2);
+  EXPECT_EQ(M.at("a"), 2);
+  EXPECT_EQ(M.at("b"), 2);
+  EXPECT_EQ(M.at("c"), 2);
+  EXPECT_EQ(M.count(1), 0u);
+  EXPECT_EQ(M.keys(2).size(), 3u);
+
+  M.merge(2, 4);
+  M.insert("d", 4);
+  for (auto &Ent : M) {
+    EXPECT_EQ(Ent.second, 4);
+  }
+  EXPECT_EQ(M.size(), 4u);
+}
+
+TEST(DSUMap, InsertMapped) {
+  DSUMap<std::string, int> M;
+  M.insert("a", 1);
+  M.insert("b", 2);
+  M.insert("c", 3);
+  M.merge(3, 2);
+
+  DSUMap<std::string, int> N;
+  EXPECT_TRUE(N.insertMapped(M, [](int V) { return V == 1 ? 10 : 20; }));
+  EXPECT_EQ(N.at("a"), 10);
+  EXPECT_EQ(N.at("c"), 20);
+  N.merge(10, 20);
+  EXPECT_EQ(N.keys(20).size(), 3u);
+
+  EXPECT_FALSE(N.insertMapped(M, [](int V) { return V; }));
+}
+
+TEST(DSUMap, DenseMapKeys) {
+  DSUMap<int *, int, llvm::DenseMap<int *, std::size_t>> M;
+  int X[3];
+  M.insert(&X[0], 1);
+  M.insert(&X[1], 2);
+  M.insert(&X[2], 2);
+  M.merge(2, 1);
+  EXPECT_EQ(M.at(&X[2]), 1);
+  EXPECT_EQ(M.find(&X[1])->second, 1);
+  EXPECT_EQ(M.keys(1).size(), 3u);
+  EXPECT_EQ(M.count(2), 0u);
+}
+
+TEST(DSUMap, InsertionOrder) {
+  // iteration must not depend on the addresses of pointer keys.
+  DSUMap<int *, int, llvm::DenseMap<int *, std::size_t>> M;
+  int X[64];
+  std::vector<int *> Order;
+  for (int I = 0; I < 64; ++I) {
+    Order.push_back(&X[(I * 37) % 64]);
+    M.insert(Order.back(), I % 4);
+  }
+  M.merge(3, 0);
+  std::size_t Pos = 0;
+  for (auto &Ent : M) {
+    EXPECT_EQ(Ent.first, Order[Pos]);
+    EXPECT_EQ(Ent.second, Pos % 4 == 3 ? 0 : int(Pos % 4));
+    ++Pos;
+  }
+  EXPECT_EQ(Pos, 64u);
+
+  DSUMap<int *, int, llvm::DenseMap<int *, std::size_t>> N;
+  N.insertMapped(M, [](int V) { return V + 1; });
+  EXPECT_EQ(N.begin()->first, Order[0]);
+  EXPECT_EQ(std::next(N.begin(), 5)->first, Order[5]);
+  EXPECT_EQ(N.find(Order[7])->second, 1);
+}
+
+// Uses of the same constant are different keys and must not share a hash,
+// or every use of a common constant ends up in one probe chain.
+TEST(DSUMap, ConstantUseKeys) {
+  using Info = llvm::DenseMapInfo<notdec::ExtValuePtr>;
+  llvm::LLVMContext C;
+  auto *Zero = llvm::ConstantInt::get(llvm::Type::getInt32Ty(C), 0);
+  char Users[2];
+  notdec::ExtValuePtr A = notdec::UConstant{
+      .Val = Zero, .User = reinterpret_cast<llvm::User *>(&Users[0]), .OpInd = 0};
+  notdec::ExtValuePtr B = notdec::UConstant{
+      .Val = Zero, .User = reinterpret_cast<llvm::User *>(&Users[1]), .OpInd = 0};
+  notdec::ExtValuePtr A1 = notdec::UConstant{
+      .Val = Zero, .User = reinterpret_cast<llvm::User *>(&Users[0]), .OpInd = 1};
+  EXPECT_NE(Info::getHashValue(A), Info::getHashValue(B));
+  EXPECT_NE(Info::getHashValue(A), Info::getHashValue(A1));
+
+  DSUMap<notdec::ExtValuePtr, int,
+         llvm::DenseMap<notdec::ExtValuePtr, std::size_t>>
+      M;
+  M.insert(A, 1);
+  M.insert(B, 2);
+  M.insert(A1, 3);
+  EXPECT_EQ(M.at(A), 1);
+  EXPECT_EQ(M.at(B), 2);
+  EXPECT_EQ(M.at(A1), 3);
+}